@@ -10,7 +10,7 @@
 [org 0x7C00]
 
 %ifndef KERNEL_MAX_SECTORS
-%define KERNEL_MAX_SECTORS 300
+%define KERNEL_MAX_SECTORS 600
 %endif
 
 %ifndef STAGE2_SECTORS
@@ -26,22 +26,18 @@ VIDEO_PAGE          equ 0x00        ; Display page number
 STAGE2_ADDR         equ 0x7E00      ; Load address for stage 2 + kernel
 DISK_READ_SECTORS   equ (STAGE2_SECTORS + KERNEL_MAX_SECTORS)
 FIRST_READ_SECTORS  equ 65          ; Max sectors from 0x7E00 without 64KB wrap
-SECOND_READ_SEG     equ 0x1000      ; Physical 0x10000, contiguous after first chunk
-SECOND_READ_MAX     equ 127         ; INT 13h extensions packet read limit
-
-%if ((DISK_READ_SECTORS - FIRST_READ_SECTORS) > SECOND_READ_MAX)
-%define SECOND_READ_SECTORS SECOND_READ_MAX
-%define THIRD_READ_SECTORS ((DISK_READ_SECTORS - FIRST_READ_SECTORS) - SECOND_READ_MAX)
-%else
-%define SECOND_READ_SECTORS (DISK_READ_SECTORS - FIRST_READ_SECTORS)
-%define THIRD_READ_SECTORS 0
+NEXT_READ_SEG       equ 0x1000      ; Physical 0x10000, contiguous after first chunk
+READ_CHUNK_MAX      equ 127         ; INT 13h extensions packet read limit
+
+; Preprocessor checks cannot see equ values, so they use the macros directly
+%if (STAGE2_SECTORS + KERNEL_MAX_SECTORS) <= 65
+%error "Stage 2 and kernel must span more than the first INT13 read chunk."
 %endif
 
-%if THIRD_READ_SECTORS > SECOND_READ_MAX
-%error "KERNEL_MAX_SECTORS too large for current 3-chunk INT13 read strategy."
+%if (0x7E00 + (STAGE2_SECTORS + KERNEL_MAX_SECTORS) * 512) > 0x80000
+%error "KERNEL_MAX_SECTORS too large: the load would reach the stage 2 stack."
 %endif
 
-THIRD_READ_SEG      equ (SECOND_READ_SEG + ((SECOND_READ_SECTORS * 512) / 16))
 DISK_READ_RETRIES   equ 3           ; Retry count for disk reads
 
 ; ---------------------------------------------------------------------------
@@ -70,8 +66,8 @@ start:
 
     ; =================================================================
     ; Load stage 2 + kernel from disk via INT 13h extensions (AH=42h)
-    ;   LBA 1 onward (right after MBR), split into two reads to avoid
-    ;   crossing a 64KB segment boundary in the transfer buffer.
+    ;   LBA 1 onward (right after MBR), split into chunks of at most 127
+    ;   sectors so no transfer buffer crosses a 64KB segment boundary.
     ; =================================================================
     mov si, msg_load
     call print_string
@@ -110,33 +106,37 @@ start:
     int 0x13
     jc .read_fail
 
-    ; Second chunk: up to 127 sectors into 0x1000:0x0000 (phys 0x10000)
-    mov word [dap_sector_count], SECOND_READ_SECTORS
+    ; Remaining chunks: up to 127 sectors each, starting at 0x1000:0x0000
+    ; (phys 0x10000) and each one contiguous after the previous one
     mov word [dap_buffer_offset], 0x0000
-    mov word [dap_buffer_segment], SECOND_READ_SEG
+    mov word [dap_buffer_segment], NEXT_READ_SEG
     mov dword [dap_lba_low], (1 + FIRST_READ_SECTORS)
-    mov dword [dap_lba_high], 0
-
+    mov cx, (DISK_READ_SECTORS - FIRST_READ_SECTORS)   ; CX = sectors left
+
+.read_chunk:
+    mov bx, cx
+    cmp bx, READ_CHUNK_MAX
+    jbe .chunk_sized
+    mov bx, READ_CHUNK_MAX
+.chunk_sized:
+    mov [dap_sector_count], bx
+
+    push bx
+    push cx
     mov ah, 0x42
     mov dl, [boot_drive]
     mov si, dap_packet
     int 0x13
+    pop cx                          ; pop leaves CF intact
+    pop bx
     jc .read_fail
 
-%if THIRD_READ_SECTORS > 0
-    ; Third chunk: any remaining sectors, contiguous after second chunk.
-    mov word [dap_sector_count], THIRD_READ_SECTORS
-    mov word [dap_buffer_offset], 0x0000
-    mov word [dap_buffer_segment], THIRD_READ_SEG
-    mov dword [dap_lba_low], (1 + FIRST_READ_SECTORS + SECOND_READ_SECTORS)
-    mov dword [dap_lba_high], 0
-
-    mov ah, 0x42
-    mov dl, [boot_drive]
-    mov si, dap_packet
-    int 0x13
-    jc .read_fail
-%endif
+    sub cx, bx
+    add [dap_lba_low], bx           ; LBA stays below 64K; high word is 0
+    shl bx, 5                       ; sectors * 512 / 16 = paragraphs
+    add [dap_buffer_segment], bx
+    test cx, cx
+    jnz .read_chunk
 
     jmp .read_ok
 
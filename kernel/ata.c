@@ -5,9 +5,12 @@
 #include "io.h"
 #include "serial.h"
 #include "spinlock.h"
+#include "sync.h"
 
 #define ATA_PRIMARY_IO_BASE          0x1F0U
 #define ATA_PRIMARY_CTRL_BASE        0x3F6U
+#define ATA_SECONDARY_IO_BASE        0x170U
+#define ATA_SECONDARY_CTRL_BASE      0x376U
 
 #define ATA_REG_DATA                 0x00U
 #define ATA_REG_ERROR                0x01U
@@ -24,6 +27,8 @@
 #define ATA_REG_DEVICE_CONTROL       0x00U
 
 #define ATA_CMD_READ_SECTORS         0x20U
+#define ATA_CMD_WRITE_SECTORS        0x30U
+#define ATA_CMD_CACHE_FLUSH          0xE7U
 #define ATA_CMD_IDENTIFY             0xECU
 
 #define ATA_STATUS_ERR               0x01U
@@ -40,8 +45,12 @@ struct ata_drive_info {
     uint32_t total_sectors;
 };
 
-static struct ata_drive_info ata_primary_drives[2];
-static struct spinlock ata_lock = SPINLOCK_INITIALIZER;
+static struct ata_drive_info ata_drives[ATA_DRIVE_COUNT];
+static uint8_t ata_probed;
+static struct spinlock ata_lock = SPINLOCK_INITIALIZER;   /* guards probing */
+/* Serializes transfers. A task waiting for the drive sleeps, and the PIO
+ * data phase runs with IRQs on so the timer and other devices keep going. */
+static struct mutex ata_mutex;
 
 static void serial_put_u32(uint32_t value)
 {
@@ -65,38 +74,45 @@ static void serial_put_u32(uint32_t value)
     }
 }
 
-static uint16_t ata_io_reg(uint16_t reg)
+/* Drives 0/1 sit on the primary channel, 2/3 on the secondary one */
+static uint16_t ata_io_reg(uint8_t drive, uint16_t reg)
 {
-    return (uint16_t)(ATA_PRIMARY_IO_BASE + reg);
+    uint16_t base = (drive >= ATA_DRIVE_SECONDARY_MASTER) ?
+                    (uint16_t)ATA_SECONDARY_IO_BASE : (uint16_t)ATA_PRIMARY_IO_BASE;
+
+    return (uint16_t)(base + reg);
 }
 
-static uint16_t ata_ctrl_reg(uint16_t reg)
+static uint16_t ata_ctrl_reg(uint8_t drive, uint16_t reg)
 {
-    return (uint16_t)(ATA_PRIMARY_CTRL_BASE + reg);
+    uint16_t base = (drive >= ATA_DRIVE_SECONDARY_MASTER) ?
+                    (uint16_t)ATA_SECONDARY_CTRL_BASE : (uint16_t)ATA_PRIMARY_CTRL_BASE;
+
+    return (uint16_t)(base + reg);
 }
 
-static void ata_400ns_delay(void)
+static void ata_400ns_delay(uint8_t drive)
 {
-    (void)inb(ata_ctrl_reg(ATA_REG_ALT_STATUS));
-    (void)inb(ata_ctrl_reg(ATA_REG_ALT_STATUS));
-    (void)inb(ata_ctrl_reg(ATA_REG_ALT_STATUS));
-    (void)inb(ata_ctrl_reg(ATA_REG_ALT_STATUS));
+    (void)inb(ata_ctrl_reg(drive, ATA_REG_ALT_STATUS));
+    (void)inb(ata_ctrl_reg(drive, ATA_REG_ALT_STATUS));
+    (void)inb(ata_ctrl_reg(drive, ATA_REG_ALT_STATUS));
+    (void)inb(ata_ctrl_reg(drive, ATA_REG_ALT_STATUS));
 }
 
 static void ata_select_drive(uint8_t drive, uint8_t lba_high_nibble)
 {
     uint8_t value = (uint8_t)(0xE0U | ((drive & 0x01U) << 4U) |
                               (lba_high_nibble & 0x0FU));
-    outb(ata_io_reg(ATA_REG_HDDEVSEL), value);
-    ata_400ns_delay();
+    outb(ata_io_reg(drive, ATA_REG_HDDEVSEL), value);
+    ata_400ns_delay(drive);
 }
 
-static int ata_wait_not_busy(void)
+static int ata_wait_not_busy(uint8_t drive)
 {
     uint32_t spins = ATA_POLL_SPINS;
 
     while (spins > 0U) {
-        uint8_t status = inb(ata_io_reg(ATA_REG_STATUS));
+        uint8_t status = inb(ata_io_reg(drive, ATA_REG_STATUS));
         if ((status & ATA_STATUS_BSY) == 0U) {
             return 0;
         }
@@ -106,17 +122,17 @@ static int ata_wait_not_busy(void)
     return -1;
 }
 
-static int ata_poll_data_ready(uint8_t ignore_initial_error)
+static int ata_poll_data_ready(uint8_t drive, uint8_t ignore_initial_error)
 {
     uint32_t spins = ATA_POLL_SPINS;
     uint8_t status = 0U;
 
-    if (ata_wait_not_busy() != 0) {
+    if (ata_wait_not_busy(drive) != 0) {
         return -1;
     }
 
     while (spins > 0U) {
-        status = inb(ata_io_reg(ATA_REG_STATUS));
+        status = inb(ata_io_reg(drive, ATA_REG_STATUS));
 
         if (ignore_initial_error != 0U && spins > (ATA_POLL_SPINS - 4U)) {
             spins--;
@@ -142,12 +158,12 @@ static int ata_poll_data_ready(uint8_t ignore_initial_error)
     return -1;
 }
 
-static void ata_read_data_words(uint8_t *dst)
+static void ata_read_data_words(uint8_t drive, uint8_t *dst)
 {
     uint32_t i;
 
     for (i = 0U; i < ATA_IDENTIFY_WORDS; i++) {
-        uint16_t word = inw(ata_io_reg(ATA_REG_DATA));
+        uint16_t word = inw(ata_io_reg(drive, ATA_REG_DATA));
         dst[(i * 2U)] = (uint8_t)(word & 0xFFU);
         dst[(i * 2U) + 1U] = (uint8_t)((word >> 8U) & 0xFFU);
     }
@@ -161,36 +177,36 @@ static uint32_t ata_probe_drive(uint8_t drive, uint32_t *total_sectors)
     uint8_t lba_high;
     uint32_t sectors;
 
-    if (total_sectors == 0 || drive > ATA_DRIVE_SLAVE) {
+    if (total_sectors == 0 || drive >= ATA_DRIVE_COUNT) {
         return 0U;
     }
 
     ata_select_drive(drive, 0U);
 
-    outb(ata_io_reg(ATA_REG_SECTOR_COUNT), 0U);
-    outb(ata_io_reg(ATA_REG_LBA0), 0U);
-    outb(ata_io_reg(ATA_REG_LBA1), 0U);
-    outb(ata_io_reg(ATA_REG_LBA2), 0U);
+    outb(ata_io_reg(drive, ATA_REG_SECTOR_COUNT), 0U);
+    outb(ata_io_reg(drive, ATA_REG_LBA0), 0U);
+    outb(ata_io_reg(drive, ATA_REG_LBA1), 0U);
+    outb(ata_io_reg(drive, ATA_REG_LBA2), 0U);
 
-    outb(ata_io_reg(ATA_REG_COMMAND), ATA_CMD_IDENTIFY);
-    ata_400ns_delay();
+    outb(ata_io_reg(drive, ATA_REG_COMMAND), ATA_CMD_IDENTIFY);
+    ata_400ns_delay(drive);
 
-    status = inb(ata_io_reg(ATA_REG_STATUS));
+    status = inb(ata_io_reg(drive, ATA_REG_STATUS));
     if (status == 0U || status == 0xFFU) {
         return 0U;
     }
 
-    lba_mid = inb(ata_io_reg(ATA_REG_LBA1));
-    lba_high = inb(ata_io_reg(ATA_REG_LBA2));
+    lba_mid = inb(ata_io_reg(drive, ATA_REG_LBA1));
+    lba_high = inb(ata_io_reg(drive, ATA_REG_LBA2));
     if (lba_mid != 0U || lba_high != 0U) {
         return 0U;
     }
 
-    if (ata_poll_data_ready(0U) != 0) {
+    if (ata_poll_data_ready(drive, 0U) != 0) {
         return 0U;
     }
 
-    ata_read_data_words(identify_data);
+    ata_read_data_words(drive, identify_data);
 
     sectors = (uint32_t)identify_data[120] |
               ((uint32_t)identify_data[121] << 8U) |
@@ -212,20 +228,31 @@ void ata_init(void)
     uint8_t drive;
 
     flags = spinlock_lock_irqsave(&ata_lock);
+    if (ata_probed != 0U) {
+        spinlock_unlock_irqrestore(&ata_lock, flags);
+        return;
+    }
+    ata_probed = 1U;
+    mutex_init(&ata_mutex);
 
-    outb(ata_ctrl_reg(ATA_REG_DEVICE_CONTROL), 0U);
-    ata_400ns_delay();
+    for (drive = ATA_DRIVE_MASTER; drive < ATA_DRIVE_COUNT; drive++) {
+        ata_drives[drive].present = 0U;
+        ata_drives[drive].total_sectors = 0U;
 
-    for (drive = ATA_DRIVE_MASTER; drive <= ATA_DRIVE_SLAVE; drive++) {
-        ata_primary_drives[drive].present = 0U;
-        ata_primary_drives[drive].total_sectors = 0U;
+        /* Once per channel: clear SRST/nIEN. A floating bus reads 0xFF. */
+        if ((drive & 0x01U) == 0U) {
+            outb(ata_ctrl_reg(drive, ATA_REG_DEVICE_CONTROL), 0U);
+            ata_400ns_delay(drive);
+        }
 
-        if (ata_probe_drive(drive, &sectors) != 0U) {
-            ata_primary_drives[drive].present = 1U;
-            ata_primary_drives[drive].total_sectors = sectors;
+        if (inb(ata_io_reg(drive, ATA_REG_STATUS)) != 0xFFU &&
+            ata_probe_drive(drive, &sectors) != 0U) {
+            ata_drives[drive].present = 1U;
+            ata_drives[drive].total_sectors = sectors;
 
-            serial_puts("[ATA] primary ");
-            serial_puts((drive == ATA_DRIVE_MASTER) ? "master" : "slave");
+            serial_puts((drive < ATA_DRIVE_SECONDARY_MASTER) ? "[ATA] primary " :
+                                                               "[ATA] secondary ");
+            serial_puts(((drive & 0x01U) == 0U) ? "master" : "slave");
             serial_puts(" present sectors=");
             serial_put_u32(sectors);
             serial_puts("\n");
@@ -237,32 +264,31 @@ void ata_init(void)
 
 uint8_t ata_drive_present(uint8_t drive)
 {
-    if (drive > ATA_DRIVE_SLAVE) {
+    if (drive >= ATA_DRIVE_COUNT) {
         return 0U;
     }
 
-    return ata_primary_drives[drive].present;
+    return ata_drives[drive].present;
 }
 
 uint32_t ata_drive_total_sectors(uint8_t drive)
 {
-    if (drive > ATA_DRIVE_SLAVE) {
+    if (drive >= ATA_DRIVE_COUNT) {
         return 0U;
     }
 
-    return ata_primary_drives[drive].total_sectors;
+    return ata_drives[drive].total_sectors;
 }
 
 int ata_pio_read28(uint8_t drive, uint32_t lba, uint8_t sector_count, void *buffer)
 {
-    uint32_t flags;
     uint8_t *dst;
     uint32_t i;
     uint32_t sector;
     uint32_t total_sectors;
     uint8_t lba_hi;
 
-    if (buffer == 0 || drive > ATA_DRIVE_SLAVE || sector_count == 0U) {
+    if (buffer == 0 || drive >= ATA_DRIVE_COUNT || sector_count == 0U) {
         return -1;
     }
 
@@ -270,45 +296,109 @@ int ata_pio_read28(uint8_t drive, uint32_t lba, uint8_t sector_count, void *buff
         return -1;
     }
 
-    if (ata_primary_drives[drive].present == 0U) {
+    if (ata_drives[drive].present == 0U) {
         return -1;
     }
 
-    total_sectors = ata_primary_drives[drive].total_sectors;
+    total_sectors = ata_drives[drive].total_sectors;
     if (lba >= total_sectors ||
         (uint32_t)sector_count > (total_sectors - lba)) {
         return -1;
     }
 
     dst = (uint8_t *)buffer;
-    flags = spinlock_lock_irqsave(&ata_lock);
+    mutex_lock(&ata_mutex);
 
     lba_hi = (uint8_t)((lba >> 24U) & 0x0FU);
     ata_select_drive(drive, lba_hi);
 
-    outb(ata_io_reg(ATA_REG_FEATURES), 0U);
-    outb(ata_io_reg(ATA_REG_SECTOR_COUNT), sector_count);
-    outb(ata_io_reg(ATA_REG_LBA0), (uint8_t)(lba & 0xFFU));
-    outb(ata_io_reg(ATA_REG_LBA1), (uint8_t)((lba >> 8U) & 0xFFU));
-    outb(ata_io_reg(ATA_REG_LBA2), (uint8_t)((lba >> 16U) & 0xFFU));
-    outb(ata_io_reg(ATA_REG_COMMAND), ATA_CMD_READ_SECTORS);
+    outb(ata_io_reg(drive, ATA_REG_FEATURES), 0U);
+    outb(ata_io_reg(drive, ATA_REG_SECTOR_COUNT), sector_count);
+    outb(ata_io_reg(drive, ATA_REG_LBA0), (uint8_t)(lba & 0xFFU));
+    outb(ata_io_reg(drive, ATA_REG_LBA1), (uint8_t)((lba >> 8U) & 0xFFU));
+    outb(ata_io_reg(drive, ATA_REG_LBA2), (uint8_t)((lba >> 16U) & 0xFFU));
+    outb(ata_io_reg(drive, ATA_REG_COMMAND), ATA_CMD_READ_SECTORS);
 
     for (sector = 0U; sector < sector_count; sector++) {
-        if (ata_poll_data_ready(1U) != 0) {
-            spinlock_unlock_irqrestore(&ata_lock, flags);
+        if (ata_poll_data_ready(drive, 1U) != 0) {
+            mutex_unlock(&ata_mutex);
             return -1;
         }
 
         for (i = 0U; i < ATA_IDENTIFY_WORDS; i++) {
-            uint16_t word = inw(ata_io_reg(ATA_REG_DATA));
+            uint16_t word = inw(ata_io_reg(drive, ATA_REG_DATA));
             dst[(sector * 512U) + (i * 2U)] = (uint8_t)(word & 0xFFU);
             dst[(sector * 512U) + (i * 2U) + 1U] =
                 (uint8_t)((word >> 8U) & 0xFFU);
         }
 
-        ata_400ns_delay();
+        ata_400ns_delay(drive);
     }
 
-    spinlock_unlock_irqrestore(&ata_lock, flags);
+    mutex_unlock(&ata_mutex);
     return 0;
 }
+
+int ata_pio_write28(uint8_t drive, uint32_t lba, uint8_t sector_count, const void *buffer,
+                    uint8_t flush)
+{
+    const uint8_t *src;
+    uint32_t i;
+    uint32_t sector;
+    uint32_t total_sectors;
+    int rc = 0;
+
+    if (buffer == 0 || drive >= ATA_DRIVE_COUNT || sector_count == 0U) {
+        return -1;
+    }
+
+    if ((lba & 0xF0000000U) != 0U || ata_drives[drive].present == 0U) {
+        return -1;
+    }
+
+    total_sectors = ata_drives[drive].total_sectors;
+    if (lba >= total_sectors ||
+        (uint32_t)sector_count > (total_sectors - lba)) {
+        return -1;
+    }
+
+    src = (const uint8_t *)buffer;
+    mutex_lock(&ata_mutex);
+
+    ata_select_drive(drive, (uint8_t)((lba >> 24U) & 0x0FU));
+
+    outb(ata_io_reg(drive, ATA_REG_FEATURES), 0U);
+    outb(ata_io_reg(drive, ATA_REG_SECTOR_COUNT), sector_count);
+    outb(ata_io_reg(drive, ATA_REG_LBA0), (uint8_t)(lba & 0xFFU));
+    outb(ata_io_reg(drive, ATA_REG_LBA1), (uint8_t)((lba >> 8U) & 0xFFU));
+    outb(ata_io_reg(drive, ATA_REG_LBA2), (uint8_t)((lba >> 16U) & 0xFFU));
+    outb(ata_io_reg(drive, ATA_REG_COMMAND), ATA_CMD_WRITE_SECTORS);
+
+    for (sector = 0U; sector < sector_count && rc == 0; sector++) {
+        if (ata_poll_data_ready(drive, 1U) != 0) {
+            rc = -1;
+            break;
+        }
+
+        for (i = 0U; i < ATA_IDENTIFY_WORDS; i++) {
+            uint32_t at = (sector * 512U) + (i * 2U);
+            outw(ata_io_reg(drive, ATA_REG_DATA),
+                 (uint16_t)((uint16_t)src[at] | ((uint16_t)src[at + 1U] << 8U)));
+        }
+
+        ata_400ns_delay(drive);
+    }
+
+    /* The data is only durable once the drive's write cache is flushed */
+    if (rc == 0 && flush != 0U) {
+        outb(ata_io_reg(drive, ATA_REG_COMMAND), ATA_CMD_CACHE_FLUSH);
+        ata_400ns_delay(drive);
+        if (ata_wait_not_busy(drive) != 0 ||
+            (inb(ata_io_reg(drive, ATA_REG_STATUS)) & (ATA_STATUS_ERR | ATA_STATUS_DF)) != 0U) {
+            rc = -1;
+        }
+    }
+
+    mutex_unlock(&ata_mutex);
+    return rc;
+}
@@ -5,17 +5,28 @@
 
 #define ATA_DRIVE_MASTER    0U
 #define ATA_DRIVE_SLAVE     1U
+#define ATA_DRIVE_SECONDARY_MASTER  2U
+#define ATA_DRIVE_SECONDARY_SLAVE   3U
+#define ATA_DRIVE_COUNT     4U
 
-/* Probe primary-bus ATA drives and cache geometry/capabilities. */
+/* Probe ATA drives on both legacy channels and cache their geometry.
+ * Later calls are no-ops. */
 void ata_init(void);
 
-/* Return non-zero when selected primary-bus drive is present. */
+/* Return non-zero when the selected drive is present. */
 uint8_t ata_drive_present(uint8_t drive);
 
 /* Return total 28-bit addressable sectors for selected drive. */
 uint32_t ata_drive_total_sectors(uint8_t drive);
 
-/* Read sectors using primary-bus 28-bit LBA PIO path. Returns 0 on success. */
+/* Read sectors using the 28-bit LBA PIO path. Returns 0 on success. */
 int ata_pio_read28(uint8_t drive, uint32_t lba, uint8_t sector_count, void *buffer);
 
+/* Write sectors using the 28-bit LBA PIO path. A non-zero 'flush' also
+ * flushes the drive's write cache so the data survives power loss; scratch
+ * data such as swap can skip it. Returns 0 on success.
+ * Transfers may sleep, so neither call may be made from IRQ context. */
+int ata_pio_write28(uint8_t drive, uint32_t lba, uint8_t sector_count, const void *buffer,
+                    uint8_t flush);
+
 #endif /* CLAUDE_ATA_H */
@@ -0,0 +1,196 @@
+/* ==========================================================================
+ * ClaudeOS Clock Source
+ * ==========================================================================
+ * The PIT tick only resolves 10ms. At boot the TSC is timed against a
+ * 50ms one-shot countdown on PIT channel 2 (the speaker channel, so IRQ0
+ * keeps running untouched), which gives its rate in kHz. Reading the clock
+ * is then one RDTSC plus a fixed-point multiply:
+ *
+ *     ns = ((tsc - tsc_base) * mult) >> CLOCK_TSC_SHIFT
+ *
+ * with mult = (10^6 << CLOCK_TSC_SHIFT) / khz. The 64-bit delta is split
+ * into 32-bit halves so only 32x32->64 multiplies are needed.
+ *
+ * Without a TSC (or if calibration fails) the clock counts PIT ticks.
+ * ========================================================================== */
+
+#include "clock.h"
+
+#include "io.h"
+#include "pit.h"
+#include "serial.h"
+
+#define CLOCK_CPUID_EDX_TSC     (1U << 4)
+
+#define CLOCK_PIT_CH2_DATA      0x42
+#define CLOCK_PIT_CH2_GATE      0x61
+#define CLOCK_PIT_CH2_MODE0     0xB0    /* ch2, lobyte/hibyte, mode 0, binary */
+#define CLOCK_GATE_ENABLE       0x01
+#define CLOCK_GATE_SPEAKER      0x02
+#define CLOCK_GATE_OUT2         0x20
+
+#define CLOCK_CALIBRATE_MS      50U
+#define CLOCK_CALIBRATE_LATCH   ((PIT_BASE_FREQ * CLOCK_CALIBRATE_MS) / 1000U)
+#define CLOCK_MIN_TSC_KHZ       1000U
+#define CLOCK_NS_PER_TICK       (1000000000U / PIT_TARGET_FREQ)
+
+static uint64_t clock_tsc_base;
+static uint32_t clock_tsc_mult;
+static uint32_t clock_khz;
+
+static void serial_put_dec(uint32_t value)
+{
+    char buf[11];
+    uint32_t i = 0;
+
+    if (value == 0U) {
+        serial_putchar('0');
+        return;
+    }
+
+    while (value > 0U && i < sizeof(buf)) {
+        buf[i] = (char)('0' + (value % 10U));
+        value /= 10U;
+        i++;
+    }
+
+    while (i > 0U) {
+        i--;
+        serial_putchar(buf[i]);
+    }
+}
+
+static inline uint64_t clock_rdtsc(void)
+{
+    uint32_t lo;
+    uint32_t hi;
+
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t clock_div64(uint64_t n, uint32_t d, uint32_t *rem)
+{
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+
+    /* r < d, so the second divl cannot overflow */
+    __asm__ ("divl %4" : "=a"(q_lo), "=d"(r) : "a"((uint32_t)n), "d"(r), "rm"(d));
+
+    if (rem != 0) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+static uint8_t clock_cpu_has_tsc(void)
+{
+    uint32_t eax = 1U;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (uint8_t)((edx & CLOCK_CPUID_EDX_TSC) != 0U);
+}
+
+/* TSC cycles across a CLOCK_CALIBRATE_MS countdown, or 0 on failure. */
+static uint32_t clock_measure_tsc(void)
+{
+    uint64_t start;
+    uint64_t delta;
+    uint32_t spins = 0U;
+    uint8_t gate;
+
+    gate = inb(CLOCK_PIT_CH2_GATE);
+    outb(CLOCK_PIT_CH2_GATE, (uint8_t)((gate & ~CLOCK_GATE_SPEAKER) | CLOCK_GATE_ENABLE));
+
+    outb(PIT_COMMAND, CLOCK_PIT_CH2_MODE0);
+    outb(CLOCK_PIT_CH2_DATA, (uint8_t)(CLOCK_CALIBRATE_LATCH & 0xFFU));
+    outb(CLOCK_PIT_CH2_DATA, (uint8_t)((CLOCK_CALIBRATE_LATCH >> 8) & 0xFFU));
+
+    start = clock_rdtsc();
+    while ((inb(CLOCK_PIT_CH2_GATE) & CLOCK_GATE_OUT2) == 0U) {
+        /* Each port read takes about 1us, so this bounds the wait near 1s */
+        if (++spins > 1000000U) {
+            outb(CLOCK_PIT_CH2_GATE, gate);
+            return 0U;
+        }
+    }
+    delta = clock_rdtsc() - start;
+
+    outb(CLOCK_PIT_CH2_GATE, gate);
+
+    if ((delta >> 32) != 0U) {
+        return 0U;
+    }
+    return (uint32_t)delta;
+}
+
+void clock_init(void)
+{
+    uint32_t cycles;
+    uint32_t khz;
+
+    clock_khz = 0U;
+
+    if (clock_cpu_has_tsc() == 0U) {
+        serial_puts("[CLOCK] No TSC, using the 100 Hz PIT tick\n");
+        return;
+    }
+
+    cycles = clock_measure_tsc();
+    khz = cycles / CLOCK_CALIBRATE_MS;
+    if (khz < CLOCK_MIN_TSC_KHZ) {
+        serial_puts("[CLOCK] TSC calibration failed, using the 100 Hz PIT tick\n");
+        return;
+    }
+
+    clock_tsc_mult = (uint32_t)clock_div64((uint64_t)1000000U << CLOCK_TSC_SHIFT, khz, 0);
+    clock_tsc_base = clock_rdtsc();
+    clock_khz = khz;
+
+    serial_puts("[CLOCK] TSC calibrated at ");
+    serial_put_dec(khz);
+    serial_puts(" kHz\n");
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    uint64_t delta;
+
+    if (clock_khz == 0U) {
+        return (uint64_t)pit_get_ticks() * CLOCK_NS_PER_TICK;
+    }
+
+    delta = clock_rdtsc() - clock_tsc_base;
+    return (((uint64_t)(uint32_t)(delta >> 32) * clock_tsc_mult) << (32U - CLOCK_TSC_SHIFT))
+           + (((uint64_t)(uint32_t)delta * clock_tsc_mult) >> CLOCK_TSC_SHIFT);
+}
+
+uint32_t clock_monotonic_ms(void)
+{
+    return (uint32_t)clock_div64(clock_monotonic_ns(), 1000000U, 0);
+}
+
+uint32_t clock_resolution_ns(void)
+{
+    return (clock_khz != 0U) ? 1U : CLOCK_NS_PER_TICK;
+}
+
+uint32_t clock_tsc_khz(void)
+{
+    return clock_khz;
+}
+
+void clock_get_tsc_params(uint64_t *base, uint32_t *mult)
+{
+    if (base != 0) {
+        *base = (clock_khz != 0U) ? clock_tsc_base : 0U;
+    }
+    if (mult != 0) {
+        *mult = (clock_khz != 0U) ? clock_tsc_mult : 0U;
+    }
+}
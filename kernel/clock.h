@@ -0,0 +1,35 @@
+#ifndef CLAUDE_CLOCK_H
+#define CLAUDE_CLOCK_H
+
+#include <stdint.h>
+
+/* TSC-to-nanosecond scale: ns = (cycles * mult) >> CLOCK_TSC_SHIFT */
+#define CLOCK_TSC_SHIFT     22U
+
+/* Calibrate the TSC against PIT channel 2 (about 50ms of polling). Falls
+ * back to the 100 Hz PIT tick when the CPU has no usable TSC. Call once
+ * after pit_init(). */
+void clock_init(void);
+
+/* Nanoseconds since clock_init(), monotonic. */
+uint64_t clock_monotonic_ns(void);
+
+/* Milliseconds since clock_init(); wraps after about 49 days. */
+uint32_t clock_monotonic_ms(void);
+
+/* Smallest step clock_monotonic_ns() advances by: 1 with the TSC, one PIT
+ * tick with the fallback. */
+uint32_t clock_resolution_ns(void);
+
+/* Calibrated TSC frequency in kHz, or 0 when the PIT fallback is active. */
+uint32_t clock_tsc_khz(void);
+
+/* TSC value at time zero and the ns multiplier, for readers that convert
+ * TSC values themselves (the user data page). Both 0 without a TSC. */
+void clock_get_tsc_params(uint64_t *base, uint32_t *mult);
+
+/* 64-by-32 division without libgcc. Stores the remainder in *rem when
+ * rem is non-null. */
+uint64_t clock_div64(uint64_t n, uint32_t d, uint32_t *rem);
+
+#endif /* CLAUDE_CLOCK_H */
@@ -3,8 +3,11 @@
 #include <stdint.h>
 
 #include "elf.h"
+#include "heap.h"
+#include "pmm.h"
 #include "process.h"
 #include "serial.h"
+#include "slab.h"
 #include "usermode.h"
 #include "vfs.h"
 #include "vga.h"
@@ -275,9 +278,52 @@ static void console_builtin_ps(void)
     console_emit_char('\n');
 }
 
+static void console_emit_u32(uint32_t value)
+{
+    char digits[16];
+    uint32_t idx = 0U;
+
+    if (value == 0U) {
+        digits[idx++] = '0';
+    } else {
+        while (value != 0U && idx < sizeof(digits)) {
+            digits[idx++] = (char)('0' + (value % 10U));
+            value /= 10U;
+        }
+    }
+
+    while (idx > 0U) {
+        idx--;
+        console_emit_char(digits[idx]);
+    }
+}
+
+static void console_builtin_meminfo(void)
+{
+    uint32_t free_count = pmm_get_free_frame_count();
+    uint32_t heap_span;
+    uint32_t heap_pages;
+
+    console_emit_text("[meminfo] free_frames=");
+    console_emit_u32(free_count);
+    console_emit_text(" (");
+    console_emit_u32(free_count * 4U);
+    console_emit_text(" KB), details on serial\n");
+
+    kheap_get_stats(&heap_span, &heap_pages);
+    console_emit_text("[meminfo] kheap span=");
+    console_emit_u32(heap_span / 1024U);
+    console_emit_text(" KB committed=");
+    console_emit_u32(heap_pages * 4U);
+    console_emit_text(" KB\n");
+
+    pmm_dump_stats();
+    kmem_cache_dump_stats();
+}
+
 static void console_builtin_help(void)
 {
-    console_emit_text("Builtins: ls cat echo clear help ps exit\n");
+    console_emit_text("Builtins: ls cat echo clear help ps meminfo exit\n");
     console_emit_text("Commands: ring3test elftest forkexec libctest shell uhello ucat uexec appsdemo doom wmstart\n");
     console_emit_text("wmstart: GUI with terminal/calculator/uptime/checklist + dock (Esc exits)\n");
 }
@@ -352,6 +398,11 @@ static void console_execute_tokens(uint32_t argc, char **argv)
         return;
     }
 
+    if (console_text_equals_ci(argv[0], "meminfo") != 0U) {
+        console_builtin_meminfo();
+        return;
+    }
+
     if (console_text_equals_ci(argv[0], "exit") != 0U) {
         if (wm_is_active() != 0) {
             wm_stop();
@@ -3,7 +3,6 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#include "heap.h"
 #include "paging.h"
 #include "pmm.h"
 #include "process.h"
@@ -12,6 +11,9 @@
 #include "usermode.h"
 #include "vfs.h"
 #include "vga.h"
+#include "vmalloc.h"
+#include "vdso.h"
+#include "vma.h"
 
 #define ELF_EI_NIDENT           16U
 #define ELFCLASS32              1U
@@ -20,13 +22,15 @@
 #define EM_386                  3U
 #define EV_CURRENT              1U
 #define PT_LOAD                 1U
+#define PF_X                    0x1U
 #define PF_W                    0x2U
 
 #define USER_KERNEL_SPLIT       0xC0000000U
 #define ELF_USER_STACK_PAGE     0xBFF00000U
 #define ELF_USER_STACK_TOP      (ELF_USER_STACK_PAGE + PAGE_SIZE)
-#define ELF_MAX_MAPPED_PAGES    1024U
-#define ELF_MAX_FILE_SIZE       (1024U * 1024U)
+#define ELF_USER_STACK_SIZE     (64U * 1024U)
+/* Files are staged whole in the vmalloc area */
+#define ELF_MAX_FILE_SIZE       (16U * 1024U * 1024U)
 #define ELF_DEMO_VFS_PATH       "/elf_demo.elf"
 #define ELF_LIBCTEST_VFS_PATH   "/libctest.elf"
 #define ELF_SHELL_VFS_PATH      "/shell.elf"
@@ -35,26 +39,8 @@
 #define ELF_UEXEC_VFS_PATH      "/uexec.elf"
 #define ELF_DOOM_VFS_PATH       "/fat/DOOMGEN.ELF"
 
-/* Single-threaded loader scratch list; avoids 4KB stack frame pressure. */
-static uint32_t elf_mapped_pages[ELF_MAX_MAPPED_PAGES];
-static uint32_t elf_previous_pages[ELF_MAX_MAPPED_PAGES];
 static struct spinlock elf_loader_lock = SPINLOCK_INITIALIZER;
 
-struct elf_space_tracker {
-    uint32_t cr3;
-    uint32_t active_count;
-    uint32_t active_pages[ELF_MAX_MAPPED_PAGES];
-};
-
-struct elf_replaced_page {
-    uint32_t page;
-    uint32_t phys;
-    uint32_t flags;
-};
-
-static struct elf_space_tracker elf_trackers[PROCESS_MAX_COUNT];
-static struct elf_replaced_page elf_replaced_pages[ELF_MAX_MAPPED_PAGES];
-
 struct elf32_ehdr {
     uint8_t e_ident[ELF_EI_NIDENT];
     uint16_t e_type;
@@ -103,141 +89,82 @@ static uint32_t add_overflow_u32(uint32_t a, uint32_t b, uint32_t *sum)
     return 0U;
 }
 
-static uint8_t page_was_mapped_by_loader(const uint32_t *mapped_pages,
-                                         uint32_t mapped_count, uint32_t page)
+/* Map zeroed frames over [start, end) of the new address space */
+static int elf_map_zeroed_pages(uint32_t start, uint32_t end, uint32_t page_flags)
 {
-    uint32_t i;
+    for (uint32_t page = start; page < end; page += PAGE_SIZE) {
+        uint32_t phys = pmm_alloc_zeroed_frame();
+        uint32_t zeroed = (phys != 0U) ? 1U : 0U;
 
-    for (i = 0U; i < mapped_count; i++) {
-        if (mapped_pages[i] == page) {
-            return 1U;
+        if (phys == 0U) {
+            phys = pmm_alloc_frame();
         }
-    }
-
-    return 0U;
-}
-
-static void cleanup_mapped_pages(const uint32_t *mapped_pages, uint32_t mapped_count)
-{
-    while (mapped_count > 0U) {
-        uint32_t phys;
-
-        mapped_count--;
-        phys = paging_unmap_page(mapped_pages[mapped_count]);
-        if (phys != 0U) {
-            pmm_free_frame(phys);
+        if (phys == 0U) {
+            return -1;
         }
-    }
-}
 
-static void restore_replaced_pages(const struct elf_replaced_page *replaced_pages,
-                                   uint32_t replaced_count)
-{
-    while (replaced_count > 0U) {
-        uint32_t restored_flags;
-        uint32_t new_phys;
-
-        replaced_count--;
-        restored_flags = replaced_pages[replaced_count].flags;
-        new_phys = paging_unmap_page(replaced_pages[replaced_count].page);
-        if (new_phys != 0U) {
-            pmm_free_frame(new_phys);
+        if (paging_map_page(page, phys, page_flags) != 0) {
+            pmm_free_frame(phys);
+            return -1;
         }
 
-        if (paging_map_page(replaced_pages[replaced_count].page,
-                            replaced_pages[replaced_count].phys,
-                            restored_flags) != 0) {
-            /*
-             * Best effort rollback. If remap fails, avoid leaking the frame;
-             * caller will still fail the load and keep prior tracker state.
-             */
-            pmm_free_frame(replaced_pages[replaced_count].phys);
+        for (uint32_t j = 0U; zeroed == 0U && j < PAGE_SIZE; j++) {
+            *((uint8_t *)(uintptr_t)(page + j)) = 0U;
         }
     }
-}
-
-static void free_replaced_frames(const struct elf_replaced_page *replaced_pages,
-                                 uint32_t replaced_count)
-{
-    uint32_t i;
-
-    for (i = 0U; i < replaced_count; i++) {
-        pmm_free_frame(replaced_pages[i].phys);
-    }
-}
 
-static uint32_t elf_read_cr3(void)
-{
-    uint32_t value;
-    __asm__ volatile ("mov %%cr3, %0" : "=r"(value));
-    return value;
+    return 0;
 }
 
-static struct elf_space_tracker *elf_find_tracker(uint32_t cr3, uint8_t create)
+static int elf_check_header(const uint8_t *image, uint32_t image_size)
 {
-    uint32_t i;
-    struct elf_space_tracker *free_slot = 0;
-
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        if (elf_trackers[i].cr3 == cr3) {
-            return &elf_trackers[i];
-        }
+    const struct elf32_ehdr *ehdr = (const struct elf32_ehdr *)image;
+    uint32_t phdr_bytes;
 
-        if (free_slot == 0 && elf_trackers[i].cr3 == 0U) {
-            free_slot = &elf_trackers[i];
-        }
+    if (ehdr->e_ident[0] != 0x7FU || ehdr->e_ident[1] != 'E' ||
+        ehdr->e_ident[2] != 'L' || ehdr->e_ident[3] != 'F') {
+        return -1;
     }
 
-    if (create == 0U || free_slot == 0) {
-        return 0;
+    if (ehdr->e_ident[4] != ELFCLASS32 || ehdr->e_ident[5] != ELFDATA2LSB) {
+        return -1;
     }
 
-    free_slot->cr3 = cr3;
-    free_slot->active_count = 0U;
-    return free_slot;
-}
-
-static void drop_previous_active_pages_not_reused(const uint32_t *previous_pages,
-                                                  uint32_t previous_count,
-                                                  const uint32_t *mapped_pages,
-                                                  uint32_t mapped_count)
-{
-    uint32_t i;
-
-    for (i = 0U; i < previous_count; i++) {
-        uint32_t page = previous_pages[i];
-        uint32_t phys;
-
-        if (page_was_mapped_by_loader(mapped_pages, mapped_count, page) != 0U) {
-            continue;
-        }
+    if (ehdr->e_type != ET_EXEC || ehdr->e_machine != EM_386 ||
+        ehdr->e_version != EV_CURRENT || ehdr->e_phnum == 0U ||
+        ehdr->e_phentsize != sizeof(struct elf32_phdr)) {
+        return -1;
+    }
 
-        phys = paging_unmap_page(page);
-        if (phys != 0U) {
-            pmm_free_frame(phys);
-        }
+    if (add_overflow_u32((uint32_t)ehdr->e_phoff,
+                         (uint32_t)ehdr->e_phnum * (uint32_t)sizeof(struct elf32_phdr),
+                         &phdr_bytes) != 0U || phdr_bytes > image_size) {
+        return -1;
     }
+
+    return 0;
 }
 
+/*
+ * Build the image in a fresh address space: the old one stays intact until
+ * the new one is complete, so a failed exec returns to the caller's image
+ * untouched and a successful one frees the old space wholesale. Every
+ * region is recorded as an area: one per PT_LOAD segment, plus the stack.
+ */
 static int elf_load_user_image_locked(const uint8_t *image, uint32_t image_size,
                                       struct elf_user_image *loaded)
 {
     const struct elf32_ehdr *ehdr;
     const struct elf32_phdr *phdr_table;
-    struct elf_replaced_page *replaced_pages = elf_replaced_pages;
-    struct elf_space_tracker *tracker;
-    uint32_t active_count;
-    uint32_t current_cr3;
-    uint32_t previous_count;
-    uint32_t phdr_bytes;
-    uint32_t *mapped_pages = elf_mapped_pages;
-    uint32_t mapped_count = 0U;
-    uint32_t replaced_count = 0U;
+    struct vma_space *vmas;
+    uint32_t old_cr3;
+    uint32_t image_end = 0U;
+    uint32_t last_vaddr = 0U;
     uint32_t i;
 
 #define ELF_LOAD_FAIL() do { \
-    cleanup_mapped_pages(mapped_pages, mapped_count); \
-    restore_replaced_pages(replaced_pages, replaced_count); \
+    vma_space_destroy(vmas); \
+    process_exec_space_abort(old_cr3); \
     return -1; \
 } while (0)
 
@@ -245,43 +172,23 @@ static int elf_load_user_image_locked(const uint8_t *image, uint32_t image_size,
         return -1;
     }
 
-    current_cr3 = elf_read_cr3();
-    tracker = elf_find_tracker(current_cr3, 1U);
-    if (tracker == 0) {
+    if (elf_check_header(image, image_size) != 0) {
         return -1;
     }
 
-    active_count = tracker->active_count;
-    previous_count = active_count;
-    for (i = 0U; i < active_count; i++) {
-        elf_previous_pages[i] = tracker->active_pages[i];
-    }
-
     ehdr = (const struct elf32_ehdr *)image;
+    phdr_table = (const struct elf32_phdr *)(const void *)(image + ehdr->e_phoff);
 
-    if (ehdr->e_ident[0] != 0x7FU || ehdr->e_ident[1] != 'E' ||
-        ehdr->e_ident[2] != 'L' || ehdr->e_ident[3] != 'F') {
-        return -1;
-    }
-
-    if (ehdr->e_ident[4] != ELFCLASS32 || ehdr->e_ident[5] != ELFDATA2LSB) {
+    vmas = vma_space_create();
+    if (vmas == 0) {
         return -1;
     }
 
-    if (ehdr->e_type != ET_EXEC || ehdr->e_machine != EM_386 ||
-        ehdr->e_version != EV_CURRENT || ehdr->e_phnum == 0U ||
-        ehdr->e_phentsize != sizeof(struct elf32_phdr)) {
+    if (process_exec_space_begin(&old_cr3) != 0) {
+        vma_space_destroy(vmas);
         return -1;
     }
 
-    if (add_overflow_u32((uint32_t)ehdr->e_phoff,
-                         (uint32_t)ehdr->e_phnum * (uint32_t)sizeof(struct elf32_phdr),
-                         &phdr_bytes) != 0U || phdr_bytes > image_size) {
-        return -1;
-    }
-
-    phdr_table = (const struct elf32_phdr *)(const void *)(image + ehdr->e_phoff);
-
     for (i = 0U; i < (uint32_t)ehdr->e_phnum; i++) {
         const struct elf32_phdr *ph = &phdr_table[i];
         uint32_t seg_end;
@@ -289,7 +196,9 @@ static int elf_load_user_image_locked(const uint8_t *image, uint32_t image_size,
         uint32_t page_start;
         uint32_t page_end;
         uint32_t page;
-        uint32_t copy_flags;
+        uint32_t shared_end;
+        uint32_t page_flags;
+        uint32_t area_flags;
 
         if (ph->p_type != PT_LOAD || ph->p_memsz == 0U) {
             continue;
@@ -309,85 +218,63 @@ static int elf_load_user_image_locked(const uint8_t *image, uint32_t image_size,
             ELF_LOAD_FAIL();
         }
 
+        /* PT_LOAD entries are sorted by address; only the boundary page
+         * may be shared with the previous segment */
+        if (ph->p_vaddr < last_vaddr) {
+            ELF_LOAD_FAIL();
+        }
+        last_vaddr = ph->p_vaddr;
+
         page_start = ph->p_vaddr & PAGE_FRAME_MASK;
         page_end = align_up_u32(seg_end, PAGE_SIZE);
-        page = page_start;
-        copy_flags = PAGE_USER;
+        page_flags = PAGE_USER;
+        area_flags = VMA_TYPE_IMAGE | VMA_READ;
         if ((ph->p_flags & PF_W) != 0U) {
-            copy_flags |= PAGE_WRITABLE;
+            page_flags |= PAGE_WRITABLE;
+            area_flags |= VMA_WRITE;
+        }
+        if ((ph->p_flags & PF_X) != 0U) {
+            area_flags |= VMA_EXEC;
         }
 
-        while (page < page_end) {
-            uint32_t existing_phys = paging_get_phys_addr(page);
-
-            if (existing_phys != 0U) {
-                if (page_was_mapped_by_loader(mapped_pages, mapped_count, page) == 0U) {
-                    uint32_t old_flags;
-
-                    if (page_was_mapped_by_loader(elf_previous_pages,
-                                                  previous_count,
-                                                  page) == 0U) {
-                        ELF_LOAD_FAIL();
-                    }
-
-                    if (replaced_count >= ELF_MAX_MAPPED_PAGES) {
-                        ELF_LOAD_FAIL();
-                    }
-
-                    if (paging_get_page_flags(page, &old_flags) != 0) {
-                        ELF_LOAD_FAIL();
-                    }
-
-                    existing_phys = paging_unmap_page(page);
-                    if (existing_phys == 0U) {
-                        ELF_LOAD_FAIL();
-                    }
-
-                    replaced_pages[replaced_count].page = page;
-                    replaced_pages[replaced_count].phys = existing_phys;
-                    replaced_pages[replaced_count].flags = PAGE_USER;
-                    if ((old_flags & PAGE_WRITABLE) != 0U) {
-                        replaced_pages[replaced_count].flags |= PAGE_WRITABLE;
-                    }
-                    replaced_count++;
-                } else {
-                    /* Overlapping PT_LOAD segments may require stronger perms later. */
-                    if ((copy_flags & PAGE_WRITABLE) != 0U) {
-                        if (paging_or_page_flags(page, PAGE_USER | PAGE_WRITABLE) != 0) {
-                            ELF_LOAD_FAIL();
-                        }
-                    }
-
-                    page += PAGE_SIZE;
-                    continue;
-                }
-            }
-
-            if (mapped_count >= ELF_MAX_MAPPED_PAGES) {
+        /* Pages below image_end came with an earlier segment */
+        for (page = page_start; page < image_end && page < page_end; page += PAGE_SIZE) {
+            if ((page_flags & PAGE_WRITABLE) != 0U &&
+                paging_or_page_flags(page, PAGE_USER | PAGE_WRITABLE) != 0) {
                 ELF_LOAD_FAIL();
             }
+        }
+
+        shared_end = page;
 
-            existing_phys = pmm_alloc_frame();
-            if (existing_phys == 0U) {
+        /* A writable segment makes the shared pages writable too; their
+         * area is split off so the rest of the earlier segment keeps its
+         * rights */
+        if ((page_flags & PAGE_WRITABLE) != 0U && page_start < shared_end) {
+            struct vma shared;
+
+            if (vma_find(vmas, page_start, &shared) != 0 ||
+                vma_protect(vmas, page_start, shared_end,
+                            (shared.flags & VMA_PROT_MASK) | VMA_WRITE) != 0) {
                 ELF_LOAD_FAIL();
             }
+        }
 
-            if (paging_map_page(page, existing_phys, copy_flags) != 0) {
-                pmm_free_frame(existing_phys);
+        if (page < page_end) {
+            if (vma_map(vmas, page, page_end, area_flags) != 0 ||
+                elf_map_zeroed_pages(page, page_end, page_flags) != 0) {
                 ELF_LOAD_FAIL();
             }
-
-            mapped_pages[mapped_count] = page;
-            mapped_count++;
-            page += PAGE_SIZE;
+            image_end = page_end;
         }
 
         for (page = 0U; page < ph->p_filesz; page++) {
             *((uint8_t *)(uintptr_t)(ph->p_vaddr + page)) = image[ph->p_offset + page];
         }
 
-        for (page = ph->p_filesz; page < ph->p_memsz; page++) {
-            *((uint8_t *)(uintptr_t)(ph->p_vaddr + page)) = 0U;
+        /* Fresh frames are already clear; only a shared page may need it */
+        for (page = ph->p_vaddr + ph->p_filesz; page < seg_end && page < shared_end; page++) {
+            *((uint8_t *)(uintptr_t)page) = 0U;
         }
     }
 
@@ -395,71 +282,19 @@ static int elf_load_user_image_locked(const uint8_t *image, uint32_t image_size,
         ELF_LOAD_FAIL();
     }
 
-    if (paging_get_phys_addr(ELF_USER_STACK_PAGE) != 0U) {
-        uint32_t stack_existing;
-        uint32_t old_flags;
-
-        if (page_was_mapped_by_loader(elf_previous_pages,
-                                      previous_count,
-                                      ELF_USER_STACK_PAGE) == 0U) {
-            ELF_LOAD_FAIL();
-        }
-
-        if (replaced_count >= ELF_MAX_MAPPED_PAGES) {
-            ELF_LOAD_FAIL();
-        }
-
-        if (paging_get_page_flags(ELF_USER_STACK_PAGE, &old_flags) != 0) {
-            ELF_LOAD_FAIL();
-        }
-
-        stack_existing = paging_unmap_page(ELF_USER_STACK_PAGE);
-        if (stack_existing == 0U) {
-            ELF_LOAD_FAIL();
-        }
-
-        replaced_pages[replaced_count].page = ELF_USER_STACK_PAGE;
-        replaced_pages[replaced_count].phys = stack_existing;
-        replaced_pages[replaced_count].flags = PAGE_USER;
-        if ((old_flags & PAGE_WRITABLE) != 0U) {
-            replaced_pages[replaced_count].flags |= PAGE_WRITABLE;
-        }
-        replaced_count++;
-    }
-
-    if (mapped_count >= ELF_MAX_MAPPED_PAGES) {
+    /* The top stack page is mapped now; the rest of the area fills on demand */
+    if (vma_map(vmas, ELF_USER_STACK_TOP - ELF_USER_STACK_SIZE, ELF_USER_STACK_TOP,
+                VMA_TYPE_STACK | VMA_READ | VMA_WRITE) != 0 ||
+        elf_map_zeroed_pages(ELF_USER_STACK_PAGE, ELF_USER_STACK_TOP,
+                             PAGE_USER | PAGE_WRITABLE) != 0) {
         ELF_LOAD_FAIL();
     }
 
-    {
-        uint32_t stack_phys = pmm_alloc_frame();
-        uint32_t j;
-
-        if (stack_phys == 0U) {
-            ELF_LOAD_FAIL();
-        }
-
-        if (paging_map_page(ELF_USER_STACK_PAGE, stack_phys, PAGE_USER | PAGE_WRITABLE) != 0) {
-            pmm_free_frame(stack_phys);
-            ELF_LOAD_FAIL();
-        }
-
-        mapped_pages[mapped_count] = ELF_USER_STACK_PAGE;
-        mapped_count++;
-
-        for (j = 0U; j < PAGE_SIZE; j++) {
-            *((uint8_t *)(uintptr_t)(ELF_USER_STACK_PAGE + j)) = 0U;
-        }
+    if (vdso_map_current() != 0) {
+        ELF_LOAD_FAIL();
     }
 
-    drop_previous_active_pages_not_reused(elf_previous_pages, previous_count,
-                                          mapped_pages, mapped_count);
-    free_replaced_frames(replaced_pages, replaced_count);
-
-    tracker->active_count = mapped_count;
-    for (i = 0U; i < mapped_count; i++) {
-        tracker->active_pages[i] = mapped_pages[i];
-    }
+    process_exec_space_commit(old_cr3, vmas);
 
     loaded->entry = ehdr->e_entry;
     loaded->stack_top = ELF_USER_STACK_TOP;
@@ -479,26 +314,6 @@ int elf_load_user_image(const uint8_t *image, uint32_t image_size,
     return rc;
 }
 
-void elf_forget_address_space(uint32_t cr3_phys)
-{
-    uint32_t irq_flags;
-    uint32_t i;
-
-    if (cr3_phys == 0U) {
-        return;
-    }
-
-    irq_flags = spinlock_lock_irqsave(&elf_loader_lock);
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        if (elf_trackers[i].cr3 == cr3_phys) {
-            elf_trackers[i].cr3 = 0U;
-            elf_trackers[i].active_count = 0U;
-            break;
-        }
-    }
-    spinlock_unlock_irqrestore(&elf_loader_lock, irq_flags);
-}
-
 int elf_load_user_image_from_vfs(const char *path, struct elf_user_image *loaded)
 {
     struct vfs_node node;
@@ -516,14 +331,14 @@ int elf_load_user_image_from_vfs(const char *path, struct elf_user_image *loaded
         return -1;
     }
 
-    image = (uint8_t *)kmalloc(node.size);
+    image = (uint8_t *)vmalloc(node.size);
     if (image == 0) {
         return -1;
     }
 
     fd = vfs_open(path, VFS_OPEN_READ);
     if (fd < 0) {
-        kfree(image);
+        vfree(image);
         return -1;
     }
 
@@ -532,7 +347,7 @@ int elf_load_user_image_from_vfs(const char *path, struct elf_user_image *loaded
         int32_t got = vfs_read(fd, image + total, node.size - total);
         if (got <= 0) {
             (void)vfs_close(fd);
-            kfree(image);
+            vfree(image);
             return -1;
         }
         total += (uint32_t)got;
@@ -540,7 +355,7 @@ int elf_load_user_image_from_vfs(const char *path, struct elf_user_image *loaded
 
     (void)vfs_close(fd);
     rc = elf_load_user_image(image, node.size, loaded);
-    kfree(image);
+    vfree(image);
     return rc;
 }
 
@@ -76,13 +76,15 @@ static int32_t fat32_write(const struct vfs_node *node, uint32_t offset,
 static const struct vfs_node_ops fat32_dir_ops = {
     .lookup = fat32_lookup,
     .read = 0,
-    .write = 0
+    .write = 0,
+    .map_page = 0
 };
 
 static const struct vfs_node_ops fat32_file_ops = {
     .lookup = 0,
     .read = fat32_read,
-    .write = fat32_write
+    .write = fat32_write,
+    .map_page = 0
 };
 
 static uint8_t to_upper_ascii(uint8_t c)
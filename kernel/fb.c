@@ -2,9 +2,9 @@
 
 #include <stdint.h>
 
-#include "heap.h"
 #include "serial.h"
 #include "vbe.h"
+#include "vmalloc.h"
 
 #define FB_GLYPH_W          8U
 #define FB_GLYPH_H          16U
@@ -323,7 +323,7 @@ int fb_init(void)
         return -1;
     }
 
-    back_ptr = (uint8_t *)kmalloc(mode.framebuffer_size);
+    back_ptr = (uint8_t *)vmalloc(mode.framebuffer_size);
     if (back_ptr == 0) {
         serial_puts("[FB] back buffer alloc failed, using single buffer\n");
         back_ptr = (uint8_t *)front_ptr;
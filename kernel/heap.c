@@ -6,21 +6,57 @@
 
 #include <stdint.h>
 
+/*
+ * Kernel heap: boundary-tag blocks with segregated power-of-two free lists.
+ *
+ * The heap is one contiguous virtual range [KHEAP_START, kheap_top). Every
+ * block starts with a 16-byte header holding its own payload size and the
+ * payload size of the physically preceding block, so both neighbours are
+ * found by pointer arithmetic. Free blocks keep their list links in the
+ * payload and sit in class floor(log2(size)); a bitmap marks non-empty
+ * classes. kmalloc picks the first non-empty class whose blocks are all big
+ * enough (one bsf), kfree validates the header and coalesces in O(1).
+ *
+ * Trimming: free blocks of at least KHEAP_DECOMMIT_MIN bytes give the pages
+ * strictly inside their payload back to the PMM (the header and free-list
+ * links stay mapped), and kmalloc maps them again before handing the block
+ * out. A free tail larger than KHEAP_TRIM_THRESHOLD lowers kheap_top until
+ * only KHEAP_TRIM_KEEP bytes of slack remain; the gap between the two
+ * constants keeps alloc/free cycles at the tail from remapping every time.
+ */
+
 #define KHEAP_START         0xC1000000U
 #define KHEAP_END           0xC2000000U
 #define KHEAP_ALIGNMENT     8U
 #define KHEAP_MIN_SPLIT     16U
+#define KHEAP_CLASS_COUNT   32U
+#define KHEAP_MAGIC_USED    0x4B48A110U
+#define KHEAP_MAGIC_FREE    0x4B48F4EEU
+#define KHEAP_DECOMMIT_MIN  (64U * 1024U)
+#define KHEAP_TRIM_THRESHOLD (256U * 1024U)
+#define KHEAP_TRIM_KEEP     (64U * 1024U)
+#define KHEAP_MAP_MAX_ORDER 4U      /* growth maps up to 64KB contiguous per call */
 
 struct heap_block {
-    uint32_t size;
-    uint32_t used;
+    uint32_t size;       /* payload bytes */
+    uint32_t prev_size;  /* payload bytes of the preceding block, 0 if first */
+    uint32_t magic;      /* KHEAP_MAGIC_USED or KHEAP_MAGIC_FREE */
+    uint32_t check;      /* address ^ size ^ magic */
+};
+
+/* Stored in the payload of free blocks */
+struct heap_free_links {
     struct heap_block *prev;
     struct heap_block *next;
 };
 
-static struct heap_block *kheap_head;
-static struct heap_block *kheap_tail;
+#define KHEAP_HEADER_SIZE   ((uint32_t)sizeof(struct heap_block))
+
+static struct heap_block *kheap_free_lists[KHEAP_CLASS_COUNT];
+static uint32_t kheap_class_map;
+static struct heap_block *kheap_last;
 static uint32_t kheap_top;
+static uint32_t kheap_committed_pages;
 static uint32_t kheap_ready;
 static struct spinlock kheap_lock = SPINLOCK_INITIALIZER;
 
@@ -29,115 +65,301 @@ static uint32_t align_up_u32(uint32_t value, uint32_t alignment)
     return (value + alignment - 1U) & ~(alignment - 1U);
 }
 
+static inline uint32_t heap_bsr(uint32_t value)
+{
+    uint32_t index;
+    __asm__ ("bsr %1, %0" : "=r"(index) : "rm"(value) : "cc");
+    return index;
+}
+
+static inline uint32_t heap_bsf(uint32_t value)
+{
+    uint32_t index;
+    __asm__ ("bsf %1, %0" : "=r"(index) : "rm"(value) : "cc");
+    return index;
+}
+
+/* -------------------------------------------------------------------------
+ * Block header helpers
+ * ------------------------------------------------------------------------- */
+
+static uint32_t block_addr(const struct heap_block *block)
+{
+    return (uint32_t)(uintptr_t)block;
+}
+
 static uint32_t block_end_addr(const struct heap_block *block)
 {
-    return (uint32_t)(uintptr_t)block + (uint32_t)sizeof(struct heap_block) + block->size;
+    return block_addr(block) + KHEAP_HEADER_SIZE + block->size;
 }
 
-static struct heap_block *find_fit(uint32_t size)
+static void block_set(struct heap_block *block, uint32_t size, uint32_t magic)
 {
-    struct heap_block *block = kheap_head;
+    block->size = size;
+    block->magic = magic;
+    block->check = block_addr(block) ^ size ^ magic;
+}
 
-    while (block != 0) {
-        if (block->used == 0U && block->size >= size) {
-            return block;
+static int block_is_valid(const struct heap_block *block, uint32_t magic)
+{
+    return block->magic == magic &&
+           block->check == (block_addr(block) ^ block->size ^ magic) &&
+           block_end_addr(block) <= kheap_top;
+}
+
+static struct heap_block *block_next(const struct heap_block *block)
+{
+    uint32_t end = block_end_addr(block);
+
+    if (end >= kheap_top) {
+        return 0;
+    }
+    return (struct heap_block *)(uintptr_t)end;
+}
+
+static struct heap_block *block_prev(const struct heap_block *block)
+{
+    if (block_addr(block) == KHEAP_START) {
+        return 0;
+    }
+    return (struct heap_block *)(uintptr_t)(block_addr(block) - block->prev_size -
+                                            KHEAP_HEADER_SIZE);
+}
+
+/* Keep the following block's prev_size (and kheap_last) in sync */
+static void block_link_next(struct heap_block *block)
+{
+    struct heap_block *next = block_next(block);
+
+    if (next != 0) {
+        next->prev_size = block->size;
+    } else {
+        kheap_last = block;
+    }
+}
+
+static struct heap_free_links *block_links(struct heap_block *block)
+{
+    return (struct heap_free_links *)(void *)(block + 1);
+}
+
+/* -------------------------------------------------------------------------
+ * Segregated free lists
+ *
+ * Class c holds free blocks with 2^c <= size < 2^(c+1).
+ * ------------------------------------------------------------------------- */
+
+static void free_list_insert(struct heap_block *block)
+{
+    uint32_t cls = heap_bsr(block->size);
+    struct heap_free_links *links = block_links(block);
+
+    block_set(block, block->size, KHEAP_MAGIC_FREE);
+    links->prev = 0;
+    links->next = kheap_free_lists[cls];
+    if (links->next != 0) {
+        block_links(links->next)->prev = block;
+    }
+    kheap_free_lists[cls] = block;
+    kheap_class_map |= 1U << cls;
+}
+
+static void free_list_remove(struct heap_block *block)
+{
+    uint32_t cls = heap_bsr(block->size);
+    struct heap_free_links *links = block_links(block);
+
+    if (links->prev != 0) {
+        block_links(links->prev)->next = links->next;
+    } else {
+        kheap_free_lists[cls] = links->next;
+        if (links->next == 0) {
+            kheap_class_map &= ~(1U << cls);
         }
-        block = block->next;
     }
 
-    return 0;
+    if (links->next != 0) {
+        block_links(links->next)->prev = links->prev;
+    }
 }
 
-static struct heap_block *find_block_by_payload(void *ptr)
+static struct heap_block *find_fit(uint32_t size)
 {
-    struct heap_block *block = kheap_head;
-    uint32_t payload_addr = (uint32_t)(uintptr_t)ptr;
+    uint32_t cls = heap_bsr(size);
+    uint32_t good_cls = ((size & (size - 1U)) == 0U) ? cls : cls + 1U;
+    uint32_t mask;
+    struct heap_block *block;
+
+    /* Every block in a class >= good_cls is large enough */
+    if (good_cls < KHEAP_CLASS_COUNT) {
+        mask = kheap_class_map & (0xFFFFFFFFU << good_cls);
+        if (mask != 0U) {
+            return kheap_free_lists[heap_bsf(mask)];
+        }
+    }
 
+    /* Last resort before growing: the request's own class may hold a fit */
+    block = (good_cls != cls) ? kheap_free_lists[cls] : 0;
     while (block != 0) {
-        uint32_t block_payload = (uint32_t)(uintptr_t)block + (uint32_t)sizeof(struct heap_block);
-        if (block_payload == payload_addr) {
+        if (block->size >= size) {
             return block;
         }
-        block = block->next;
+        block = block_links(block)->next;
     }
 
     return 0;
 }
 
+/* Carve 'size' bytes off the front of a block that is not on a free list;
+ * the remainder (if worth keeping) becomes a new free block. */
 static void split_block(struct heap_block *block, uint32_t size)
 {
-    uint32_t header_size = (uint32_t)sizeof(struct heap_block);
+    struct heap_block *rest;
 
     if (block->size <= size) {
         return;
     }
 
-    if (block->size - size < header_size + KHEAP_MIN_SPLIT) {
+    if (block->size - size < KHEAP_HEADER_SIZE + KHEAP_MIN_SPLIT) {
         return;
     }
 
-    uint32_t new_addr = (uint32_t)(uintptr_t)block + header_size + size;
-    struct heap_block *new_block = (struct heap_block *)(uintptr_t)new_addr;
+    rest = (struct heap_block *)(uintptr_t)(block_addr(block) + KHEAP_HEADER_SIZE + size);
+    rest->size = block->size - size - KHEAP_HEADER_SIZE;
+    rest->prev_size = size;
+    block_link_next(rest);
+    free_list_insert(rest);
 
-    new_block->size = block->size - size - header_size;
-    new_block->used = 0U;
-    new_block->prev = block;
-    new_block->next = block->next;
+    block->size = size;
+}
 
-    if (block->next != 0) {
-        block->next->prev = new_block;
-    } else {
-        kheap_tail = new_block;
-    }
+/* Merge 'block' with a free physical successor. Neither is on a list. */
+static void merge_next(struct heap_block *block, struct heap_block *next)
+{
+    block->size += KHEAP_HEADER_SIZE + next->size;
+    next->magic = 0U;
+    block_link_next(block);
+}
 
-    block->size = size;
-    block->next = new_block;
+/* -------------------------------------------------------------------------
+ * Page commit/decommit
+ * ------------------------------------------------------------------------- */
+
+/* Unmap every mapped page in [start, end) and return its frame to the PMM */
+static void heap_release_pages(uint32_t start, uint32_t end)
+{
+    uint32_t unmapped;
+
+    /* Heap pages are 4KB mappings, so there is nothing to split */
+    if (start < end && paging_unmap_range(start, end - start, 1, &unmapped) == 0) {
+        kheap_committed_pages -= unmapped;
+    }
 }
 
-static void merge_forward(struct heap_block *block)
+/* Make sure every page overlapping [start, end) is backed by a frame */
+static int heap_commit_range(uint32_t start, uint32_t end)
 {
-    uint32_t header_size = (uint32_t)sizeof(struct heap_block);
+    uint32_t va = start & ~(PAGE_SIZE - 1U);
 
-    while (block->next != 0 && block->next->used == 0U) {
-        struct heap_block *next = block->next;
+    while (va < end) {
+        if (paging_get_phys_addr(va) == 0U) {
+            uint32_t phys = pmm_alloc_frame();
 
-        block->size += header_size + next->size;
-        block->next = next->next;
+            if (phys == 0U) {
+                return -1;
+            }
 
-        if (next->next != 0) {
-            next->next->prev = block;
-        } else {
-            kheap_tail = block;
+            if (paging_map_page(va, phys, PAGE_WRITABLE) != 0) {
+                pmm_free_frame(phys);
+                return -1;
+            }
+            kheap_committed_pages++;
         }
+        va += PAGE_SIZE;
     }
+
+    return 0;
 }
 
-static void add_region(uint32_t region_start, uint32_t region_size)
+/* Nonzero if every page overlapping [start, end) is mapped */
+static int heap_range_mapped(uint32_t start, uint32_t end)
+{
+    uint32_t va = start & ~(PAGE_SIZE - 1U);
+
+    while (va < end) {
+        if (paging_get_phys_addr(va) == 0U) {
+            return 0;
+        }
+        va += PAGE_SIZE;
+    }
+
+    return 1;
+}
+
+/* Release the pages strictly inside a large free block's payload */
+static void heap_decommit_block(const struct heap_block *block)
 {
-    uint32_t header_size = (uint32_t)sizeof(struct heap_block);
+    uint32_t start;
+    uint32_t end;
 
-    if (region_size <= header_size) {
+    if (block->size < KHEAP_DECOMMIT_MIN) {
         return;
     }
 
-    if (kheap_tail != 0 && kheap_tail->used == 0U && block_end_addr(kheap_tail) == region_start) {
-        kheap_tail->size += region_size;
+    start = align_up_u32(block_addr(block) + KHEAP_HEADER_SIZE +
+                         (uint32_t)sizeof(struct heap_free_links), PAGE_SIZE);
+    end = block_end_addr(block) & ~(PAGE_SIZE - 1U);
+    if (start < end) {
+        heap_release_pages(start, end);
+    }
+}
+
+/* Shrink the heap when the last block is a large free block */
+static void heap_trim_tail(void)
+{
+    struct heap_block *block = kheap_last;
+    uint32_t new_top;
+
+    if (block == 0 || block->magic != KHEAP_MAGIC_FREE ||
+        block->size < KHEAP_TRIM_THRESHOLD) {
         return;
     }
 
-    struct heap_block *block = (struct heap_block *)(uintptr_t)region_start;
-    block->size = region_size - header_size;
-    block->used = 0U;
-    block->prev = kheap_tail;
-    block->next = 0;
+    new_top = align_up_u32(block_addr(block) + KHEAP_HEADER_SIZE + KHEAP_TRIM_KEEP,
+                           PAGE_SIZE);
+    if (new_top >= kheap_top) {
+        return;
+    }
 
-    if (kheap_tail != 0) {
-        kheap_tail->next = block;
-    } else {
-        kheap_head = block;
+    free_list_remove(block);
+    block->size = new_top - block_addr(block) - KHEAP_HEADER_SIZE;
+    free_list_insert(block);
+
+    heap_release_pages(new_top, kheap_top);
+    kheap_top = new_top;
+}
+
+static void add_region(uint32_t region_start, uint32_t region_size)
+{
+    struct heap_block *block;
+
+    if (kheap_last != 0 && kheap_last->magic == KHEAP_MAGIC_FREE &&
+        block_end_addr(kheap_last) == region_start) {
+        free_list_remove(kheap_last);
+        kheap_last->size += region_size;
+        free_list_insert(kheap_last);
+        return;
     }
 
-    kheap_tail = block;
+    if (region_size <= KHEAP_HEADER_SIZE) {
+        return;
+    }
+
+    block = (struct heap_block *)(uintptr_t)region_start;
+    block->size = region_size - KHEAP_HEADER_SIZE;
+    block->prev_size = (kheap_last != 0) ? kheap_last->size : 0U;
+    kheap_last = block;
+    free_list_insert(block);
 }
 
 static int expand_heap(uint32_t min_bytes)
@@ -158,25 +380,43 @@ static int expand_heap(uint32_t min_bytes)
     uint32_t old_top = kheap_top;
     uint32_t mapped_bytes = 0U;
 
+    /* Prefer small contiguous blocks so one paging_map_range() call covers
+     * several pages; fall back to single frames when memory is fragmented */
     while (mapped_bytes < bytes_to_map) {
-        uint32_t phys = pmm_alloc_frame();
+        uint32_t remaining_pages = (bytes_to_map - mapped_bytes) / PAGE_SIZE;
+        uint32_t order = KHEAP_MAP_MAX_ORDER;
+        uint32_t phys;
+
+        while (order > 0U && (1U << order) > remaining_pages) {
+            order--;
+        }
+
+        phys = pmm_alloc_frames(order);
+        while (phys == 0U && order > 0U) {
+            order--;
+            phys = pmm_alloc_frames(order);
+        }
         if (phys == 0U) {
             break;
         }
 
-        if (paging_map_page(kheap_top, phys, PAGE_WRITABLE) != 0) {
-            pmm_free_frame(phys);
+        if (paging_map_range(kheap_top + mapped_bytes, phys, PAGE_SIZE << order,
+                             PAGE_WRITABLE) != 0) {
+            pmm_free_frames(phys, order);
             break;
         }
 
-        kheap_top += PAGE_SIZE;
-        mapped_bytes += PAGE_SIZE;
+        mapped_bytes += PAGE_SIZE << order;
+        kheap_committed_pages += 1U << order;
     }
 
     if (mapped_bytes == 0U) {
         return -1;
     }
 
+    /* Publish the new top only after the pages exist; add_region relies on
+     * the old top to find the previous last block. */
+    kheap_top += mapped_bytes;
     add_region(old_top, mapped_bytes);
     return (mapped_bytes == bytes_to_map) ? 0 : -1;
 }
@@ -185,13 +425,17 @@ void kheap_init(void)
 {
     spinlock_init(&kheap_lock);
 
-    kheap_head = 0;
-    kheap_tail = 0;
+    for (uint32_t i = 0; i < KHEAP_CLASS_COUNT; i++) {
+        kheap_free_lists[i] = 0;
+    }
+    kheap_class_map = 0U;
+    kheap_last = 0;
     kheap_top = KHEAP_START;
+    kheap_committed_pages = 0U;
     kheap_ready = 0U;
 
     (void)expand_heap(PAGE_SIZE);
-    if (kheap_head == 0) {
+    if (kheap_last == 0) {
         serial_puts("KHEAP: init failed\n");
         return;
     }
@@ -204,6 +448,7 @@ void *kmalloc(size_t size)
 {
     struct heap_block *block;
     uint32_t request;
+    uint32_t commit_end;
     uint32_t flags;
     void *result = 0;
 
@@ -230,7 +475,7 @@ void *kmalloc(size_t size)
 
     while (block == 0) {
         uint32_t top_before = kheap_top;
-        uint32_t required = request + (uint32_t)sizeof(struct heap_block);
+        uint32_t required = request + KHEAP_HEADER_SIZE;
 
         (void)expand_heap(required);
         if (kheap_top == top_before) {
@@ -240,9 +485,24 @@ void *kmalloc(size_t size)
         block = find_fit(request);
     }
 
+    free_list_remove(block);
+
+    /* Map back any decommitted pages the allocation (and the header plus
+     * links of a split remainder) will touch */
+    commit_end = block_addr(block) + 2U * KHEAP_HEADER_SIZE + request +
+                 (uint32_t)sizeof(struct heap_free_links);
+    if (commit_end > block_end_addr(block)) {
+        commit_end = block_end_addr(block);
+    }
+    if (heap_commit_range(block_addr(block) + KHEAP_HEADER_SIZE, commit_end) != 0) {
+        free_list_insert(block);
+        goto out;
+    }
+
     split_block(block, request);
-    block->used = 1U;
-    result = (void *)(uintptr_t)((uint32_t)(uintptr_t)block + (uint32_t)sizeof(struct heap_block));
+    block_set(block, block->size, KHEAP_MAGIC_USED);
+    block_link_next(block);
+    result = (void *)(block + 1);
 
 out:
     spinlock_unlock_irqrestore(&kheap_lock, flags);
@@ -252,29 +512,67 @@ out:
 void kfree(void *ptr)
 {
     struct heap_block *block;
+    struct heap_block *neighbour;
+    uint32_t payload_addr;
     uint32_t flags;
 
     if (ptr == 0) {
         return;
     }
 
+    payload_addr = (uint32_t)(uintptr_t)ptr;
+
     flags = spinlock_lock_irqsave(&kheap_lock);
     if (kheap_ready == 0U) {
         spinlock_unlock_irqrestore(&kheap_lock, flags);
         return;
     }
 
-    block = find_block_by_payload(ptr);
-    if (block == 0 || block->used == 0U) {
+    /* Validate by pointer arithmetic: range, alignment, header magic/check.
+     * A stale pointer can land inside a decommitted free block, so the header
+     * pages must be mapped before they are read. */
+    block = (struct heap_block *)ptr - 1;
+    if (payload_addr < KHEAP_START + KHEAP_HEADER_SIZE || payload_addr >= kheap_top ||
+        (payload_addr & (KHEAP_ALIGNMENT - 1U)) != 0U ||
+        heap_range_mapped(block_addr(block), payload_addr) == 0 ||
+        block_is_valid(block, KHEAP_MAGIC_USED) == 0) {
         spinlock_unlock_irqrestore(&kheap_lock, flags);
+        serial_puts("KHEAP: invalid or double kfree ignored\n");
         return;
     }
 
-    block->used = 0U;
-    merge_forward(block);
+    neighbour = block_next(block);
+    if (neighbour != 0 && neighbour->magic == KHEAP_MAGIC_FREE) {
+        free_list_remove(neighbour);
+        merge_next(block, neighbour);
+    }
+
+    neighbour = block_prev(block);
+    if (neighbour != 0 && neighbour->magic == KHEAP_MAGIC_FREE) {
+        free_list_remove(neighbour);
+        merge_next(neighbour, block);
+        block = neighbour;
+    }
+
+    free_list_insert(block);
 
-    if (block->prev != 0 && block->prev->used == 0U) {
-        merge_forward(block->prev);
+    if (block == kheap_last) {
+        heap_trim_tail();
+    }
+    heap_decommit_block(block);
+
+    spinlock_unlock_irqrestore(&kheap_lock, flags);
+}
+
+void kheap_get_stats(uint32_t *span_bytes_out, uint32_t *committed_pages_out)
+{
+    uint32_t flags = spinlock_lock_irqsave(&kheap_lock);
+
+    if (span_bytes_out != 0) {
+        *span_bytes_out = kheap_top - KHEAP_START;
+    }
+    if (committed_pages_out != 0) {
+        *committed_pages_out = kheap_committed_pages;
     }
 
     spinlock_unlock_irqrestore(&kheap_lock, flags);
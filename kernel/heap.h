@@ -2,6 +2,7 @@
 #define CLAUDE_HEAP_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* Initialize kernel heap allocator */
 void kheap_init(void);
@@ -10,4 +11,7 @@ void kheap_init(void);
 void *kmalloc(size_t size);
 void kfree(void *ptr);
 
+/* Report bytes of heap virtual space in use and pages backed by frames */
+void kheap_get_stats(uint32_t *span_bytes_out, uint32_t *committed_pages_out);
+
 #endif /* CLAUDE_HEAP_H */
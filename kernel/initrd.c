@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 
+#include "paging.h"
 #include "serial.h"
 #include "vfs.h"
 
@@ -50,17 +51,21 @@ static int32_t initrd_read(const struct vfs_node *node, uint32_t offset,
                            uint8_t *buffer, uint32_t size);
 static int32_t initrd_write(const struct vfs_node *node, uint32_t offset,
                             const uint8_t *buffer, uint32_t size);
+static int32_t initrd_map_page(const struct vfs_node *node, uint32_t offset,
+                               uint32_t *phys_out);
 
 static const struct vfs_node_ops initrd_dir_ops = {
     .lookup = initrd_lookup,
     .read = 0,
-    .write = 0
+    .write = 0,
+    .map_page = 0
 };
 
 static const struct vfs_node_ops initrd_file_ops = {
     .lookup = 0,
     .read = initrd_read,
-    .write = initrd_write
+    .write = initrd_write,
+    .map_page = initrd_map_page
 };
 
 static uint32_t str_len(const char *s)
@@ -740,6 +745,47 @@ static int32_t initrd_read(const struct vfs_node *node, uint32_t offset,
     return (int32_t)to_copy;
 }
 
+/*
+ * File data sits in the embedded archive, which the build lays out with
+ * every file page aligned. Whole pages can be mapped into user space as
+ * they are; a partial last page is left to the caller to copy, so nothing
+ * past the end of the file becomes visible.
+ */
+static int32_t initrd_map_page(const struct vfs_node *node, uint32_t offset,
+                               uint32_t *phys_out)
+{
+    const struct initrd_entry *entry;
+    const uint8_t *page;
+    uint32_t phys;
+
+    if (node == 0 || node->fs_data == 0 || phys_out == 0) {
+        return VFS_ERR_INVALID;
+    }
+
+    entry = (const struct initrd_entry *)node->fs_data;
+    if (entry->type != VFS_NODE_FILE || entry->data == 0) {
+        return VFS_ERR_NOT_FILE;
+    }
+
+    if ((offset & (PAGE_SIZE - 1U)) != 0U || offset >= entry->size ||
+        entry->size - offset < PAGE_SIZE) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+
+    page = entry->data + offset;
+    if (((uint32_t)(uintptr_t)page & (PAGE_SIZE - 1U)) != 0U) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+
+    phys = virt_to_phys(page);
+    if (phys == 0U) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+
+    *phys_out = phys & PAGE_FRAME_MASK;
+    return VFS_OK;
+}
+
 static int32_t initrd_write(const struct vfs_node *node, uint32_t offset,
                             const uint8_t *buffer, uint32_t size)
 {
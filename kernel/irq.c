@@ -1,6 +1,7 @@
 #include "irq.h"
 #include "pic.h"
 #include "idt.h"
+#include "lapic.h"
 #include "process.h"
 
 #define SCHED_QUANTUM_TICKS  1U
@@ -34,10 +35,33 @@ void irq_register_handler(uint8_t irq, irq_handler_t handler)
     }
 }
 
+/* Scheduler tick: the PIT IRQ0 or, once it took over, the LAPIC timer.
+ * The scheduler decides whether the current slice is over. */
+static void irq_scheduler_tick(void)
+{
+    if (process_is_preemption_enabled() != 0U) {
+        scheduler_tick_accum++;
+        if (scheduler_tick_accum >= SCHED_QUANTUM_TICKS) {
+            scheduler_tick_accum = 0U;
+            process_preempt_from_irq();
+        }
+    }
+}
+
 void irq_handler(struct isr_regs *regs)
 {
+    uint8_t irq;
+
+    /* The LAPIC timer is not a PIC line; it sends its own EOI */
+    if (regs->int_no == LAPIC_TIMER_VECTOR) {
+        if (lapic_timer_interrupt() != 0U) {
+            irq_scheduler_tick();
+        }
+        return;
+    }
+
     /* Convert interrupt number back to IRQ number (0-15) */
-    uint8_t irq = (uint8_t)(regs->int_no - IRQ_BASE);
+    irq = (uint8_t)(regs->int_no - IRQ_BASE);
 
     if (irq >= IRQ_COUNT) {
         return;
@@ -56,13 +80,9 @@ void irq_handler(struct isr_regs *regs)
     /* Send EOI to PIC after handling */
     pic_send_eoi(irq);
 
-    /* PIT-driven round-robin preemption (IRQ0). */
-    if (irq == 0U && process_is_preemption_enabled() != 0U) {
-        scheduler_tick_accum++;
-        if (scheduler_tick_accum >= SCHED_QUANTUM_TICKS) {
-            scheduler_tick_accum = 0U;
-            process_preempt_from_irq();
-        }
+    /* PIT-driven preemption (IRQ0) */
+    if (irq == 0U) {
+        irq_scheduler_tick();
     }
 }
 
@@ -1,7 +1,8 @@
 ; =============================================================================
 ; ClaudeOS IRQ Entry Stubs - Phase 2, Task 7
 ; =============================================================================
-; 16 IRQ entry points (IRQ 0-15, mapped to INT 32-47).
+; 16 IRQ entry points (IRQ 0-15, mapped to INT 32-47), plus the local
+; APIC timer (INT 0x30) and spurious (INT 0xFF) vectors.
 ; Each stub pushes a dummy error code (0) and the interrupt number,
 ; then jumps to irq_common which builds the same register frame
 ; as the ISR common stub (struct isr_regs) before calling irq_handler().
@@ -46,6 +47,20 @@ IRQ_STUB 13, 45
 IRQ_STUB 14, 46
 IRQ_STUB 15, 47
 
+; ---------------------------------------------------------------------------
+; Local APIC vectors (must match LAPIC_TIMER_VECTOR / LAPIC_SPURIOUS_VECTOR)
+; ---------------------------------------------------------------------------
+global lapic_timer_entry
+lapic_timer_entry:
+    push dword 0
+    push dword 0x30
+    jmp irq_common
+
+; Spurious APIC interrupts need no handler and no EOI
+global lapic_spurious_entry
+lapic_spurious_entry:
+    iret
+
 ; ---------------------------------------------------------------------------
 ; irq_common: build struct isr_regs frame, call C handler, restore and iret
 ; ---------------------------------------------------------------------------
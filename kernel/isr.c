@@ -1,6 +1,7 @@
 #include "isr.h"
 #include "vga.h"
 #include "serial.h"
+#include "vmm.h"
 
 /* Human-readable exception names for vectors 0-31 */
 static const char *exception_names[32] = {
@@ -70,6 +71,11 @@ static void print_reg(const char *label, uint32_t val)
 
 void isr_handler(struct isr_regs *regs)
 {
+    /* Recoverable page faults (copy-on-write) return to the faulting code */
+    if (regs->int_no == 14U && vmm_handle_page_fault(regs) == 0) {
+        return;
+    }
+
     /* Set error colors: white on red */
     vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_RED);
 
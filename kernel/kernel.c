@@ -7,8 +7,15 @@
 #include "idt.h"
 #include "irq.h"
 #include "pit.h"
+#include "clock.h"
+#include "lapic.h"
+#include "vdso.h"
+#include "paging.h"
 #include "pmm.h"
 #include "heap.h"
+#include "vmalloc.h"
+#include "kstack.h"
+#include "vmm.h"
 #include "keyboard.h"
 #include "mouse.h"
 #include "console.h"
@@ -18,6 +25,7 @@
 #include "vfs.h"
 #include "initrd.h"
 #include "fat32.h"
+#include "swap.h"
 #include "vbe.h"
 #include "wm.h"
 
@@ -55,8 +63,13 @@ void kernel_main(void)
     serial_puts("ClaudeOS serial debug ready\n");
     serial_puts("Paging enabled\n");
 
+    paging_init();
     pmm_init();
+    paging_physmap_init(pmm_get_usable_end());
     kheap_init();
+    vmalloc_init();
+    kstack_init();
+    vmm_init();
     (void)vbe_init();
 
     vga_init();
@@ -97,6 +110,11 @@ void kernel_main(void)
 
     pit_init();
     vga_puts("PIT initialized (100 Hz).\n");
+    clock_init();
+    if (lapic_init() == 0) {
+        vga_puts("LAPIC one-shot timer initialized.\n");
+    }
+    vdso_init();
 
     keyboard_init();
     vga_puts("PS/2 keyboard initialized (IRQ1).\n");
@@ -138,17 +156,25 @@ void kernel_main(void)
         vga_puts("FAT32 mount failed.\n");
     }
 
+    swap_init();
+
     tss_init();
     vga_puts("TSS initialized.\n");
     serial_puts("TSS initialized\n");
     process_refresh_tss_stack();
     serial_puts("[PROC] TSS esp0 synchronized for current task\n");
 
-    (void)process_create_kernel("demo_a", demo_process_a, 0);
-    (void)process_create_kernel("demo_b", demo_process_b, 0);
+    /* Background workers: lowest level, so they never delay the shell,
+     * the window manager or a running user program. */
+    (void)process_set_nice((uint32_t)kthread_create("demo_a", demo_process_a, 0),
+                           PROCESS_NICE_MAX);
+    (void)process_set_nice((uint32_t)kthread_create("demo_b", demo_process_b, 0),
+                           PROCESS_NICE_MAX);
 
     process_set_preemption(1U);
-    serial_puts("[PROC] Preemptive scheduler enabled (PIT-driven)\n");
+    serial_puts((lapic_timer_is_active() != 0U) ?
+                "[PROC] Preemptive scheduler enabled (LAPIC-driven)\n" :
+                "[PROC] Preemptive scheduler enabled (PIT-driven)\n");
 
     console_init();
 
@@ -184,6 +210,16 @@ void kernel_main(void)
         if (wm_is_active() != 0) {
             wm_update();
         }
-        __asm__ volatile ("hlt");
+
+        /* Idle: clear a few frames for pmm_alloc_zeroed_frame() */
+        pmm_zero_pool_refill();
+
+        /* Hand the CPU to READY work instead of halting through our slice;
+         * yielding early keeps the shell on the top priority level. */
+        if (process_has_ready() != 0U) {
+            process_yield();
+        } else {
+            __asm__ volatile ("hlt");
+        }
     }
 }
@@ -0,0 +1,155 @@
+/* ==========================================================================
+ * ClaudeOS Kernel Stack Region
+ * ==========================================================================
+ * Every process kernel stack gets a fixed slot in a dedicated 4MB range:
+ * one unmapped guard page followed by KSTACK_SIZE bytes of stack. Running
+ * off the bottom of a stack faults on the guard page instead of silently
+ * overwriting a neighbouring object.
+ *
+ * Slots that have never been used or whose frames were released sit on a
+ * free-slot stack; reaped stacks that are still mapped sit on a small LIFO
+ * cache, so the stack of a process that just exited is handed to the next
+ * one while its lines are still warm. Both operations are O(1).
+ *
+ * The page table for the region is created by kstack_init() at boot, like
+ * the vmalloc range, so every address space shares it.
+ * ========================================================================== */
+
+#include "kstack.h"
+#include "paging.h"
+#include "pmm.h"
+#include "serial.h"
+#include "spinlock.h"
+
+#include <stdint.h>
+
+#define KSTACK_SLOT_SIZE    (KSTACK_SIZE + PAGE_SIZE)
+#define KSTACK_SLOT_COUNT   ((KSTACK_REGION_END - KSTACK_REGION_START) / KSTACK_SLOT_SIZE)
+
+#if (KSTACK_SIZE % 4096U) != 0U || KSTACK_SIZE == 0U
+#error "KSTACK_SIZE must be a non-zero multiple of 4KB"
+#endif
+
+static uint16_t kstack_free_slots[KSTACK_SLOT_COUNT];
+static uint32_t kstack_free_count;
+static uint16_t kstack_cached[KSTACK_CACHE_MAX];
+static uint32_t kstack_cached_count;
+static uint32_t kstack_ready;
+static struct spinlock kstack_lock = SPINLOCK_INITIALIZER;
+
+/* Stack base of a slot: the guard page comes first */
+static uint32_t kstack_slot_base(uint32_t slot)
+{
+    return KSTACK_REGION_START + slot * KSTACK_SLOT_SIZE + PAGE_SIZE;
+}
+
+static int kstack_map_slot(uint32_t slot)
+{
+    uint32_t base = kstack_slot_base(slot);
+
+    for (uint32_t offset = 0; offset < KSTACK_SIZE; offset += PAGE_SIZE) {
+        uint32_t phys = pmm_alloc_frame();
+
+        if (phys == 0U || paging_map_page(base + offset, phys, PAGE_WRITABLE) != 0) {
+            if (phys != 0U) {
+                pmm_free_frame(phys);
+            }
+            if (offset != 0U) {
+                (void)paging_unmap_range(base, offset, 1, 0);
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void kstack_init(void)
+{
+    spinlock_init(&kstack_lock);
+    kstack_cached_count = 0U;
+    kstack_free_count = 0U;
+    kstack_ready = 0U;
+
+    if (paging_ensure_table(KSTACK_REGION_START, PAGE_WRITABLE) != 0) {
+        serial_puts("[KSTACK] page table preallocation failed\n");
+        return;
+    }
+
+    /* Lowest slots on top */
+    for (uint32_t slot = KSTACK_SLOT_COUNT; slot > 0U; slot--) {
+        kstack_free_slots[kstack_free_count++] = (uint16_t)(slot - 1U);
+    }
+
+    kstack_ready = 1U;
+    serial_puts("[KSTACK] stack region at 0xC8000000-0xC8400000\n");
+}
+
+void *kstack_alloc(void)
+{
+    uint32_t flags;
+    uint32_t slot;
+
+    flags = spinlock_lock_irqsave(&kstack_lock);
+    if (kstack_ready == 0U) {
+        spinlock_unlock_irqrestore(&kstack_lock, flags);
+        return 0;
+    }
+
+    if (kstack_cached_count != 0U) {
+        slot = kstack_cached[--kstack_cached_count];
+        spinlock_unlock_irqrestore(&kstack_lock, flags);
+        return (void *)(uintptr_t)kstack_slot_base(slot);
+    }
+
+    if (kstack_free_count == 0U) {
+        spinlock_unlock_irqrestore(&kstack_lock, flags);
+        serial_puts("[KSTACK] out of stack slots\n");
+        return 0;
+    }
+    slot = kstack_free_slots[--kstack_free_count];
+    spinlock_unlock_irqrestore(&kstack_lock, flags);
+
+    /* The slot is reserved; map it without holding the lock */
+    if (kstack_map_slot(slot) != 0) {
+        flags = spinlock_lock_irqsave(&kstack_lock);
+        kstack_free_slots[kstack_free_count++] = (uint16_t)slot;
+        spinlock_unlock_irqrestore(&kstack_lock, flags);
+        serial_puts("[KSTACK] out of physical frames\n");
+        return 0;
+    }
+
+    return (void *)(uintptr_t)kstack_slot_base(slot);
+}
+
+void kstack_free(void *stack)
+{
+    uint32_t base = (uint32_t)(uintptr_t)stack;
+    uint32_t flags;
+    uint32_t slot;
+
+    if (stack == 0) {
+        return;
+    }
+
+    if (base < KSTACK_REGION_START + PAGE_SIZE || base >= KSTACK_REGION_END ||
+        (base - KSTACK_REGION_START - PAGE_SIZE) % KSTACK_SLOT_SIZE != 0U) {
+        serial_puts("[KSTACK] free of foreign pointer ignored\n");
+        return;
+    }
+    slot = (base - KSTACK_REGION_START) / KSTACK_SLOT_SIZE;
+
+    flags = spinlock_lock_irqsave(&kstack_lock);
+    if (kstack_cached_count < KSTACK_CACHE_MAX) {
+        kstack_cached[kstack_cached_count++] = (uint16_t)slot;
+        spinlock_unlock_irqrestore(&kstack_lock, flags);
+        return;
+    }
+    spinlock_unlock_irqrestore(&kstack_lock, flags);
+
+    (void)paging_unmap_range(base, KSTACK_SIZE, 1, 0);
+
+    flags = spinlock_lock_irqsave(&kstack_lock);
+    kstack_free_slots[kstack_free_count++] = (uint16_t)slot;
+    spinlock_unlock_irqrestore(&kstack_lock, flags);
+}
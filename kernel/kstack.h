@@ -0,0 +1,32 @@
+#ifndef CLAUDE_KSTACK_H
+#define CLAUDE_KSTACK_H
+
+#include <stdint.h>
+
+/* Kernel virtual range reserved for process kernel stacks (one page table) */
+#define KSTACK_REGION_START 0xC8000000U
+#define KSTACK_REGION_END   0xC8400000U
+
+/* Stack size in bytes, a multiple of 4KB. Override at build time (e.g.
+ * -DKSTACK_SIZE=16384U) for deeper kernel paths. */
+#ifndef KSTACK_SIZE
+#define KSTACK_SIZE         8192U
+#endif
+
+/* Reaped stacks kept mapped for reuse */
+#define KSTACK_CACHE_MAX    8U
+
+/* Preallocate the page table for the stack region. Must run before the
+ * first process address space is created so every address space shares it. */
+void kstack_init(void);
+
+/* Return the lowest address of a KSTACK_SIZE stack whose page below is an
+ * unmapped guard, or 0 on failure. Reuses a cached stack in O(1) when one
+ * is available. */
+void *kstack_alloc(void);
+
+/* Return a stack from kstack_alloc(). It goes to the cache while there is
+ * room, otherwise its frames are released. */
+void kstack_free(void *stack);
+
+#endif /* CLAUDE_KSTACK_H */
@@ -0,0 +1,248 @@
+/* ==========================================================================
+ * ClaudeOS Local APIC Timer
+ * ==========================================================================
+ * The PIT only interrupts every 10ms, so a timer could fire up to a full
+ * tick late. The local APIC timer counts down from any value and raises
+ * one interrupt, which turns it into a clock event device: after every
+ * interrupt it is re-armed for the earlier of
+ *
+ *   - the head of the timer list (a nanosecond deadline), and
+ *   - the next 10ms scheduler tick,
+ *
+ * so timers fire at their deadline and slices keep their old length. Time
+ * itself still comes from the TSC clock; the APIC timer's rate is measured
+ * against it at boot.
+ *
+ * The APIC stays in virtual-wire mode: LINT0 passes the 8259 PIC through
+ * as ExtINT, so keyboard, mouse and disk IRQs are untouched. Only PIT IRQ0
+ * is masked once the APIC timer takes over. Without an APIC or a TSC the
+ * PIT keeps driving timers and the scheduler as before.
+ * ========================================================================== */
+
+#include "lapic.h"
+
+#include "clock.h"
+#include "idt.h"
+#include "paging.h"
+#include "pit.h"
+#include "serial.h"
+#include "timer.h"
+#include "vdso.h"
+
+#define LAPIC_CPUID_EDX_APIC    (1U << 9)
+#define LAPIC_MSR_APIC_BASE     0x1BU
+#define LAPIC_BASE_ENABLE       (1U << 11)
+
+/* Register offsets */
+#define LAPIC_REG_TPR           0x080U
+#define LAPIC_REG_EOI           0x0B0U
+#define LAPIC_REG_SVR           0x0F0U
+#define LAPIC_REG_LVT_TIMER     0x320U
+#define LAPIC_REG_LVT_LINT0     0x350U
+#define LAPIC_REG_LVT_LINT1     0x360U
+#define LAPIC_REG_TIMER_INIT    0x380U
+#define LAPIC_REG_TIMER_COUNT   0x390U
+#define LAPIC_REG_TIMER_DIV     0x3E0U
+
+#define LAPIC_SVR_ENABLE        0x100U
+#define LAPIC_LVT_MASKED        0x10000U
+#define LAPIC_LVT_EXTINT        0x700U
+#define LAPIC_LVT_NMI           0x400U
+#define LAPIC_TIMER_DIV_16      0x3U
+
+#define LAPIC_CALIBRATE_NS      10000000U
+#define LAPIC_MIN_TIMER_KHZ     100U
+#define LAPIC_TICK_NS           (1000000000U / PIT_TARGET_FREQ)
+
+/* Interrupt entry points from irq_stubs.asm */
+extern void lapic_timer_entry(void);
+extern void lapic_spurious_entry(void);
+
+static volatile uint32_t *lapic_regs;
+static uint32_t lapic_timer_khz;    /* timer input after the divider */
+static uint64_t lapic_next_tick_ns; /* next scheduler tick */
+static uint8_t lapic_active;
+
+static void serial_put_dec(uint32_t value)
+{
+    char buf[11];
+    uint32_t i = 0;
+
+    if (value == 0U) {
+        serial_putchar('0');
+        return;
+    }
+
+    while (value > 0U && i < sizeof(buf)) {
+        buf[i] = (char)('0' + (value % 10U));
+        value /= 10U;
+        i++;
+    }
+
+    while (i > 0U) {
+        i--;
+        serial_putchar(buf[i]);
+    }
+}
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic_regs[reg / 4U];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic_regs[reg / 4U] = value;
+}
+
+static uint8_t lapic_cpu_has_apic(void)
+{
+    uint32_t eax = 1U;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (uint8_t)((edx & LAPIC_CPUID_EDX_APIC) != 0U);
+}
+
+/* Timer input rate in kHz across LAPIC_CALIBRATE_NS of TSC time, or 0. */
+static uint32_t lapic_measure_timer(void)
+{
+    uint64_t start;
+    uint32_t elapsed;
+
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+
+    start = clock_monotonic_ns();
+    lapic_write(LAPIC_REG_TIMER_INIT, 0xFFFFFFFFU);
+    while (clock_monotonic_ns() - start < LAPIC_CALIBRATE_NS) {
+        __asm__ volatile ("pause");
+    }
+    elapsed = 0xFFFFFFFFU - lapic_read(LAPIC_REG_TIMER_COUNT);
+    lapic_write(LAPIC_REG_TIMER_INIT, 0U);
+
+    return elapsed / (LAPIC_CALIBRATE_NS / 1000000U);
+}
+
+int lapic_init(void)
+{
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t khz;
+
+    lapic_active = 0U;
+
+    if (lapic_cpu_has_apic() == 0U) {
+        serial_puts("[LAPIC] No local APIC, PIT drives timers\n");
+        return -1;
+    }
+
+    if (clock_tsc_khz() == 0U) {
+        serial_puts("[LAPIC] No TSC clock to calibrate against, PIT drives timers\n");
+        return -1;
+    }
+
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(LAPIC_MSR_APIC_BASE));
+    if ((lo & LAPIC_BASE_ENABLE) == 0U) {
+        lo |= LAPIC_BASE_ENABLE;
+        __asm__ volatile ("wrmsr" : : "a"(lo), "d"(hi), "c"(LAPIC_MSR_APIC_BASE));
+    }
+
+    if (paging_map_page(LAPIC_VIRT_BASE, lo & PAGE_FRAME_MASK,
+                        PAGE_WRITABLE | PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH) != 0) {
+        serial_puts("[LAPIC] Register page mapping failed, PIT drives timers\n");
+        return -1;
+    }
+    lapic_regs = (volatile uint32_t *)LAPIC_VIRT_BASE;
+
+    /* Virtual-wire mode: the PIC arrives through LINT0, NMI through LINT1 */
+    idt_set_gate((uint8_t)LAPIC_SPURIOUS_VECTOR, (uint32_t)lapic_spurious_entry,
+                 KERNEL_CS, IDT_GATE_INT32);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_EXTINT);
+    lapic_write(LAPIC_REG_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_REG_TPR, 0U);
+
+    khz = lapic_measure_timer();
+    if (khz < LAPIC_MIN_TIMER_KHZ) {
+        serial_puts("[LAPIC] Timer calibration failed, PIT drives timers\n");
+        return -1;
+    }
+    lapic_timer_khz = khz;
+
+    /* One-shot mode, unmasked; nothing counts until the first re-arm */
+    idt_set_gate((uint8_t)LAPIC_TIMER_VECTOR, (uint32_t)lapic_timer_entry,
+                 KERNEL_CS, IDT_GATE_INT32);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_VECTOR);
+
+    lapic_next_tick_ns = clock_monotonic_ns() + LAPIC_TICK_NS;
+    lapic_active = 1U;
+    pit_stop_irq();
+    lapic_timer_reprogram();
+
+    serial_puts("[LAPIC] One-shot timer at ");
+    serial_put_dec(khz);
+    serial_puts(" kHz drives timers and the scheduler tick\n");
+    return 0;
+}
+
+uint8_t lapic_timer_is_active(void)
+{
+    return lapic_active;
+}
+
+void lapic_timer_reprogram(void)
+{
+    uint64_t deadline;
+    uint64_t next;
+    uint64_t now;
+    uint64_t cycles;
+    uint32_t count = 1U;
+
+    if (lapic_active == 0U) {
+        return;
+    }
+
+    deadline = lapic_next_tick_ns;
+    if (timer_next_deadline(&next) == 0 && next < deadline) {
+        deadline = next;
+    }
+
+    /* At most one tick away, so the product cannot overflow. Rounding up
+     * means the interrupt never comes before the deadline. */
+    now = clock_monotonic_ns();
+    if (deadline > now) {
+        cycles = clock_div64((deadline - now) * lapic_timer_khz + 999999U, 1000000U, 0);
+        if (cycles > 0xFFFFFFFFU) {
+            count = 0xFFFFFFFFU;
+        } else if (cycles != 0U) {
+            count = (uint32_t)cycles;
+        }
+    }
+
+    /* Writing the initial count restarts the countdown */
+    lapic_write(LAPIC_REG_TIMER_INIT, count);
+}
+
+uint8_t lapic_timer_interrupt(void)
+{
+    uint64_t now = clock_monotonic_ns();
+    uint8_t tick = 0U;
+
+    if (now >= lapic_next_tick_ns) {
+        tick = 1U;
+        lapic_next_tick_ns += LAPIC_TICK_NS;
+        if (lapic_next_tick_ns <= now) {
+            /* Missed ticks are not replayed */
+            lapic_next_tick_ns = now + LAPIC_TICK_NS;
+        }
+        vdso_update_ticks(pit_get_ticks());
+    }
+
+    timer_run_expired();
+    lapic_timer_reprogram();
+    lapic_write(LAPIC_REG_EOI, 0U);
+    return tick;
+}
@@ -0,0 +1,32 @@
+#ifndef CLAUDE_LAPIC_H
+#define CLAUDE_LAPIC_H
+
+#include <stdint.h>
+
+/* IDT vectors owned by the local APIC (above the remapped PIC range) */
+#define LAPIC_TIMER_VECTOR      0x30U
+#define LAPIC_SPURIOUS_VECTOR   0xFFU
+
+/* Kernel virtual page the LAPIC registers are mapped at (uncached), just
+ * past the framebuffer window. */
+#define LAPIC_VIRT_BASE         0xD1000000U
+
+/* Detect and enable the local APIC in virtual-wire mode (the PIC keeps
+ * delivering device IRQs), calibrate its timer against the TSC clock and
+ * take over timers and the scheduler tick from PIT IRQ0. Call after
+ * clock_init() and before process_init(). Returns 0 when the LAPIC timer
+ * is in use, -1 when the PIT stays in charge (no APIC or no TSC). */
+int lapic_init(void);
+
+/* Return 1 while the LAPIC one-shot timer drives timers, else 0. */
+uint8_t lapic_timer_is_active(void);
+
+/* Re-arm the one-shot for the earlier of the next timer deadline and the
+ * next scheduler tick. IRQs must be off. No-op with the PIT fallback. */
+void lapic_timer_reprogram(void);
+
+/* LAPIC timer interrupt body: runs due timers, re-arms and sends EOI.
+ * Returns 1 when a scheduler tick is due, else 0. */
+uint8_t lapic_timer_interrupt(void);
+
+#endif /* CLAUDE_LAPIC_H */
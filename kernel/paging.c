@@ -1,10 +1,62 @@
 #include "paging.h"
 #include "pmm.h"
+#include "serial.h"
+#include "spinlock.h"
+#include "swap.h"
 
 /* Recursive paging layout (set by kernel_entry.asm) */
 #define RECURSIVE_PD_VADDR  0xFFFFF000U
 #define RECURSIVE_PT_VADDR  0xFFC00000U
 #define PAGE_TABLE_ENTRIES  1024U
+#define KERNEL_PD_INDEX     768U
+
+#define CPUID_EDX_PSE       0x00000008U
+#define CPUID_EDX_PGE       0x00002000U
+#define CR4_PSE             0x00000010U
+#define CR4_PGE             0x00000080U
+
+/* Kernel range whose translations are identical in every address space.
+ * The recursive window (PD[1023]) maps the current directory and must stay
+ * non-global. */
+#define GLOBAL_RANGE_START  0xC0000000U
+#define GLOBAL_RANGE_END    RECURSIVE_PT_VADDR
+
+/* PTE bits that a split large page keeps (PS and the PDE PAT bit drop) */
+#define LARGE_SPLIT_FLAGS   (PAGE_FLAGS_MASK & ~PAGE_LARGE)
+
+/* Above this many pages one full flush beats an invlpg sweep */
+#define PAGING_INVLPG_MAX   32U
+/* Frames collected on the stack before a pmm_free_frame_batch() call */
+#define PAGING_FREE_BATCH   64U
+/* Bits paging_protect_range() rewrites */
+#define PAGING_PROT_MASK    (PAGE_WRITABLE | PAGE_USER | PAGE_COW)
+
+static uint8_t paging_pse_enabled;
+static uint32_t paging_physmap_end;     /* physical bytes covered by the physmap */
+static uint32_t paging_global_flag;     /* PAGE_GLOBAL once CR4.PGE is on */
+static struct spinlock paging_split_lock = SPINLOCK_INITIALIZER;
+
+static void serial_put_dec(uint32_t value)
+{
+    char buf[11];
+    uint32_t i = 0;
+
+    if (value == 0U) {
+        serial_putchar('0');
+        return;
+    }
+
+    while (value > 0U && i < sizeof(buf)) {
+        buf[i] = (char)('0' + (value % 10U));
+        value /= 10U;
+        i++;
+    }
+
+    while (i > 0U) {
+        i--;
+        serial_putchar(buf[i]);
+    }
+}
 
 static inline uint32_t *paging_page_directory(void)
 {
@@ -21,21 +73,258 @@ static inline void paging_flush_tlb_single(uint32_t virt_addr)
     __asm__ volatile ("invlpg (%0)" : : "r" ((void *)(uintptr_t)virt_addr) : "memory");
 }
 
+/* Full flush. A CR3 reload keeps global entries, so with PGE on the
+ * CR4.PGE bit is toggled instead, which drops every translation. */
 static inline void paging_flush_tlb_all(void)
 {
-    uint32_t cr3;
-    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
-    __asm__ volatile ("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    uint32_t reg;
+
+    if (paging_global_flag != 0U) {
+        __asm__ volatile ("mov %%cr4, %0" : "=r"(reg));
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(reg & ~CR4_PGE) : "memory");
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(reg) : "memory");
+        return;
+    }
+
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(reg));
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(reg) : "memory");
 }
 
-int paging_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
+/* Invalidate 'pages' pages starting at virt_addr. User-only ranges never
+ * hold global entries, so a CR3 reload is enough there. */
+static void paging_flush_tlb_range(uint32_t virt_addr, uint32_t pages)
 {
-    if ((virt_addr & (PAGE_SIZE - 1U)) != 0U || (phys_addr & (PAGE_SIZE - 1U)) != 0U) {
+    if (pages == 0U) {
+        return;
+    }
+
+    if (pages <= PAGING_INVLPG_MAX) {
+        for (uint32_t i = 0; i < pages; i++) {
+            paging_flush_tlb_single(virt_addr + i * PAGE_SIZE);
+        }
+    } else if (virt_addr + pages * PAGE_SIZE <= GLOBAL_RANGE_START) {
+        uint32_t cr3;
+
+        __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+        __asm__ volatile ("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    } else {
+        paging_flush_tlb_all();
+    }
+}
+
+/* Page-align a [virt_addr, virt_addr + size) request; returns the page count */
+static uint32_t paging_range_pages(uint32_t virt_addr, uint32_t size)
+{
+    if ((virt_addr & (PAGE_SIZE - 1U)) != 0U || size == 0U ||
+        size - 1U > 0xFFFFFFFFU - virt_addr) {
+        return 0U;
+    }
+
+    return (size + PAGE_SIZE - 1U) / PAGE_SIZE;
+}
+
+static inline uint32_t paging_global_bit(uint32_t virt_addr)
+{
+    return (virt_addr >= GLOBAL_RANGE_START && virt_addr < GLOBAL_RANGE_END)
+        ? paging_global_flag : 0U;
+}
+
+void paging_init(void)
+{
+    uint32_t eax = 1U;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t cr4;
+    uint32_t *pd = paging_page_directory();
+
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+
+    if ((edx & CPUID_EDX_PSE) != 0U) {
+        cr4 |= CR4_PSE;
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+        paging_pse_enabled = 1U;
+
+        /* The boot page table maps physical 0-4MB 1:1 at 0xC0000000; one
+         * large PDE covers the same range with a single TLB entry. The old
+         * table lives in the boot image and is simply no longer referenced. */
+        pd[KERNEL_PD_INDEX] = PAGE_PRESENT | PAGE_WRITABLE | PAGE_LARGE;
+        paging_flush_tlb_all();
+        serial_puts("[PAGING] PSE enabled, kernel window mapped with a 4MB page\n");
+    } else {
+        serial_puts("[PAGING] PSE not supported, 4KB pages only\n");
+    }
+
+    if ((edx & CPUID_EDX_PGE) != 0U) {
+        /* Kernel translations are shared by every address space; marking
+         * them global lets them survive the CR3 load on a process switch */
+        if (paging_pse_enabled != 0U) {
+            pd[KERNEL_PD_INDEX] |= PAGE_GLOBAL;
+        } else {
+            uint32_t *pt = paging_page_table(KERNEL_PD_INDEX);
+
+            for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+                pt[i] |= PAGE_GLOBAL;
+            }
+        }
+
+        cr4 |= CR4_PGE;
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+        paging_global_flag = PAGE_GLOBAL;
+        paging_flush_tlb_all();
+        serial_puts("[PAGING] PGE enabled, kernel mappings are global\n");
+    }
+}
+
+int paging_large_pages_enabled(void)
+{
+    return (paging_pse_enabled != 0U) ? 1 : 0;
+}
+
+void paging_physmap_init(uint32_t phys_end)
+{
+    uint32_t bytes;
+
+    if (phys_end > PHYSMAP_MAX_BYTES) {
+        phys_end = PHYSMAP_MAX_BYTES;
+    }
+    bytes = (phys_end + LARGE_PAGE_SIZE - 1U) & LARGE_PAGE_MASK;
+    if (bytes > PHYSMAP_MAX_BYTES || bytes == 0U) {
+        bytes = PHYSMAP_MAX_BYTES;
+    }
+
+    if (paging_pse_enabled != 0U) {
+        for (uint32_t offset = 0; offset < bytes; offset += LARGE_PAGE_SIZE) {
+            if (paging_map_large(PHYSMAP_BASE + offset, offset, PAGE_WRITABLE) != 0) {
+                bytes = offset;
+                break;
+            }
+        }
+    } else if (paging_map_range(PHYSMAP_BASE, 0U, bytes, PAGE_WRITABLE) != 0) {
+        bytes = 0U;
+    }
+
+    paging_physmap_end = bytes;
+
+    serial_puts("[PAGING] physmap covers ");
+    serial_put_dec(bytes >> 20);
+    serial_puts("MB at 0xE0000000\n");
+}
+
+void *phys_to_virt(uint32_t phys_addr)
+{
+    if (phys_addr >= paging_physmap_end) {
+        return 0;
+    }
+
+    return (void *)(uintptr_t)(PHYSMAP_BASE + phys_addr);
+}
+
+uint32_t virt_to_phys(const void *virt)
+{
+    uint32_t addr = (uint32_t)(uintptr_t)virt;
+
+    if (addr >= PHYSMAP_BASE && addr - PHYSMAP_BASE < paging_physmap_end) {
+        return addr - PHYSMAP_BASE;
+    }
+
+    return paging_get_phys_addr(addr);
+}
+
+int paging_map_large(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
+{
+    uint32_t *pd = paging_page_directory();
+    uint32_t pd_index = virt_addr >> 22;
+
+    if (paging_pse_enabled == 0U ||
+        (virt_addr & ~LARGE_PAGE_MASK) != 0U || (phys_addr & ~LARGE_PAGE_MASK) != 0U ||
+        pd_index == 1023U) {
+        return -1;
+    }
+
+    if ((pd[pd_index] & PAGE_PRESENT) != 0U) {
         return -1;
     }
 
+    pd[pd_index] = phys_addr
+                 | (flags & LARGE_SPLIT_FLAGS)
+                 | paging_global_bit(virt_addr)
+                 | PAGE_LARGE
+                 | PAGE_PRESENT;
+
+    paging_flush_tlb_single(virt_addr);
+    return 0;
+}
+
+uint32_t paging_unmap_large(uint32_t virt_addr)
+{
+    uint32_t *pd = paging_page_directory();
+    uint32_t pd_index = virt_addr >> 22;
+    uint32_t entry = pd[pd_index];
+
+    if ((virt_addr & ~LARGE_PAGE_MASK) != 0U ||
+        (entry & (PAGE_PRESENT | PAGE_LARGE)) != (PAGE_PRESENT | PAGE_LARGE)) {
+        return 0U;
+    }
+
+    pd[pd_index] = 0U;
+    paging_flush_tlb_single(virt_addr);
+
+    return entry & LARGE_PAGE_MASK;
+}
+
+int paging_split_large(uint32_t virt_addr)
+{
+    uint32_t pd_index = virt_addr >> 22;
+    uint32_t *pd = paging_page_directory();
+    uint32_t *pt;
+    uint32_t entry;
+    uint32_t pt_phys;
+    uint32_t flags;
+
+    if ((pd[pd_index] & (PAGE_PRESENT | PAGE_LARGE)) != (PAGE_PRESENT | PAGE_LARGE)) {
+        return 0;
+    }
+
+    pt_phys = pmm_alloc_frame();
+    if (pt_phys == 0U) {
+        return -1;
+    }
+
+    flags = spinlock_lock_irqsave(&paging_split_lock);
+    entry = pd[pd_index];
+
+    pt = (uint32_t *)phys_to_virt(pt_phys);
+    if (pt != 0) {
+        /* Fill the table through the physmap, then swap it in; only the
+         * large entry and its recursive-window alias need invalidating */
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            pt[i] = ((entry & LARGE_PAGE_MASK) + i * PAGE_SIZE) | (entry & LARGE_SPLIT_FLAGS);
+        }
+        pd[pd_index] = pt_phys | (entry & (PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER));
+        paging_flush_tlb_single(virt_addr & LARGE_PAGE_MASK);
+        paging_flush_tlb_single((uint32_t)(uintptr_t)paging_page_table(pd_index));
+    } else {
+        /* The range is briefly unmapped while the table is filled through
+         * the recursive window; keep interrupts away from it */
+        pd[pd_index] = pt_phys | (entry & (PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER));
+        paging_flush_tlb_all();
+
+        pt = paging_page_table(pd_index);
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            pt[i] = ((entry & LARGE_PAGE_MASK) + i * PAGE_SIZE) | (entry & LARGE_SPLIT_FLAGS);
+        }
+        paging_flush_tlb_all();
+    }
+
+    spinlock_unlock_irqrestore(&paging_split_lock, flags);
+    return 0;
+}
+
+int paging_ensure_table(uint32_t virt_addr, uint32_t flags)
+{
     uint32_t pd_index = virt_addr >> 22;
-    uint32_t pt_index = (virt_addr >> 12) & 0x3FFU;
     uint32_t *pd = paging_page_directory();
     uint32_t required_pde_flags = PAGE_PRESENT | PAGE_WRITABLE;
 
@@ -43,8 +332,21 @@ int paging_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
         required_pde_flags |= PAGE_USER;
     }
 
+    if ((pd[pd_index] & PAGE_LARGE) != 0U) {
+        /* Already covered by a 4MB page; there is no table to map into */
+        return -1;
+    }
+
     if ((pd[pd_index] & PAGE_PRESENT) == 0U) {
-        uint32_t pt_phys = pmm_alloc_frame();
+        /* A pre-zeroed table can go live at once: a PDE going from
+         * not-present to present needs no TLB invalidation */
+        uint32_t pt_phys = pmm_alloc_zeroed_frame();
+        if (pt_phys != 0U) {
+            pd[pd_index] = (pt_phys & PAGE_FRAME_MASK) | required_pde_flags;
+            return 0;
+        }
+
+        pt_phys = pmm_alloc_frame();
         if (pt_phys == 0U) {
             return -1;
         }
@@ -67,6 +369,27 @@ int paging_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
         paging_flush_tlb_all();
     }
 
+    return 0;
+}
+
+int paging_pde_present(uint32_t virt_addr)
+{
+    return ((paging_page_directory()[virt_addr >> 22] & PAGE_PRESENT) != 0U) ? 1 : 0;
+}
+
+int paging_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
+{
+    if ((virt_addr & (PAGE_SIZE - 1U)) != 0U || (phys_addr & (PAGE_SIZE - 1U)) != 0U) {
+        return -1;
+    }
+
+    uint32_t pd_index = virt_addr >> 22;
+    uint32_t pt_index = (virt_addr >> 12) & 0x3FFU;
+
+    if (paging_ensure_table(virt_addr, flags) != 0) {
+        return -1;
+    }
+
     uint32_t *pt = paging_page_table(pd_index);
 
     if ((pt[pt_index] & PAGE_PRESENT) != 0U) {
@@ -75,6 +398,7 @@ int paging_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
 
     pt[pt_index] = (phys_addr & PAGE_FRAME_MASK)
                  | (flags & PAGE_FLAGS_MASK)
+                 | paging_global_bit(virt_addr)
                  | PAGE_PRESENT;
 
     paging_flush_tlb_single(virt_addr);
@@ -91,7 +415,7 @@ uint32_t paging_unmap_page(uint32_t virt_addr)
     uint32_t pt_index = (virt_addr >> 12) & 0x3FFU;
     uint32_t *pd = paging_page_directory();
 
-    if ((pd[pd_index] & PAGE_PRESENT) == 0U) {
+    if ((pd[pd_index] & PAGE_PRESENT) == 0U || paging_split_large(virt_addr) != 0) {
         return 0U;
     }
 
@@ -119,6 +443,10 @@ uint32_t paging_get_phys_addr(uint32_t virt_addr)
         return 0U;
     }
 
+    if ((pd[pd_index] & PAGE_LARGE) != 0U) {
+        return (pd[pd_index] & LARGE_PAGE_MASK) + (virt_addr & ~LARGE_PAGE_MASK);
+    }
+
     uint32_t *pt = paging_page_table(pd_index);
     uint32_t entry = pt[pt_index];
     if ((entry & PAGE_PRESENT) == 0U) {
@@ -148,6 +476,11 @@ int paging_get_page_flags(uint32_t virt_addr, uint32_t *flags_out)
         return -1;
     }
 
+    if ((pd[pd_index] & PAGE_LARGE) != 0U) {
+        *flags_out = pd[pd_index] & PAGE_FLAGS_MASK;
+        return 0;
+    }
+
     pt = paging_page_table(pd_index);
     entry = pt[pt_index];
     if ((entry & PAGE_PRESENT) == 0U) {
@@ -158,6 +491,18 @@ int paging_get_page_flags(uint32_t virt_addr, uint32_t *flags_out)
     return 0;
 }
 
+uint32_t paging_get_entry(uint32_t virt_addr)
+{
+    uint32_t pd_index = virt_addr >> 22;
+    uint32_t *pd = paging_page_directory();
+
+    if ((pd[pd_index] & PAGE_PRESENT) == 0U || (pd[pd_index] & PAGE_LARGE) != 0U) {
+        return 0U;
+    }
+
+    return paging_page_table(pd_index)[(virt_addr >> 12) & 0x3FFU];
+}
+
 int paging_or_page_flags(uint32_t virt_addr, uint32_t flags)
 {
     uint32_t pd_index;
@@ -181,7 +526,7 @@ int paging_or_page_flags(uint32_t virt_addr, uint32_t flags)
         required_pde_flags |= PAGE_USER;
     }
 
-    if ((pd[pd_index] & PAGE_PRESENT) == 0U) {
+    if ((pd[pd_index] & PAGE_PRESENT) == 0U || paging_split_large(virt_addr) != 0) {
         return -1;
     }
 
@@ -204,3 +549,245 @@ int paging_or_page_flags(uint32_t virt_addr, uint32_t flags)
 
     return 0;
 }
+
+int paging_map_range(uint32_t virt_addr, uint32_t phys_addr, uint32_t size,
+                     uint32_t flags)
+{
+    uint32_t pages = paging_range_pages(virt_addr, size);
+    uint32_t done = 0U;
+    uint8_t collided = 0U;
+
+    if (pages == 0U || (phys_addr & (PAGE_SIZE - 1U)) != 0U) {
+        return -1;
+    }
+
+    /* Not-present entries are never cached, so filling empty PTEs needs no
+     * invalidation; only the table walk per 4MB is left */
+    while (done < pages && collided == 0U) {
+        uint32_t va = virt_addr + done * PAGE_SIZE;
+        uint32_t pd_index = va >> 22;
+        uint32_t pt_index = (va >> 12) & 0x3FFU;
+        uint32_t chunk = PAGE_TABLE_ENTRIES - pt_index;
+        uint32_t *pt;
+        uint32_t entry_flags = (flags & PAGE_FLAGS_MASK) | paging_global_bit(va) | PAGE_PRESENT;
+
+        if (chunk > pages - done) {
+            chunk = pages - done;
+        }
+
+        if (paging_ensure_table(va, flags) != 0) {
+            break;
+        }
+
+        pt = paging_page_table(pd_index);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if ((pt[pt_index + i] & PAGE_PRESENT) != 0U) {
+                chunk = i;
+                collided = 1U;
+                break;
+            }
+        }
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            pt[pt_index + i] = (phys_addr + (done + i) * PAGE_SIZE) | entry_flags;
+        }
+        done += chunk;
+    }
+
+    if (done < pages) {
+        (void)paging_unmap_range(virt_addr, done * PAGE_SIZE, 0, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Nonzero when the 'pages' pages from virt_addr cover the whole 4MB around va */
+static int paging_range_covers_large(uint32_t virt_addr, uint32_t pages, uint32_t va)
+{
+    uint32_t first = virt_addr >> 12;
+    uint32_t base = (va & LARGE_PAGE_MASK) >> 12;
+
+    return base >= first && base - first + PAGE_TABLE_ENTRIES <= pages;
+}
+
+int paging_split_range(uint32_t virt_addr, uint32_t size)
+{
+    uint32_t pages = paging_range_pages(virt_addr, size);
+    uint32_t done = 0U;
+
+    if (pages == 0U) {
+        return -1;
+    }
+
+    while (done < pages) {
+        uint32_t va = virt_addr + done * PAGE_SIZE;
+
+        if (paging_split_large(va) != 0) {
+            return -1;
+        }
+        done += PAGE_TABLE_ENTRIES - ((va >> 12) & 0x3FFU);
+    }
+
+    return 0;
+}
+
+int paging_unmap_range(uint32_t virt_addr, uint32_t size, int release_frames,
+                       uint32_t *unmapped_out)
+{
+    uint32_t pages = paging_range_pages(virt_addr, size);
+    uint32_t *pd = paging_page_directory();
+    uint32_t frames[PAGING_FREE_BATCH];
+    uint32_t frame_count = 0U;
+    uint32_t unmapped = 0U;
+    uint32_t done = 0U;
+
+    if (unmapped_out != 0) {
+        *unmapped_out = 0U;
+    }
+
+    /* Only the first and last 4MB can be partly covered. Split those before
+     * anything changes, so a missing page-table frame leaves the range as
+     * it was; fully covered 4MB pages are dropped whole below. */
+    if (pages != 0U &&
+        ((paging_range_covers_large(virt_addr, pages, virt_addr) == 0 &&
+          paging_split_large(virt_addr) != 0) ||
+         (paging_range_covers_large(virt_addr, pages, virt_addr + (pages - 1U) * PAGE_SIZE) == 0 &&
+          paging_split_large(virt_addr + (pages - 1U) * PAGE_SIZE) != 0))) {
+        return -1;
+    }
+
+    while (done < pages) {
+        uint32_t va = virt_addr + done * PAGE_SIZE;
+        uint32_t pd_index = va >> 22;
+        uint32_t pt_index = (va >> 12) & 0x3FFU;
+        uint32_t chunk = PAGE_TABLE_ENTRIES - pt_index;
+        uint32_t *pt;
+
+        if (chunk > pages - done) {
+            chunk = pages - done;
+        }
+
+        if ((pd[pd_index] & PAGE_PRESENT) == 0U) {
+            done += chunk;
+            continue;
+        }
+
+        if ((pd[pd_index] & PAGE_LARGE) != 0U) {
+            uint32_t phys = paging_unmap_large(va);
+
+            unmapped += PAGE_TABLE_ENTRIES;
+            if (release_frames != 0) {
+                pmm_free_frames(phys, PMM_MAX_ORDER);
+            }
+            done += chunk;
+            continue;
+        }
+
+        pt = paging_page_table(pd_index);
+        for (uint32_t i = 0; i < chunk; i++) {
+            uint32_t entry = pt[pt_index + i];
+
+            /* A swapped-out page owns a swap slot instead of a frame */
+            if (swap_pte_is_swapped(entry) != 0) {
+                pt[pt_index + i] = 0U;
+                if (release_frames != 0) {
+                    swap_free_slot(swap_pte_slot(entry));
+                }
+                continue;
+            }
+
+            if ((entry & PAGE_PRESENT) == 0U) {
+                continue;
+            }
+
+            pt[pt_index + i] = 0U;
+            unmapped++;
+
+            if (release_frames != 0) {
+                frames[frame_count++] = entry & PAGE_FRAME_MASK;
+                if (frame_count == PAGING_FREE_BATCH) {
+                    pmm_free_frame_batch(frames, frame_count);
+                    frame_count = 0U;
+                }
+            }
+        }
+        done += chunk;
+    }
+
+    /* Flush before the frames can be handed out again */
+    paging_flush_tlb_range(virt_addr, pages);
+    if (frame_count != 0U) {
+        pmm_free_frame_batch(frames, frame_count);
+    }
+
+    if (unmapped_out != 0) {
+        *unmapped_out = unmapped;
+    }
+    return 0;
+}
+
+int paging_protect_range(uint32_t virt_addr, uint32_t size, uint32_t flags)
+{
+    uint32_t pages = paging_range_pages(virt_addr, size);
+    uint32_t *pd = paging_page_directory();
+    uint32_t done = 0U;
+    uint32_t changed = 0U;
+
+    /* Split every 4MB page first: a failure then leaves all PTEs as they
+     * were (splitting alone changes nothing visible) */
+    if (paging_split_range(virt_addr, size) != 0) {
+        return -1;
+    }
+
+    while (done < pages) {
+        uint32_t va = virt_addr + done * PAGE_SIZE;
+        uint32_t pd_index = va >> 22;
+        uint32_t pt_index = (va >> 12) & 0x3FFU;
+        uint32_t chunk = PAGE_TABLE_ENTRIES - pt_index;
+        uint32_t *pt;
+
+        if (chunk > pages - done) {
+            chunk = pages - done;
+        }
+
+        if ((pd[pd_index] & PAGE_PRESENT) == 0U) {
+            done += chunk;
+            continue;
+        }
+
+        /* PDE permissions must allow anything a PTE below grants */
+        if ((flags & PAGE_USER) != 0U && (pd[pd_index] & PAGE_USER) == 0U) {
+            pd[pd_index] |= PAGE_USER;
+            changed++;
+        }
+
+        pt = paging_page_table(pd_index);
+        for (uint32_t i = 0; i < chunk; i++) {
+            uint32_t entry = pt[pt_index + i];
+            uint32_t new_entry;
+
+            /* Swap entries carry the rights the page returns with */
+            if (swap_pte_is_swapped(entry) != 0) {
+                pt[pt_index + i] = (entry & ~PAGING_PROT_MASK) | (flags & PAGING_PROT_MASK);
+                continue;
+            }
+
+            if ((entry & PAGE_PRESENT) == 0U) {
+                continue;
+            }
+
+            new_entry = (entry & ~PAGING_PROT_MASK) | (flags & PAGING_PROT_MASK);
+            if (new_entry != entry) {
+                pt[pt_index + i] = new_entry;
+                changed++;
+            }
+        }
+        done += chunk;
+    }
+
+    if (changed != 0U) {
+        paging_flush_tlb_range(virt_addr, pages);
+    }
+    return 0;
+}
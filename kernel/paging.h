@@ -8,8 +8,97 @@
 #define PAGE_PRESENT        0x001U
 #define PAGE_WRITABLE       0x002U
 #define PAGE_USER           0x004U
+#define PAGE_WRITE_THROUGH  0x008U
+#define PAGE_CACHE_DISABLE  0x010U  /* device registers (MMIO) */
+#define PAGE_ACCESSED       0x020U  /* set by the CPU on any access */
+#define PAGE_DIRTY          0x040U  /* set by the CPU on a write */
+#define PAGE_LARGE          0x080U  /* PDE only: 4MB page (PSE) */
+#define PAGE_GLOBAL         0x100U  /* kept across CR3 loads (PGE) */
+#define PAGE_COW            0x200U  /* software bit: read-only copy-on-write page */
+#define PAGE_SWAPPED        0x400U  /* software bit, non-present PTE: page is in swap */
 #define PAGE_FLAGS_MASK     0x0FFFU
 #define PAGE_FRAME_MASK     0xFFFFF000U
+#define LARGE_PAGE_SIZE     0x00400000U
+#define LARGE_PAGE_MASK     0xFFC00000U
+
+/*
+ * Enable CR4.PSE and CR4.PGE (when the CPU supports them), remap the boot
+ * 4MB kernel window at 0xC0000000 as a single large page and mark it global.
+ * Afterwards every kernel mapping made through this API (0xC0000000 up to
+ * the recursive window) gets PAGE_GLOBAL. Must run before the first process
+ * address space is created.
+ */
+void paging_init(void);
+
+/* Returns 1 when 4MB pages are enabled, 0 otherwise. */
+int paging_large_pages_enabled(void);
+
+/* Physmap: permanent linear kernel mapping of low physical memory */
+#define PHYSMAP_BASE        0xE0000000U
+#define PHYSMAP_MAX_BYTES   0x1F800000U     /* 504MB, up to 0xFF800000 */
+
+/*
+ * Map physical [0, phys_end) (clamped to PHYSMAP_MAX_BYTES) at PHYSMAP_BASE,
+ * with global 4MB pages when PSE is available. Must run after pmm_init() and
+ * before the first process address space is created.
+ */
+void paging_physmap_init(uint32_t phys_end);
+
+/* Kernel pointer for a physical address, or 0 if the physmap does not
+ * cover it (callers then need a temporary mapping). */
+void *phys_to_virt(uint32_t phys_addr);
+
+/* Physical address behind a kernel pointer (physmap or page tables).
+ * Returns 0 if unmapped. */
+uint32_t virt_to_phys(const void *virt);
+
+/*
+ * Make sure the page table covering virt_addr exists (allocating and zeroing
+ * it if needed) with PDE permissions that allow 'flags'.
+ * Returns 0 on success, -1 on failure.
+ */
+int paging_ensure_table(uint32_t virt_addr, uint32_t flags);
+
+/*
+ * Map [virt_addr, virt_addr + size) to the physically contiguous range at
+ * phys_addr. Walks each page table once; all target PTEs must be empty.
+ * On failure nothing stays mapped. Returns 0 on success, -1 on failure.
+ */
+int paging_map_range(uint32_t virt_addr, uint32_t phys_addr, uint32_t size,
+                     uint32_t flags);
+
+/*
+ * Unmap every present page in [virt_addr, virt_addr + size). 4MB pages the
+ * range covers whole are dropped as one block; one it covers only in part
+ * is split first. With release_frames set, the frames go back to the PMM
+ * in batches and the swap slots of swapped-out pages are released.
+ * Returns 0 and stores the number of pages unmapped in 'unmapped_out' (may
+ * be 0), or -1 with nothing unmapped when a split finds no frame for the
+ * page table.
+ */
+int paging_unmap_range(uint32_t virt_addr, uint32_t size, int release_frames,
+                       uint32_t *unmapped_out);
+
+/*
+ * Split every 4MB page overlapping [virt_addr, virt_addr + size) into 4KB
+ * entries with the same frames and flags. Returns 0, or -1 on invalid
+ * arguments or when a page table cannot be allocated; pages split before
+ * the failure stay split, which changes no translation.
+ */
+int paging_split_range(uint32_t virt_addr, uint32_t size);
+
+/*
+ * Replace the PAGE_WRITABLE / PAGE_USER / PAGE_COW bits of every present
+ * or swapped-out page in [virt_addr, virt_addr + size) with those in
+ * 'flags'. Unmapped pages are skipped. 4MB pages are split first.
+ * Returns 0 on success, or -1 with no PTE changed on invalid arguments or
+ * when a split finds no frame for the page table (paging_split_range()
+ * beforehand makes the call unable to fail).
+ */
+int paging_protect_range(uint32_t virt_addr, uint32_t size, uint32_t flags);
+
+/* Returns 1 if a page table or 4MB page covers virt_addr, else 0. */
+int paging_pde_present(uint32_t virt_addr);
 
 /*
  * Map one 4KB virtual page to one 4KB physical frame.
@@ -19,7 +108,29 @@
 int paging_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags);
 
 /*
- * Unmap one 4KB virtual page.
+ * Map one 4MB page directly in the page directory. Both addresses must be
+ * 4MB-aligned and the PDE must be empty.
+ * Returns 0 on success, -1 on failure (including no PSE support).
+ */
+int paging_map_large(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags);
+
+/*
+ * Remove a 4MB mapping.
+ * Returns its physical base, or 0 if virt_addr is not a large page.
+ */
+uint32_t paging_unmap_large(uint32_t virt_addr);
+
+/*
+ * Replace the 4MB page covering virt_addr by a page table of 1024 4KB
+ * entries with the same frames and flags. No-op for non-large PDEs. Only the
+ * current page directory changes, so kernel large pages must not be split
+ * once processes exist.
+ * Returns 0 on success, -1 if the page table cannot be allocated.
+ */
+int paging_split_large(uint32_t virt_addr);
+
+/*
+ * Unmap one 4KB virtual page (a covering 4MB page is split first).
  * Returns previous physical frame base, or 0 if not mapped/invalid.
  */
 uint32_t paging_unmap_page(uint32_t virt_addr);
@@ -32,11 +143,19 @@ uint32_t paging_get_phys_addr(uint32_t virt_addr);
 
 /*
  * Query flags for an already-mapped page table entry.
- * Returns 0 on success and stores flags (including PAGE_PRESENT) in flags_out.
+ * Returns 0 on success and stores flags (including PAGE_PRESENT) in flags_out;
+ * PAGE_LARGE is set when the address is covered by a 4MB page.
  * Returns -1 if the page is not mapped/invalid.
  */
 int paging_get_page_flags(uint32_t virt_addr, uint32_t *flags_out);
 
+/*
+ * Raw page-table entry for a 4KB page, present or not (swapped-out pages
+ * keep a non-present entry). Returns 0 when no page table covers it or it
+ * lies in a 4MB page.
+ */
+uint32_t paging_get_entry(uint32_t virt_addr);
+
 /*
  * Upgrade flags for an already-mapped 4KB page (bitwise OR).
  * Returns 0 on success, -1 if the page is not mapped/invalid.
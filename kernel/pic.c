@@ -106,3 +106,25 @@ void pic_clear_mask(uint8_t irq)
     mask &= ~(1 << irq);
     outb(port, mask);
 }
+
+void pic_set_mask(uint8_t irq)
+{
+    uint16_t port;
+    uint8_t mask;
+
+    if (irq >= 16) {
+        return;
+    }
+
+    if (irq < 8) {
+        port = PIC1_DATA;
+    } else {
+        port = PIC2_DATA;
+        irq -= 8;
+    }
+
+    /* Read current mask, set the bit for the requested IRQ, write back */
+    mask = inb(port);
+    mask |= (uint8_t)(1 << irq);
+    outb(port, mask);
+}
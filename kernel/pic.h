@@ -40,4 +40,7 @@ uint8_t pic_is_spurious_irq(uint8_t irq);
 /* Unmask (enable) a specific IRQ line (0-15) */
 void pic_clear_mask(uint8_t irq);
 
+/* Mask (disable) a specific IRQ line (0-15) */
+void pic_set_mask(uint8_t irq);
+
 #endif /* CLAUDE_PIC_H */
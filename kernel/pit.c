@@ -1,14 +1,22 @@
 #include "pit.h"
+#include "clock.h"
 #include "io.h"
 #include "irq.h"
 #include "pic.h"
 #include "serial.h"
+#include "timer.h"
+#include "vdso.h"
 
 /* Global tick counter — volatile because it is modified in interrupt context */
 static volatile uint32_t pit_ticks = 0;
 
+/* Set once another timer took over IRQ0's job; ticks then come from the
+ * clock, offset so the count carries on from where IRQ0 left it */
+static uint8_t pit_irq_stopped;
+static uint32_t pit_tick_offset;
+
 /*
- * IRQ0 handler: increment the system tick counter.
+ * IRQ0 handler: increment the system tick counter and fire due timers.
  * This runs in interrupt context and must be fast.
  * EOI is sent by the IRQ dispatch code in irq_handler(), so we do not
  * send it here.
@@ -17,6 +25,13 @@ static void pit_handler(struct isr_regs *regs)
 {
     (void)regs;  /* Unused */
     pit_ticks++;
+    vdso_update_ticks(pit_ticks);
+    timer_run_expired();
+}
+
+static uint32_t pit_clock_ticks(void)
+{
+    return (uint32_t)clock_div64(clock_monotonic_ns(), 1000000000U / PIT_TARGET_FREQ, 0);
 }
 
 /*
@@ -24,9 +39,22 @@ static void pit_handler(struct isr_regs *regs)
  */
 uint32_t pit_get_ticks(void)
 {
+    if (pit_irq_stopped != 0U) {
+        return pit_clock_ticks() + pit_tick_offset;
+    }
     return pit_ticks;
 }
 
+/*
+ * Mask IRQ0 for good. Ticks keep counting at the same rate from the clock.
+ */
+void pit_stop_irq(void)
+{
+    pic_set_mask(0);
+    pit_tick_offset = pit_ticks - pit_clock_ticks();
+    pit_irq_stopped = 1U;
+}
+
 /*
  * Initialize the Programmable Interval Timer.
  * Programs channel 0 in mode 2 (rate generator) with a divisor of 11931,
@@ -32,4 +32,11 @@ void pit_init(void);
  */
 uint32_t pit_get_ticks(void);
 
+/*
+ * Mask IRQ0 once a one-shot timer (the LAPIC) has taken over timers and
+ * the scheduler tick. pit_get_ticks() then derives ticks from the TSC
+ * clock, so it keeps counting without interrupts. IRQs must be off.
+ */
+void pit_stop_irq(void);
+
 #endif /* CLAUDE_PIT_H */
@@ -1,77 +1,350 @@
 /* ==========================================================================
  * ClaudeOS Physical Memory Manager - Phase 2, Task 10
  * ==========================================================================
- * Bitmap-based physical page frame allocator.
+ * Binary buddy page frame allocator.
  *
- * The bitmap uses 1 bit per 4KB frame: bit=0 means free, bit=1 means used.
- * Bit ordering: bit 0 of byte 0 = frame 0, bit 7 of byte 0 = frame 7, etc.
+ * Free memory is kept as naturally aligned blocks of 2^order frames
+ * (order 0 = 4KB, order PMM_MAX_ORDER = 4MB). Each order has its own free
+ * bitmap with one bit per block of that order: bit=1 means the block is free
+ * and is not part of a larger free block. Allocation takes the smallest free
+ * block that fits and splits it down; freeing re-inserts the block and
+ * coalesces with its buddy (block index ^ 1) for as long as the buddy is free.
+ *
+ * A separate ownership bitmap (1 bit per frame) records which frames were
+ * handed out by the allocator, so double frees and frees of reserved or
+ * foreign frames are rejected.
+ *
+ * Every free bitmap carries two summary levels ("word has a free bit"), so
+ * finding a block is a handful of bsf instructions rather than a scan. Each
+ * order also keeps a rotating next-fit cursor, so repeated allocations do not
+ * restart from the bottom of memory.
  *
  * Initialization:
- *   1. All frames start as used (bitmap filled with 0xFF).
- *   2. The E820 map (stored at virtual 0xC0000500 by stage2) is scanned.
- *   3. Only Type 1 (usable) regions above 1MB are marked free.
- *   4. Everything below 1MB stays "used" — this implicitly protects
+ *   1. The E820 map (stored at virtual 0xC0000500 by stage2) is scanned for
+ *      the top of usable RAM below 4GB.
+ *   2. The bitmaps are sized for that top and placed right after the kernel
+ *      image, inside the boot 4MB mapping. All frames start as reserved
+ *      (no free blocks, no owned frames).
+ *   3. Type 1 (usable) regions above the bitmaps are inserted as the
+ *      largest aligned blocks that fit.
+ *   4. Everything below 1MB stays reserved — this implicitly protects
  *      boot structures, BIOS data area, and VGA memory.
- *   5. Kernel physical pages (0x100000 to _kernel_end) are re-marked
- *      as used to prevent allocating over the running kernel.
+ *   5. Kernel physical pages (0x100000 to _kernel_end) and the bitmaps are
+ *      never inserted, so the running kernel cannot be handed out.
+ *
+ * Zeroed pool: a small stack of pre-cleared frames, refilled from the idle
+ * loop through the physmap, backs pmm_alloc_zeroed_frame() so page tables
+ * and demand-zero pages skip the clear on the allocation path. Pool frames
+ * count as allocated; pmm_alloc_frame() drains the pool before failing.
  * ========================================================================== */
 
 #include "pmm.h"
+#include "paging.h"
 #include "serial.h"
+#include "spinlock.h"
 
 /* Linker-provided symbol: end of kernel image in virtual address space */
 extern uint8_t _kernel_end[];
 
+/* kernel_entry.asm maps physical 0-4MB at 0xC0000000. The bookkeeping
+ * below is carved from that window, right after the kernel image. */
+#define PMM_BOOT_MAP_END    0x400000U
+#define PMM_BOOT_MAP_VIRT   0xC0000000U
+
+/* Frames are tracked in whole 4MB (largest block) units */
+#define PMM_LIMIT_ALIGN     (1U << PMM_MAX_ORDER)
+
+/* Frames tracked: the top of usable RAM from E820, rounded up to 4MB */
+static uint32_t pmm_frame_limit;
+
 /* -------------------------------------------------------------------------
- * Bitmap — 32KB in BSS, one bit per 4KB frame, supports up to 1GB RAM
+ * Per-order free bitmaps — order n holds pmm_frame_limit >> n bits. All
+ * orders together need just under 2 bits per frame (256KB for 4GB).
  * ------------------------------------------------------------------------- */
-static uint8_t pmm_bitmap[PMM_MAX_FRAMES / 8];
-static uint8_t pmm_alloc_bitmap[PMM_MAX_FRAMES / 8];
+static uint32_t *pmm_free_map;
+static uint32_t pmm_order_base[PMM_ORDER_COUNT];   /* first word of each order */
+static uint32_t pmm_order_words[PMM_ORDER_COUNT];  /* words used by each order */
+static uint32_t pmm_order_free[PMM_ORDER_COUNT];   /* free blocks per order */
+static uint32_t pmm_order_cursor[PMM_ORDER_COUNT]; /* next-fit start block */
+
+/*
+ * Summary levels: bit w of an order's L1 map is set iff free-map word w is
+ * non-zero, and bit i of its L2 map is set iff L1 word i is non-zero. For
+ * order 0 on a 4GB map that is 32768 leaf words, 1024 L1 words and 32 L2 words,
+ * so any free block is at most three bsf instructions away.
+ */
+#define PMM_NO_BLOCK        0xFFFFFFFFU
+
+static uint32_t *pmm_summary_map;
+static uint32_t *pmm_summary2_map;
+static uint32_t pmm_summary_base[PMM_ORDER_COUNT];
+static uint32_t pmm_summary_words[PMM_ORDER_COUNT];
+static uint32_t pmm_summary2_base[PMM_ORDER_COUNT];
+static uint32_t pmm_summary2_words[PMM_ORDER_COUNT];
+
+/* Ownership bitmap: bit=1 means the frame was handed out by the allocator. */
+static uint32_t *pmm_alloc_bitmap;
+
+/* Extra owners of a shared frame (copy-on-write). 0 means a single owner;
+ * pmm_free_frame() drops a share before it releases the frame. Pinned
+ * frames are never released. */
+#define PMM_FRAME_PINNED 0xFFU
+static uint8_t *pmm_frame_shares;
 
 /* Counters */
 static uint32_t total_frames;
 static uint32_t free_frames;
+static uint32_t usable_end;     /* end of the highest usable RAM region */
+
+/* Pre-zeroed frames (stack), guarded by pmm_lock */
+#define PMM_ZERO_POOL_SIZE  64U
+#define PMM_ZERO_POOL_BATCH 8U      /* frames cleared per idle refill call */
+static uint32_t pmm_zero_pool[PMM_ZERO_POOL_SIZE];
+static uint32_t pmm_zero_pool_count;
+
+static struct spinlock pmm_lock = SPINLOCK_INITIALIZER;
 
 /* -------------------------------------------------------------------------
- * Bitmap helpers
+ * Free bitmap helpers
  *
- * Frame index -> byte index: idx / 8
- * Frame index -> bit mask:   1 << (idx % 8)
+ * Block index -> word index: pmm_order_base[order] + block / 32
+ * Block index -> bit mask:   1 << (block % 32)
  * ------------------------------------------------------------------------- */
 
-/* Mark a frame as used (set bit to 1) */
-static inline void pmm_set_frame(uint32_t idx)
+static inline uint32_t pmm_bsf(uint32_t value)
+{
+    uint32_t index;
+    __asm__ ("bsf %1, %0" : "=r"(index) : "rm"(value) : "cc");
+    return index;
+}
+
+static inline uint32_t *pmm_order_map(uint32_t order)
 {
-    pmm_bitmap[idx / 8] |= (uint8_t)(1 << (idx % 8));
+    return &pmm_free_map[pmm_order_base[order]];
 }
 
-/* Mark a frame as free (clear bit to 0) */
-static inline void pmm_clear_frame(uint32_t idx)
+static inline int pmm_block_is_free(uint32_t order, uint32_t block)
 {
-    pmm_bitmap[idx / 8] &= (uint8_t)~(1 << (idx % 8));
+    return (pmm_order_map(order)[block / 32U] & (1U << (block % 32U))) != 0U;
 }
 
-/* Test if a frame is used (bit = 1). Returns non-zero if used. */
-static inline int pmm_test_frame(uint32_t idx)
+static inline uint32_t *pmm_order_summary(uint32_t order)
 {
-    return pmm_bitmap[idx / 8] & (1 << (idx % 8));
+    return &pmm_summary_map[pmm_summary_base[order]];
 }
 
-/* Mark frame ownership for allocator bookkeeping:
- * bit=1 means this frame was handed out by pmm_alloc_frame(). */
-static inline void pmm_set_allocated(uint32_t idx)
+static inline uint32_t *pmm_order_summary2(uint32_t order)
 {
-    pmm_alloc_bitmap[idx / 8] |= (uint8_t)(1 << (idx % 8));
+    return &pmm_summary2_map[pmm_summary2_base[order]];
 }
 
-static inline void pmm_clear_allocated(uint32_t idx)
+static inline void pmm_block_set_free(uint32_t order, uint32_t block)
 {
-    pmm_alloc_bitmap[idx / 8] &= (uint8_t)~(1 << (idx % 8));
+    uint32_t word = block / 32U;
+    uint32_t l1 = word / 32U;
+
+    pmm_order_map(order)[word] |= 1U << (block % 32U);
+    pmm_order_summary(order)[l1] |= 1U << (word % 32U);
+    pmm_order_summary2(order)[l1 / 32U] |= 1U << (l1 % 32U);
+    pmm_order_free[order]++;
+}
+
+static inline void pmm_block_clear_free(uint32_t order, uint32_t block)
+{
+    uint32_t word = block / 32U;
+    uint32_t l1 = word / 32U;
+    uint32_t *map = pmm_order_map(order);
+    uint32_t *summary = pmm_order_summary(order);
+
+    map[word] &= ~(1U << (block % 32U));
+    if (map[word] == 0U) {
+        summary[l1] &= ~(1U << (word % 32U));
+        if (summary[l1] == 0U) {
+            pmm_order_summary2(order)[l1 / 32U] &= ~(1U << (l1 % 32U));
+        }
+    }
+    pmm_order_free[order]--;
 }
 
-static inline int pmm_test_allocated(uint32_t idx)
+/* Mask keeping bits >= bit of a word */
+static inline uint32_t pmm_bits_from(uint32_t bit)
 {
-    return pmm_alloc_bitmap[idx / 8] & (1 << (idx % 8));
+    return 0xFFFFFFFFU << bit;
+}
+
+/* Return the first free block of this order at or after 'start', or
+ * PMM_NO_BLOCK. Walks leaf -> L1 -> L2 and back down with bsf. */
+static uint32_t pmm_find_free_from(uint32_t order, uint32_t start)
+{
+    uint32_t *map = pmm_order_map(order);
+    uint32_t *summary = pmm_order_summary(order);
+    uint32_t *summary2 = pmm_order_summary2(order);
+    uint32_t word = start / 32U;
+    uint32_t l1;
+    uint32_t l2;
+    uint32_t bits;
+
+    if (word >= pmm_order_words[order]) {
+        return PMM_NO_BLOCK;
+    }
+
+    /* Rest of the starting leaf word */
+    bits = map[word] & pmm_bits_from(start % 32U);
+    if (bits != 0U) {
+        return word * 32U + pmm_bsf(bits);
+    }
+
+    /* Later leaf words covered by the same L1 word */
+    word++;
+    l1 = word / 32U;
+    if (word % 32U != 0U) {
+        bits = summary[l1] & pmm_bits_from(word % 32U);
+        if (bits != 0U) {
+            word = l1 * 32U + pmm_bsf(bits);
+            return word * 32U + pmm_bsf(map[word]);
+        }
+        l1++;
+    }
+
+    /* Later L1 words, located through L2 */
+    if (l1 >= pmm_summary_words[order]) {
+        return PMM_NO_BLOCK;
+    }
+
+    l2 = l1 / 32U;
+    bits = summary2[l2] & pmm_bits_from(l1 % 32U);
+    while (bits == 0U) {
+        l2++;
+        if (l2 >= pmm_summary2_words[order]) {
+            return PMM_NO_BLOCK;
+        }
+        bits = summary2[l2];
+    }
+
+    l1 = l2 * 32U + pmm_bsf(bits);
+    word = l1 * 32U + pmm_bsf(summary[l1]);
+    return word * 32U + pmm_bsf(map[word]);
+}
+
+/* Return a free block of this order, next-fit from the order's cursor.
+ * Caller checks pmm_order_free. */
+static uint32_t pmm_find_free_block(uint32_t order)
+{
+    uint32_t block = pmm_find_free_from(order, pmm_order_cursor[order]);
+
+    if (block == PMM_NO_BLOCK) {
+        block = pmm_find_free_from(order, 0U);
+    }
+
+    pmm_order_cursor[order] = block + 1U;
+    return block;
+}
+
+/* -------------------------------------------------------------------------
+ * Ownership bitmap helpers (operate on runs of up to 2^PMM_MAX_ORDER frames)
+ * ------------------------------------------------------------------------- */
+
+static inline uint32_t pmm_run_mask(uint32_t first_bit, uint32_t count)
+{
+    return (count >= 32U) ? 0xFFFFFFFFU : (((1U << count) - 1U) << first_bit);
+}
+
+static void pmm_set_allocated(uint32_t frame, uint32_t count)
+{
+    while (count > 0U) {
+        uint32_t bit = frame % 32U;
+        uint32_t chunk = 32U - bit;
+
+        if (chunk > count) {
+            chunk = count;
+        }
+
+        pmm_alloc_bitmap[frame / 32U] |= pmm_run_mask(bit, chunk);
+        frame += chunk;
+        count -= chunk;
+    }
+}
+
+static void pmm_clear_allocated(uint32_t frame, uint32_t count)
+{
+    while (count > 0U) {
+        uint32_t bit = frame % 32U;
+        uint32_t chunk = 32U - bit;
+
+        if (chunk > count) {
+            chunk = count;
+        }
+
+        pmm_alloc_bitmap[frame / 32U] &= ~pmm_run_mask(bit, chunk);
+        frame += chunk;
+        count -= chunk;
+    }
+}
+
+/* Return non-zero only if every frame in the run is currently owned. */
+static int pmm_test_allocated(uint32_t frame, uint32_t count)
+{
+    while (count > 0U) {
+        uint32_t bit = frame % 32U;
+        uint32_t chunk = 32U - bit;
+        uint32_t mask;
+
+        if (chunk > count) {
+            chunk = count;
+        }
+
+        mask = pmm_run_mask(bit, chunk);
+        if ((pmm_alloc_bitmap[frame / 32U] & mask) != mask) {
+            return 0;
+        }
+
+        frame += chunk;
+        count -= chunk;
+    }
+
+    return 1;
+}
+
+/* -------------------------------------------------------------------------
+ * Buddy core
+ * ------------------------------------------------------------------------- */
+
+/* Insert a free block and merge it with free buddies as far as possible. */
+static void pmm_insert_block(uint32_t frame, uint32_t order)
+{
+    uint32_t block = frame >> order;
+
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = block ^ 1U;
+
+        if (!pmm_block_is_free(order, buddy)) {
+            break;
+        }
+
+        pmm_block_clear_free(order, buddy);
+        block >>= 1;
+        order++;
+    }
+
+    pmm_block_set_free(order, block);
+}
+
+/* Insert [first_frame, last_frame) as the largest aligned blocks that fit. */
+static void pmm_release_range(uint32_t first_frame, uint32_t last_frame)
+{
+    while (first_frame < last_frame) {
+        uint32_t order = PMM_MAX_ORDER;
+
+        while (order > 0U &&
+               ((first_frame & ((1U << order) - 1U)) != 0U ||
+                first_frame + (1U << order) > last_frame)) {
+            order--;
+        }
+
+        pmm_insert_block(first_frame, order);
+        first_frame += 1U << order;
+        free_frames += 1U << order;
+    }
 }
 
 /* -------------------------------------------------------------------------
@@ -114,25 +387,110 @@ static void serial_put_dec(uint32_t val)
     }
 }
 
+/* -------------------------------------------------------------------------
+ * pmm_e820_region: Clamp one E820 entry to a 32-bit range
+ *
+ * Stores the usable RAM of the entry as [*base_out, *end_out) and returns
+ * 0, or returns -1 for reserved or empty entries. RAM beyond PMM_MAX_ADDR
+ * is added to *ignored_high when that pointer is non-null: 32-bit page
+ * tables cannot map it.
+ * ------------------------------------------------------------------------- */
+static int pmm_e820_region(volatile const struct e820_entry *entry,
+                           uint32_t *base_out, uint32_t *end_out,
+                           uint64_t *ignored_high)
+{
+    uint64_t base64 = ((uint64_t)entry->base_high << 32) | entry->base_low;
+    uint64_t len64  = ((uint64_t)entry->length_high << 32) | entry->length_low;
+    uint64_t end64  = base64 + len64;
+
+    if (entry->type != E820_TYPE_USABLE) {
+        return -1;
+    }
+
+    if (end64 > PMM_MAX_ADDR) {
+        if (ignored_high != 0) {
+            *ignored_high += end64 - ((base64 > PMM_MAX_ADDR) ? base64 : PMM_MAX_ADDR);
+        }
+        end64 = PMM_MAX_ADDR;
+    }
+
+    if (base64 >= end64) {
+        return -1;
+    }
+
+    *base_out = (uint32_t)base64;
+    *end_out = (uint32_t)end64;
+    return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_layout: Size (and optionally place) the bookkeeping for 'frames'
+ *
+ * Computes the per-order bitmap and summary offsets for 'frames' tracked
+ * frames and returns the bytes needed for all maps. With a non-null 'base'
+ * the maps are pointed into the memory there.
+ * ------------------------------------------------------------------------- */
+static uint32_t pmm_layout(uint32_t frames, uint8_t *base)
+{
+    uint32_t offset = 0U;
+    uint32_t summary_offset = 0U;
+    uint32_t summary2_offset = 0U;
+    uint32_t alloc_words = (frames + 31U) / 32U;
+
+    for (uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+        pmm_order_base[order] = offset;
+        pmm_order_words[order] = ((frames >> order) + 31U) / 32U;
+        offset += pmm_order_words[order];
+
+        pmm_summary_base[order] = summary_offset;
+        pmm_summary_words[order] = (pmm_order_words[order] + 31U) / 32U;
+        summary_offset += pmm_summary_words[order];
+
+        pmm_summary2_base[order] = summary2_offset;
+        pmm_summary2_words[order] = (pmm_summary_words[order] + 31U) / 32U;
+        summary2_offset += pmm_summary2_words[order];
+    }
+
+    if (base != 0) {
+        pmm_free_map = (uint32_t *)base;
+        pmm_summary_map = pmm_free_map + offset;
+        pmm_summary2_map = pmm_summary_map + summary_offset;
+        pmm_alloc_bitmap = pmm_summary2_map + summary2_offset;
+        pmm_frame_shares = (uint8_t *)(pmm_alloc_bitmap + alloc_words);
+    }
+
+    return (offset + summary_offset + summary2_offset + alloc_words) * 4U + frames;
+}
+
 /* -------------------------------------------------------------------------
  * pmm_init: Initialize the physical memory manager
  *
  * Reads the E820 memory map from virtual address 0xC0000500 (physical
- * 0x0500), marks usable frames above 1MB as free in the bitmap, then
- * re-marks kernel physical pages as used, and prints a summary via serial.
+ * 0x0500), sizes the bitmaps for the highest usable frame and places them
+ * right after the kernel image, inserts usable frames above them into the
+ * buddy free lists, and prints a summary via serial.
  * ------------------------------------------------------------------------- */
 void pmm_init(void)
 {
-    /* Step 1: Mark all frames as used */
-    for (uint32_t i = 0; i < sizeof(pmm_bitmap); i++) {
-        pmm_bitmap[i] = 0xFF;
-        pmm_alloc_bitmap[i] = 0x00;
-    }
+    uint64_t ignored_high = 0U;
+    uint32_t usable_top = 0U;
+    uint32_t region_base;
+    uint32_t region_end;
+    uint32_t meta_bytes;
+    uint32_t *meta;
 
-    total_frames = PMM_MAX_FRAMES;
-    free_frames = 0;
+    spinlock_init(&pmm_lock);
+
+    /* The kernel occupies 0x100000 up to _kernel_end; _kernel_end is a
+     * virtual address, so subtract KERNEL_VIRT_BASE to get the physical end
+     * address. Usable memory below it is never inserted. */
+    uint32_t kernel_phys_end = (uint32_t)_kernel_end - 0xC0000000;
+    /* Align up to page boundary */
+    kernel_phys_end = (kernel_phys_end + PMM_PAGE_SIZE - 1)
+                      & ~(PMM_PAGE_SIZE - 1);
+    uint32_t meta_phys_end;
 
-    /* Step 2: Read E820 map from virtual memory (mapped via higher-half) */
+    /* Step 1: Read E820 map from virtual memory (mapped via higher-half) */
     volatile uint32_t *count_ptr = (volatile uint32_t *)E820_MAP_ADDR;
     uint32_t entry_count = *count_ptr;
 
@@ -145,58 +503,85 @@ void pmm_init(void)
         entry_count = E820_MAX_ENTRIES;
     }
 
-    /* Step 3: Process each E820 entry */
     volatile struct e820_entry *entries =
         (volatile struct e820_entry *)(E820_MAP_ADDR + 4);
 
+    /* Step 2: Find the top of usable RAM */
     for (uint32_t i = 0; i < entry_count; i++) {
-        uint32_t base_low  = entries[i].base_low;
-        uint32_t base_high = entries[i].base_high;
-        uint32_t len_low   = entries[i].length_low;
-        uint32_t len_high  = entries[i].length_high;
-        uint32_t type      = entries[i].type;
-
         /* Debug: print each entry */
         serial_puts("  E820 [");
         serial_put_dec(i);
         serial_puts("] base=");
-        serial_put_hex32(base_low);
+        if (entries[i].base_high != 0U) {
+            serial_put_hex32(entries[i].base_high);
+            serial_puts(":");
+        }
+        serial_put_hex32(entries[i].base_low);
         serial_puts(" len=");
-        serial_put_hex32(len_low);
+        serial_put_hex32(entries[i].length_low);
         serial_puts(" type=");
-        serial_put_dec(type);
+        serial_put_dec(entries[i].type);
         serial_puts("\n");
 
-        /* Only process Type 1 (usable RAM) entries */
-        if (type != E820_TYPE_USABLE) {
-            continue;
+        if (pmm_e820_region(&entries[i], &region_base, &region_end, &ignored_high) == 0 &&
+            region_end > usable_top) {
+            usable_top = region_end;
         }
+    }
 
-        /* Skip entries above 4GB (base_high != 0) — we're 32-bit */
-        if (base_high != 0) {
-            continue;
-        }
+    if (ignored_high != 0U) {
+        serial_puts("PMM: ignoring ");
+        serial_put_dec((uint32_t)(ignored_high >> 20));
+        serial_puts(" MB of RAM above 4GB\n");
+    }
 
-        /* Compute region end address, clamping to 32-bit range */
-        uint64_t base64 = base_low;
-        uint64_t len64  = ((uint64_t)len_high << 32) | len_low;
-        uint64_t end64  = base64 + len64;
+    /* Step 3: Size the bitmaps for that top and place them after the
+     * kernel image. If they would not fit the boot mapping, track less. */
+    pmm_frame_limit = ((usable_top / PMM_PAGE_SIZE) + PMM_LIMIT_ALIGN - 1U) &
+                      ~(PMM_LIMIT_ALIGN - 1U);
+    while (pmm_frame_limit != 0U &&
+           pmm_layout(pmm_frame_limit, 0) > PMM_BOOT_MAP_END - kernel_phys_end) {
+        pmm_frame_limit -= PMM_LIMIT_ALIGN;
+    }
+    if (pmm_frame_limit < (usable_top + PMM_PAGE_SIZE - 1U) / PMM_PAGE_SIZE) {
+        serial_puts("PMM: bitmaps do not fit below 4MB, tracking only ");
+        serial_put_dec(pmm_frame_limit >> 8);
+        serial_puts(" MB\n");
+    }
 
-        if (end64 > PMM_MAX_ADDR) {
-            end64 = PMM_MAX_ADDR;
-        }
+    meta_bytes = pmm_layout(pmm_frame_limit, (uint8_t *)(PMM_BOOT_MAP_VIRT + kernel_phys_end));
+    meta = pmm_free_map;
+    for (uint32_t i = 0; i < meta_bytes / 4U; i++) {
+        meta[i] = 0U;
+    }
+    meta_phys_end = (kernel_phys_end + meta_bytes + PMM_PAGE_SIZE - 1U) &
+                    ~(PMM_PAGE_SIZE - 1U);
+
+    /* No frame is free or owned yet */
+    for (uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+        pmm_order_free[order] = 0U;
+        pmm_order_cursor[order] = 0U;
+    }
+
+    total_frames = pmm_frame_limit;
+    free_frames = 0;
+    usable_end = 0U;
+    pmm_zero_pool_count = 0U;
 
-        uint32_t region_base = base_low;
-        uint32_t region_end  = (uint32_t)end64;
+    /* Step 4: Insert usable frames above the kernel image and bitmaps */
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (pmm_e820_region(&entries[i], &region_base, &region_end, 0) != 0) {
+            continue;
+        }
 
-        /* Skip regions entirely below 1MB */
-        if (region_end <= 0x100000) {
+        /* Skip regions entirely below the end of the kernel image */
+        if (region_end <= meta_phys_end) {
             continue;
         }
 
-        /* Adjust base up to 1MB if region straddles the 1MB boundary */
-        if (region_base < 0x100000) {
-            region_base = 0x100000;
+        /* Adjust base up past the kernel if the region straddles it */
+        if (region_base < meta_phys_end) {
+            region_base = meta_phys_end;
         }
 
         /* Align base up to page boundary */
@@ -210,131 +595,419 @@ void pmm_init(void)
             continue;
         }
 
-        /* Mark frames in this region as free */
+        /* Insert frames in this region as free buddy blocks */
         uint32_t first_frame = region_base / PMM_PAGE_SIZE;
         uint32_t last_frame  = region_end / PMM_PAGE_SIZE;
 
-        for (uint32_t frame = first_frame; frame < last_frame; frame++) {
-            if (frame < PMM_MAX_FRAMES) {
-                pmm_clear_frame(frame);
-                free_frames++;
-            }
+        if (last_frame > pmm_frame_limit) {
+            last_frame = pmm_frame_limit;
+        }
+        if (first_frame >= last_frame) {
+            continue;
+        }
+
+        pmm_release_range(first_frame, last_frame);
+        if (last_frame * PMM_PAGE_SIZE > usable_end) {
+            usable_end = last_frame * PMM_PAGE_SIZE;
         }
 
         serial_puts("  -> marked free: ");
         serial_put_hex32(region_base);
         serial_puts(" - ");
-        serial_put_hex32(region_end);
+        serial_put_hex32(last_frame * PMM_PAGE_SIZE);
         serial_puts(" (");
         serial_put_dec(last_frame - first_frame);
         serial_puts(" frames)\n");
     }
 
-    /* Step 4: Reserve kernel physical pages (0x100000 to _kernel_end)
-     * _kernel_end is a virtual address; subtract KERNEL_VIRT_BASE to get
-     * the physical end address. */
-    uint32_t kernel_phys_end = (uint32_t)_kernel_end - 0xC0000000;
-    /* Align up to page boundary */
-    kernel_phys_end = (kernel_phys_end + PMM_PAGE_SIZE - 1)
-                      & ~(PMM_PAGE_SIZE - 1);
-
-    uint32_t kernel_first_frame = 0x100000 / PMM_PAGE_SIZE;
-    uint32_t kernel_last_frame  = kernel_phys_end / PMM_PAGE_SIZE;
-
-    for (uint32_t frame = kernel_first_frame; frame < kernel_last_frame; frame++) {
-        if (frame < PMM_MAX_FRAMES && !pmm_test_frame(frame)) {
-            pmm_set_frame(frame);
-            free_frames--;
-        }
-    }
-
     serial_puts("PMM: kernel reserved: ");
     serial_put_hex32(0x100000);
     serial_puts(" - ");
     serial_put_hex32(kernel_phys_end);
     serial_puts(" (");
-    serial_put_dec(kernel_last_frame - kernel_first_frame);
+    serial_put_dec((kernel_phys_end - 0x100000) / PMM_PAGE_SIZE);
     serial_puts(" frames)\n");
 
+    serial_puts("PMM: bitmaps for ");
+    serial_put_dec(pmm_frame_limit);
+    serial_puts(" frames: ");
+    serial_put_hex32(kernel_phys_end);
+    serial_puts(" - ");
+    serial_put_hex32(meta_phys_end);
+    serial_puts("\n");
+
     /* Print summary */
     serial_puts("PMM: ");
     serial_put_dec(free_frames);
     serial_puts(" free frames (");
     serial_put_dec(free_frames * 4);
     serial_puts(" KB)\n");
+
+    pmm_dump_stats();
 }
 
 /* -------------------------------------------------------------------------
- * pmm_alloc_frame: Allocate a single 4KB page frame
+ * pmm_alloc_frames: Allocate 2^order contiguous frames
  *
- * Performs a linear scan of the bitmap for the first free frame (bit=0),
- * marks it as used, and returns its physical address.
+ * Takes a free block of the smallest order >= the request, searching
+ * next-fit from that order's cursor and wrapping to the bottom of memory,
+ * splits it down to the requested order (returning the upper halves to their
+ * free lists), and records ownership of every frame in the block.
  *
- * Returns 0 on failure (no free frames).
+ * Returns 0 on failure (no block large enough).
  * ------------------------------------------------------------------------- */
-uint32_t pmm_alloc_frame(void)
+uint32_t pmm_alloc_frames(uint32_t order)
 {
-    if (free_frames == 0) {
+    uint32_t flags;
+    uint32_t found;
+    uint32_t block;
+    uint32_t frame;
+
+    if (order > PMM_MAX_ORDER) {
         return 0;
     }
 
-    /* Scan bitmap bytes — skip fully-used bytes (0xFF) for speed */
-    uint32_t bitmap_bytes = PMM_MAX_FRAMES / 8;
-    for (uint32_t byte_idx = 0; byte_idx < bitmap_bytes; byte_idx++) {
-        if (pmm_bitmap[byte_idx] == 0xFF) {
-            continue; /* All 8 frames in this byte are used */
-        }
+    flags = spinlock_lock_irqsave(&pmm_lock);
 
-        /* At least one free bit in this byte — find it */
-        for (uint32_t bit = 0; bit < 8; bit++) {
-            uint32_t frame_idx = byte_idx * 8 + bit;
-            if (frame_idx >= PMM_MAX_FRAMES) {
-                return 0;
-            }
-            if (!pmm_test_frame(frame_idx)) {
-                pmm_set_frame(frame_idx);
-                pmm_set_allocated(frame_idx);
-                free_frames--;
-                return frame_idx * PMM_PAGE_SIZE;
-            }
-        }
+    found = order;
+    while (found <= PMM_MAX_ORDER && pmm_order_free[found] == 0U) {
+        found++;
     }
 
-    return 0;
+    if (found > PMM_MAX_ORDER) {
+        spinlock_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+
+    block = pmm_find_free_block(found);
+    pmm_block_clear_free(found, block);
+
+    /* Split: keep the lower half, free the upper half at each level */
+    while (found > order) {
+        found--;
+        block <<= 1;
+        pmm_block_set_free(found, block | 1U);
+    }
+
+    frame = block << order;
+    pmm_set_allocated(frame, 1U << order);
+    free_frames -= 1U << order;
+
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+    return frame * PMM_PAGE_SIZE;
 }
 
-/* -------------------------------------------------------------------------
- * pmm_free_frame: Free a previously allocated 4KB page frame
- *
- * Validates the address (must be page-aligned and within range) before
- * marking the frame as free.
- * ------------------------------------------------------------------------- */
-void pmm_free_frame(uint32_t phys_addr)
+/* Validate and release one block; caller holds pmm_lock */
+static void pmm_free_block_locked(uint32_t phys_addr, uint32_t order)
 {
+    uint32_t frame;
+    uint32_t count;
+
+    if (order > PMM_MAX_ORDER) {
+        return;
+    }
+
     /* Never free anything below 1MB (BIOS, VGA, boot code, kernel) */
     if (phys_addr < 0x100000) {
         return;
     }
 
-    /* Validate alignment */
-    if (phys_addr & (PMM_PAGE_SIZE - 1)) {
+    /* Validate alignment to the block size */
+    if (phys_addr & (((uint32_t)PMM_PAGE_SIZE << order) - 1U)) {
         return;
     }
 
+    frame = phys_addr / PMM_PAGE_SIZE;
+    count = 1U << order;
+
     /* Validate range */
-    if (phys_addr >= PMM_MAX_ADDR) {
+    if (frame >= pmm_frame_limit || pmm_frame_limit - frame < count) {
         return;
     }
 
-    uint32_t frame_idx = phys_addr / PMM_PAGE_SIZE;
-
-    /* Only free frames that were actually handed out by pmm_alloc_frame().
+    /* Only free frames that were actually handed out by the allocator.
      * This prevents accidental frees of permanently reserved or foreign frames. */
-    if (pmm_test_frame(frame_idx) && pmm_test_allocated(frame_idx)) {
-        pmm_clear_allocated(frame_idx);
-        pmm_clear_frame(frame_idx);
-        free_frames++;
+    if (!pmm_test_allocated(frame, count)) {
+        return;
     }
+
+    if (order == 0U && pmm_frame_shares[frame] != 0U) {
+        if (pmm_frame_shares[frame] != PMM_FRAME_PINNED) {
+            pmm_frame_shares[frame]--;
+        }
+        return;
+    }
+
+    pmm_clear_allocated(frame, count);
+    pmm_insert_block(frame, order);
+    free_frames += count;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_free_frames: Free a block of 2^order frames
+ *
+ * Validates the address (must be block-aligned, within range and above 1MB)
+ * and that every frame in the block is currently owned before returning it
+ * to the buddy free lists.
+ * ------------------------------------------------------------------------- */
+void pmm_free_frames(uint32_t phys_addr, uint32_t order)
+{
+    uint32_t flags = spinlock_lock_irqsave(&pmm_lock);
+
+    pmm_free_block_locked(phys_addr, order);
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_free_frame_batch: Free many single frames under one lock hold
+ * ------------------------------------------------------------------------- */
+void pmm_free_frame_batch(const uint32_t *frames, uint32_t count)
+{
+    uint32_t flags;
+
+    if (frames == 0 || count == 0U) {
+        return;
+    }
+
+    flags = spinlock_lock_irqsave(&pmm_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        pmm_free_block_locked(frames[i], 0U);
+    }
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_ref_frame: Add an owner to an allocated frame
+ *
+ * Used when a frame is mapped into a second address space (copy-on-write).
+ * Fails for frames the allocator does not own and when the share counter
+ * would overflow. Pinned frames accept any number of owners, and so do
+ * kernel image frames (initrd pages mapped into user space by mmap), which
+ * are never freed.
+ * ------------------------------------------------------------------------- */
+int pmm_ref_frame(uint32_t phys_addr)
+{
+    uint32_t flags;
+    uint32_t frame;
+    int rc = -1;
+
+    if (phys_addr < 0x100000 || phys_addr / PMM_PAGE_SIZE >= pmm_frame_limit ||
+        (phys_addr & (PMM_PAGE_SIZE - 1)) != 0U) {
+        return -1;
+    }
+
+    if (phys_addr < (uint32_t)_kernel_end - 0xC0000000U) {
+        return 0;
+    }
+
+    frame = phys_addr / PMM_PAGE_SIZE;
+
+    flags = spinlock_lock_irqsave(&pmm_lock);
+    if (pmm_test_allocated(frame, 1U)) {
+        if (pmm_frame_shares[frame] == PMM_FRAME_PINNED) {
+            rc = 0;
+        } else if (pmm_frame_shares[frame] + 1U < PMM_FRAME_PINNED) {
+            pmm_frame_shares[frame]++;
+            rc = 0;
+        }
+    }
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_pin_frame: Make an allocated frame permanent
+ *
+ * For frames mapped into arbitrarily many address spaces (the shared zero
+ * page). pmm_free_frame() on a pinned frame is a no-op.
+ * ------------------------------------------------------------------------- */
+int pmm_pin_frame(uint32_t phys_addr)
+{
+    uint32_t flags;
+    uint32_t frame;
+    int rc = -1;
+
+    if (phys_addr < 0x100000 || phys_addr / PMM_PAGE_SIZE >= pmm_frame_limit ||
+        (phys_addr & (PMM_PAGE_SIZE - 1)) != 0U) {
+        return -1;
+    }
+
+    frame = phys_addr / PMM_PAGE_SIZE;
+
+    flags = spinlock_lock_irqsave(&pmm_lock);
+    if (pmm_test_allocated(frame, 1U)) {
+        pmm_frame_shares[frame] = PMM_FRAME_PINNED;
+        rc = 0;
+    }
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_frame_is_shared: Return 1 if more than one owner holds the frame
+ * ------------------------------------------------------------------------- */
+int pmm_frame_is_shared(uint32_t phys_addr)
+{
+    uint32_t frame;
+
+    if (phys_addr / PMM_PAGE_SIZE >= pmm_frame_limit) {
+        return 0;
+    }
+
+    frame = phys_addr / PMM_PAGE_SIZE;
+    return pmm_frame_shares[frame] != 0U;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_frame_is_private: Return 1 if the frame has one owner and can be freed
+ * ------------------------------------------------------------------------- */
+int pmm_frame_is_private(uint32_t phys_addr)
+{
+    uint32_t flags;
+    uint32_t frame;
+    int rc;
+
+    if (phys_addr < (uint32_t)_kernel_end - 0xC0000000U ||
+        phys_addr / PMM_PAGE_SIZE >= pmm_frame_limit ||
+        (phys_addr & (PMM_PAGE_SIZE - 1)) != 0U) {
+        return 0;
+    }
+
+    frame = phys_addr / PMM_PAGE_SIZE;
+
+    flags = spinlock_lock_irqsave(&pmm_lock);
+    rc = (pmm_test_allocated(frame, 1U) && pmm_frame_shares[frame] == 0U) ? 1 : 0;
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_alloc_frame: Allocate a single 4KB page frame
+ * ------------------------------------------------------------------------- */
+uint32_t pmm_alloc_frame(void)
+{
+    uint32_t phys = pmm_alloc_frames(0U);
+
+    if (phys == 0U) {
+        /* Out of buddy memory: fall back to the zeroed pool */
+        uint32_t flags = spinlock_lock_irqsave(&pmm_lock);
+
+        if (pmm_zero_pool_count != 0U) {
+            phys = pmm_zero_pool[--pmm_zero_pool_count];
+        }
+        spinlock_unlock_irqrestore(&pmm_lock, flags);
+    }
+
+    return phys;
+}
+
+static void pmm_clear_frame(void *ptr)
+{
+    uint32_t count = PMM_PAGE_SIZE / 4U;
+
+    __asm__ volatile ("cld; rep stosl"
+                      : "+D"(ptr), "+c"(count)
+                      : "a"(0U)
+                      : "memory");
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_alloc_zeroed_frame: Allocate a 4KB frame that is already all zero
+ *
+ * Takes a frame from the idle-filled pool, or clears a fresh frame through
+ * the physmap. Returns 0 when no frame can be produced that way (out of
+ * memory, or the frame lies above the physmap); callers then fall back to
+ * pmm_alloc_frame() and clear the page through its mapping.
+ * ------------------------------------------------------------------------- */
+uint32_t pmm_alloc_zeroed_frame(void)
+{
+    uint32_t flags;
+    uint32_t phys = 0U;
+    void *ptr;
+
+    flags = spinlock_lock_irqsave(&pmm_lock);
+    if (pmm_zero_pool_count != 0U) {
+        phys = pmm_zero_pool[--pmm_zero_pool_count];
+    }
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+
+    if (phys != 0U) {
+        return phys;
+    }
+
+    phys = pmm_alloc_frames(0U);
+    if (phys == 0U) {
+        return 0U;
+    }
+
+    ptr = phys_to_virt(phys);
+    if (ptr == 0) {
+        pmm_free_frame(phys);
+        return 0U;
+    }
+
+    pmm_clear_frame(ptr);
+    return phys;
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_zero_pool_refill: Clear a few free frames into the zeroed pool
+ *
+ * Called from the idle loop. Frames are cleared with the lock dropped, so
+ * interrupts stay enabled during the stores.
+ * ------------------------------------------------------------------------- */
+void pmm_zero_pool_refill(void)
+{
+    for (uint32_t i = 0; i < PMM_ZERO_POOL_BATCH; i++) {
+        uint32_t flags;
+        uint32_t phys;
+        void *ptr;
+
+        if (pmm_zero_pool_count >= PMM_ZERO_POOL_SIZE) {
+            return;
+        }
+
+        /* Keep the pool from eating the last free frames */
+        if (free_frames <= PMM_ZERO_POOL_SIZE) {
+            return;
+        }
+
+        phys = pmm_alloc_frames(0U);
+        if (phys == 0U) {
+            return;
+        }
+
+        ptr = phys_to_virt(phys);
+        if (ptr == 0) {
+            pmm_free_frame(phys);
+            return;
+        }
+
+        pmm_clear_frame(ptr);
+
+        flags = spinlock_lock_irqsave(&pmm_lock);
+        if (pmm_zero_pool_count < PMM_ZERO_POOL_SIZE) {
+            pmm_zero_pool[pmm_zero_pool_count++] = phys;
+            phys = 0U;
+        }
+        spinlock_unlock_irqrestore(&pmm_lock, flags);
+
+        if (phys != 0U) {
+            pmm_free_frame(phys);
+            return;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * pmm_free_frame: Free a previously allocated 4KB page frame
+ * ------------------------------------------------------------------------- */
+void pmm_free_frame(uint32_t phys_addr)
+{
+    pmm_free_frames(phys_addr, 0U);
 }
 
 /* -------------------------------------------------------------------------
@@ -345,6 +1018,14 @@ uint32_t pmm_get_free_frame_count(void)
     return free_frames;
 }
 
+/* -------------------------------------------------------------------------
+ * pmm_get_usable_end: Return the end address of the highest usable region
+ * ------------------------------------------------------------------------- */
+uint32_t pmm_get_usable_end(void)
+{
+    return usable_end;
+}
+
 /* -------------------------------------------------------------------------
  * pmm_get_total_frame_count: Return the total number of tracked frames
  * ------------------------------------------------------------------------- */
@@ -352,3 +1033,53 @@ uint32_t pmm_get_total_frame_count(void)
 {
     return total_frames;
 }
+
+/* -------------------------------------------------------------------------
+ * pmm_dump_stats: Print buddy free lists and fragmentation to serial
+ *
+ * For each order, "unusable" is the percentage of free memory held in
+ * blocks too small to satisfy an allocation of that order (0% = a request
+ * of that size can use any free frame, 100% = none can be satisfied).
+ * ------------------------------------------------------------------------- */
+void pmm_dump_stats(void)
+{
+    uint32_t counts[PMM_ORDER_COUNT];
+    uint32_t free_snapshot;
+    uint32_t zeroed_snapshot;
+    uint32_t below = 0U;
+    uint32_t flags;
+
+    flags = spinlock_lock_irqsave(&pmm_lock);
+    for (uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+        counts[order] = pmm_order_free[order];
+    }
+    free_snapshot = free_frames;
+    zeroed_snapshot = pmm_zero_pool_count;
+    spinlock_unlock_irqrestore(&pmm_lock, flags);
+
+    serial_puts("PMM: buddy free blocks (");
+    serial_put_dec(free_snapshot);
+    serial_puts(" free frames, ");
+    serial_put_dec(zeroed_snapshot);
+    serial_puts(" pre-zeroed)\n");
+
+    for (uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+        uint32_t unusable = 0U;
+
+        if (free_snapshot != 0U) {
+            unusable = (below * 100U) / free_snapshot;
+        }
+
+        serial_puts("  order ");
+        serial_put_dec(order);
+        serial_puts(" (");
+        serial_put_dec(4U << order);
+        serial_puts(" KB): ");
+        serial_put_dec(counts[order]);
+        serial_puts(" free, unusable ");
+        serial_put_dec(unusable);
+        serial_puts("%\n");
+
+        below += counts[order] << order;
+    }
+}
@@ -4,7 +4,7 @@
 /* ==========================================================================
  * ClaudeOS Physical Memory Manager - Phase 2, Task 10
  * ==========================================================================
- * Bitmap-based physical page frame allocator.
+ * Binary buddy physical page frame allocator.
  * Reads the E820 memory map left by the stage2 bootloader at physical 0x0500
  * (virtual 0xC0000500 after paging) to determine which physical frames are
  * usable.
@@ -17,8 +17,16 @@
 #include <stdint.h>
 
 #define PMM_PAGE_SIZE       4096
-#define PMM_MAX_ADDR        0x40000000  /* Support up to 1GB */
-#define PMM_MAX_FRAMES      (PMM_MAX_ADDR / PMM_PAGE_SIZE)
+/* Highest address the PMM can track. The bitmaps are sized at boot for
+ * the top of usable RAM below it; RAM above 4GB would need PAE page tables
+ * and is ignored. The top frame (BIOS ROM alias) is never usable, which
+ * keeps PMM_MAX_ADDR a uint32_t. */
+#define PMM_MAX_ADDR        0xFFFFF000U
+
+/* Buddy orders: an order-n block is 2^n contiguous, naturally aligned frames.
+ * The largest block (order 10) is 4MB. */
+#define PMM_MAX_ORDER       10U
+#define PMM_ORDER_COUNT     (PMM_MAX_ORDER + 1U)
 
 /* E820 memory map location (set by stage2 bootloader at phys 0x0500,
  * accessible at virtual 0xC0000500 via higher-half mapping) */
@@ -49,13 +57,56 @@ void pmm_init(void);
 /* Allocate a single 4KB page frame. Returns physical address, or 0 on failure */
 uint32_t pmm_alloc_frame(void);
 
+/* Allocate a 4KB frame whose contents are already zero (pre-zeroed pool or
+ * cleared through the physmap). Returns 0 if none is available; callers
+ * fall back to pmm_alloc_frame() and clear it themselves. */
+uint32_t pmm_alloc_zeroed_frame(void);
+
+/* Top up the pre-zeroed pool by a few frames. Called when the CPU is idle. */
+void pmm_zero_pool_refill(void);
+
 /* Free a previously allocated 4KB page frame */
 void pmm_free_frame(uint32_t phys_addr);
 
+/* Allocate 2^order physically contiguous frames aligned to the block size.
+ * Returns the physical base address, or 0 on failure. */
+uint32_t pmm_alloc_frames(uint32_t order);
+
+/* Free a block previously returned by pmm_alloc_frames() with the same order.
+ * Frames of a block may also be released one at a time via pmm_free_frame(). */
+void pmm_free_frames(uint32_t phys_addr, uint32_t order);
+
+/* Free 'count' single frames taking the PMM lock once (unmap batches). */
+void pmm_free_frame_batch(const uint32_t *frames, uint32_t count);
+
+/* Add an owner to an allocated 4KB frame (copy-on-write sharing).
+ * pmm_free_frame() then drops one owner at a time. Kernel image frames
+ * always succeed (they are never freed). Returns 0 or -1. */
+int pmm_ref_frame(uint32_t phys_addr);
+
+/* Pin an allocated frame: it accepts unlimited owners and is never freed.
+ * Returns 0 or -1. */
+int pmm_pin_frame(uint32_t phys_addr);
+
+/* Return 1 if the frame currently has more than one owner, else 0 */
+int pmm_frame_is_shared(uint32_t phys_addr);
+
+/* Return 1 for an allocated frame with exactly one owner that may be freed
+ * (not pinned, not part of the kernel image), else 0. Swap eviction only
+ * takes such frames. */
+int pmm_frame_is_private(uint32_t phys_addr);
+
 /* Get the count of free page frames */
 uint32_t pmm_get_free_frame_count(void);
 
+/* Get the end (exclusive) of the highest usable RAM region handed to the
+ * allocator; every frame the PMM returns lies below it */
+uint32_t pmm_get_usable_end(void);
+
 /* Get the total number of frames tracked */
 uint32_t pmm_get_total_frame_count(void);
 
+/* Dump per-order free block counts and fragmentation to serial output */
+void pmm_dump_stats(void);
+
 #endif /* CLAUDE_PMM_H */
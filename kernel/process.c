@@ -3,14 +3,17 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include "elf.h"
-#include "heap.h"
+#include "kstack.h"
 #include "paging.h"
 #include "pmm.h"
 #include "serial.h"
+#include "slab.h"
 #include "spinlock.h"
+#include "swap.h"
 #include "tss.h"
+#include "vdso.h"
 #include "vfs.h"
+#include "vma.h"
 
 #define PROCESS_USER_HEAP_BASE    0x09000000U
 #define PROCESS_USER_HEAP_LIMIT   0x40000000U
@@ -18,19 +21,38 @@
 #define PROCESS_KERNEL_PD_INDEX   768U
 #define PROCESS_RECURSIVE_PD_IDX  1023U
 #define PROCESS_RECURSIVE_PD_VA   0xFFFFF000U
+#define PROCESS_RECURSIVE_PT_VA   0xFFC00000U
 #define PROCESS_TMP_PD_VA         0xDFFC0000U
 #define PROCESS_TMP_PT_VA         0xDFFC1000U
 
-static struct process process_table[PROCESS_MAX_COUNT];
+/* Address-space modes for process_create_common() */
+#define PROCESS_SPACE_NEW         0U
+#define PROCESS_SPACE_CLONE       1U
+#define PROCESS_SPACE_BORROW      2U
+
+#define PROCESS_PID_WORDS         (PROCESS_PID_MAX / 32U)
+#define PROCESS_PID_HASH_BUCKETS  256U
+
+static struct kmem_cache *process_cache;
+static struct process *process_current;
+static struct process *process_all_head;
+static struct process *process_all_tail;
+static struct process *process_zombies;
+static struct process *process_pid_hash[PROCESS_PID_HASH_BUCKETS];
+static uint32_t process_pid_bitmap[PROCESS_PID_WORDS];
 static uint32_t process_next_pid = 1U;
-static uint32_t process_current_index = 0U;
 static uint32_t process_total = 0U;
 static uint32_t process_initialized = 0U;
 static uint8_t process_preemption_enabled = 0U;
-static int32_t process_zombie_slot = -1;
+static uint32_t process_kernel_cr3 = 0U;
+static struct process *process_run_head[PROCESS_PRIORITY_LEVELS];
+static struct process *process_run_tail[PROCESS_PRIORITY_LEVELS];
+static uint32_t process_ready_mask = 0U;
+static uint32_t process_boost_accum = 0U;
 static struct spinlock process_create_lock = SPINLOCK_INITIALIZER;
 
 extern void process_switch(uint32_t *old_esp, uint32_t new_esp);
+static void process_schedule(uint8_t preempted);
 
 static uint32_t read_esp(void)
 {
@@ -72,29 +94,59 @@ static void process_unmap_temp_page(uint32_t virt_addr)
     (void)paging_unmap_page(virt_addr);
 }
 
+/* Kernel pointer to a page-table frame: the physmap when it covers the
+ * frame, otherwise the given temporary window. Returns 0 on failure. */
+static uint32_t *process_map_frame(uint32_t window_va, uint32_t phys_addr)
+{
+    void *ptr = phys_to_virt(phys_addr);
+
+    if (ptr != 0) {
+        return (uint32_t *)ptr;
+    }
+
+    if (process_map_temp_page(window_va, phys_addr) != 0) {
+        return 0;
+    }
+
+    return (uint32_t *)(uintptr_t)window_va;
+}
+
+static void process_unmap_frame(uint32_t window_va, const uint32_t *ptr)
+{
+    if ((uint32_t)(uintptr_t)ptr == window_va) {
+        process_unmap_temp_page(window_va);
+    }
+}
+
 static int process_create_address_space(uint32_t *cr3_out)
 {
     uint32_t pd_phys;
     uint32_t *new_pd;
     uint32_t *cur_pd;
+    uint32_t zeroed;
     uint32_t i;
 
     if (cr3_out == 0) {
         return -1;
     }
 
-    pd_phys = pmm_alloc_frame();
+    pd_phys = pmm_alloc_zeroed_frame();
+    zeroed = (pd_phys != 0U) ? 1U : 0U;
+    if (pd_phys == 0U) {
+        pd_phys = pmm_alloc_frame();
+    }
     if (pd_phys == 0U) {
         return -1;
     }
 
-    if (process_map_temp_page(PROCESS_TMP_PD_VA, pd_phys) != 0) {
+    new_pd = process_map_frame(PROCESS_TMP_PD_VA, pd_phys);
+    if (new_pd == 0) {
         pmm_free_frame(pd_phys);
         return -1;
     }
 
-    new_pd = (uint32_t *)(uintptr_t)PROCESS_TMP_PD_VA;
-    for (i = 0U; i < PROCESS_PAGE_DIR_ENTRIES; i++) {
+    /* Only the user half needs clearing; the kernel half is copied below */
+    for (i = 0U; zeroed == 0U && i < PROCESS_KERNEL_PD_INDEX; i++) {
         new_pd[i] = 0U;
     }
 
@@ -107,7 +159,7 @@ static int process_create_address_space(uint32_t *cr3_out)
                                      | PAGE_PRESENT
                                      | PAGE_WRITABLE;
 
-    process_unmap_temp_page(PROCESS_TMP_PD_VA);
+    process_unmap_frame(PROCESS_TMP_PD_VA, new_pd);
     *cr3_out = pd_phys;
     return 0;
 }
@@ -121,12 +173,11 @@ static void process_destroy_address_space(uint32_t cr3_phys)
         return;
     }
 
-    if (process_map_temp_page(PROCESS_TMP_PD_VA, cr3_phys) != 0) {
+    pd = process_map_frame(PROCESS_TMP_PD_VA, cr3_phys);
+    if (pd == 0) {
         return;
     }
 
-    pd = (uint32_t *)(uintptr_t)PROCESS_TMP_PD_VA;
-
     for (pdi = 0U; pdi < PROCESS_KERNEL_PD_INDEX; pdi++) {
         uint32_t pde = pd[pdi];
         uint32_t pt_phys;
@@ -137,15 +188,28 @@ static void process_destroy_address_space(uint32_t cr3_phys)
             continue;
         }
 
+        if ((pde & PAGE_LARGE) != 0U) {
+            /* Private 4MB user page (large heap chunk); never shared */
+            pmm_free_frames(pde & LARGE_PAGE_MASK, PMM_MAX_ORDER);
+            pd[pdi] = 0U;
+            continue;
+        }
+
         pt_phys = pde & PAGE_FRAME_MASK;
-        if (process_map_temp_page(PROCESS_TMP_PT_VA, pt_phys) != 0) {
+        pt = process_map_frame(PROCESS_TMP_PT_VA, pt_phys);
+        if (pt == 0) {
             continue;
         }
 
-        pt = (uint32_t *)(uintptr_t)PROCESS_TMP_PT_VA;
         for (pti = 0U; pti < PROCESS_PAGE_DIR_ENTRIES; pti++) {
             uint32_t pte = pt[pti];
 
+            if (swap_pte_is_swapped(pte) != 0) {
+                swap_free_slot(swap_pte_slot(pte));
+                pt[pti] = 0U;
+                continue;
+            }
+
             if ((pte & PAGE_PRESENT) == 0U) {
                 continue;
             }
@@ -154,15 +218,134 @@ static void process_destroy_address_space(uint32_t cr3_phys)
             pt[pti] = 0U;
         }
 
-        process_unmap_temp_page(PROCESS_TMP_PT_VA);
+        process_unmap_frame(PROCESS_TMP_PT_VA, pt);
         pmm_free_frame(pt_phys);
         pd[pdi] = 0U;
     }
 
-    process_unmap_temp_page(PROCESS_TMP_PD_VA);
+    process_unmap_frame(PROCESS_TMP_PD_VA, pd);
     pmm_free_frame(cr3_phys);
 }
 
+/*
+ * Copy-on-write clone of the current user address space (PDEs below 768).
+ * The child gets its own page tables; every present user page is shared,
+ * with writable pages downgraded to read-only + PAGE_COW in both spaces and
+ * an extra PMM owner per frame. Cost is proportional to page-table size.
+ */
+static int process_clone_address_space(uint32_t *cr3_out)
+{
+    uint32_t child_cr3;
+    uint32_t *cur_pd;
+    uint32_t *child_pd;
+    uint32_t pdi;
+    int rc = 0;
+
+    if (cr3_out == 0 || process_create_address_space(&child_cr3) != 0) {
+        return -1;
+    }
+
+    child_pd = process_map_frame(PROCESS_TMP_PD_VA, child_cr3);
+    if (child_pd == 0) {
+        process_destroy_address_space(child_cr3);
+        return -1;
+    }
+
+    cur_pd = (uint32_t *)(uintptr_t)PROCESS_RECURSIVE_PD_VA;
+
+    for (pdi = 0U; pdi < PROCESS_KERNEL_PD_INDEX && rc == 0; pdi++) {
+        uint32_t pde = cur_pd[pdi];
+        uint32_t *parent_pt;
+        uint32_t *child_pt;
+        uint32_t pt_phys;
+        uint32_t pti;
+
+        if ((pde & PAGE_PRESENT) == 0U || (pde & PAGE_USER) == 0U) {
+            continue;
+        }
+
+        /* 4MB user pages are split so each 4KB page can be COW-shared */
+        if ((pde & PAGE_LARGE) != 0U) {
+            if (paging_split_large(pdi << 22) != 0) {
+                rc = -1;
+                break;
+            }
+            pde = cur_pd[pdi];
+        }
+
+        pt_phys = pmm_alloc_frame();
+        if (pt_phys == 0U) {
+            rc = -1;
+            break;
+        }
+
+        child_pt = process_map_frame(PROCESS_TMP_PT_VA, pt_phys);
+        if (child_pt == 0) {
+            pmm_free_frame(pt_phys);
+            rc = -1;
+            break;
+        }
+
+        parent_pt = (uint32_t *)(uintptr_t)(PROCESS_RECURSIVE_PT_VA + pdi * PAGE_SIZE);
+
+        /* Single pass: every child entry is written, so no pre-clear */
+        for (pti = 0U; pti < PROCESS_PAGE_DIR_ENTRIES; pti++) {
+            uint32_t pte = parent_pt[pti];
+
+            child_pt[pti] = 0U;
+
+            /* Swapped-out pages share the slot; each space reads its own
+             * private copy back in on first touch */
+            if (swap_pte_is_swapped(pte) != 0) {
+                if (swap_dup_slot(swap_pte_slot(pte)) != 0) {
+                    for (; pti < PROCESS_PAGE_DIR_ENTRIES; pti++) {
+                        child_pt[pti] = 0U;
+                    }
+                    rc = -1;
+                    break;
+                }
+                child_pt[pti] = pte;
+                continue;
+            }
+
+            if ((pte & PAGE_PRESENT) == 0U) {
+                continue;
+            }
+
+            if (pmm_ref_frame(pte & PAGE_FRAME_MASK) != 0) {
+                /* Leave no stale entries for the teardown to free */
+                for (; pti < PROCESS_PAGE_DIR_ENTRIES; pti++) {
+                    child_pt[pti] = 0U;
+                }
+                rc = -1;
+                break;
+            }
+
+            if ((pte & PAGE_WRITABLE) != 0U) {
+                pte = (pte & ~PAGE_WRITABLE) | PAGE_COW;
+                parent_pt[pti] = pte;
+            }
+            child_pt[pti] = pte;
+        }
+
+        process_unmap_frame(PROCESS_TMP_PT_VA, child_pt);
+        child_pd[pdi] = pt_phys | (pde & PAGE_FLAGS_MASK);
+    }
+
+    process_unmap_frame(PROCESS_TMP_PD_VA, child_pd);
+
+    /* Parent PTEs lost their writable bit; drop stale TLB entries */
+    write_cr3(read_cr3());
+
+    if (rc != 0) {
+        process_destroy_address_space(child_cr3);
+        return -1;
+    }
+
+    *cr3_out = child_cr3;
+    return 0;
+}
+
 static void copy_name(char *dst, const char *src, uint32_t dst_len)
 {
     uint32_t i = 0U;
@@ -222,105 +405,328 @@ static const char *process_state_string(enum process_state state)
     }
 }
 
-static int32_t find_slot_by_pid(uint32_t pid)
+/* Next-fit over the PID bitmap, so a freed PID is not handed straight
+ * back out. PID 0 is reserved. Returns 0 when every PID is in use. */
+static uint32_t pid_alloc(void)
 {
-    uint32_t i;
-
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        if (process_table[i].state != PROCESS_STATE_UNUSED &&
-            process_table[i].pid == pid) {
-            return (int32_t)i;
+    uint32_t pid = process_next_pid;
+    uint32_t scanned;
+
+    for (scanned = 0U; scanned <= PROCESS_PID_WORDS; scanned++) {
+        uint32_t word = pid / 32U;
+        uint32_t free_bits = ~process_pid_bitmap[word] & (0xFFFFFFFFU << (pid % 32U));
+
+        if (free_bits != 0U) {
+            pid = word * 32U + (uint32_t)__builtin_ctz(free_bits);
+            process_pid_bitmap[word] |= 1U << (pid % 32U);
+            process_next_pid = (pid + 1U < PROCESS_PID_MAX) ? pid + 1U : 1U;
+            return pid;
         }
+
+        pid = (word + 1U < PROCESS_PID_WORDS) ? (word + 1U) * 32U : 0U;
     }
 
-    return -1;
+    return 0U;
+}
+
+static void pid_free(uint32_t pid)
+{
+    if (pid != 0U && pid < PROCESS_PID_MAX) {
+        process_pid_bitmap[pid / 32U] &= ~(1U << (pid % 32U));
+    }
 }
 
-static int32_t find_free_slot(void)
+static struct process **pid_bucket(uint32_t pid)
 {
-    uint32_t i;
+    return &process_pid_hash[pid & (PROCESS_PID_HASH_BUCKETS - 1U)];
+}
 
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        if (process_table[i].state == PROCESS_STATE_UNUSED) {
-            return (int32_t)i;
+static struct process *find_process_by_pid(uint32_t pid)
+{
+    struct process *proc;
+
+    for (proc = *pid_bucket(pid); proc != 0; proc = proc->hash_next) {
+        if (proc->pid == pid) {
+            return proc;
         }
     }
 
-    return -1;
+    return 0;
+}
+
+/* Publish a new PCB: PID hash plus the creation-order list used by the
+ * table dump and the swap clock. Callers hold IRQs off. */
+static void process_link(struct process *proc)
+{
+    struct process **bucket = pid_bucket(proc->pid);
+
+    proc->hash_next = *bucket;
+    *bucket = proc;
+
+    proc->all_next = 0;
+    proc->all_prev = process_all_tail;
+    if (process_all_tail != 0) {
+        process_all_tail->all_next = proc;
+    } else {
+        process_all_head = proc;
+    }
+    process_all_tail = proc;
+    process_total++;
+}
+
+static void process_unlink(struct process *proc)
+{
+    struct process **link = pid_bucket(proc->pid);
+
+    while (*link != 0 && *link != proc) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == proc) {
+        *link = proc->hash_next;
+    }
+
+    if (proc->all_prev != 0) {
+        proc->all_prev->all_next = proc->all_next;
+    } else {
+        process_all_head = proc->all_next;
+    }
+    if (proc->all_next != 0) {
+        proc->all_next->all_prev = proc->all_prev;
+    } else {
+        process_all_tail = proc->all_prev;
+    }
+
+    if (process_total > 0U) {
+        process_total--;
+    }
+}
+
+static uint32_t process_slice_ticks(uint32_t level)
+{
+    return 1U << level;
+}
+
+/* Append a READY process to the tail of the level its nice and penalty
+ * select. Callers hold IRQs off. */
+static void runqueue_push(struct process *proc)
+{
+    uint32_t level = (uint32_t)proc->nice + proc->penalty;
+
+    if (level >= PROCESS_PRIORITY_LEVELS) {
+        level = PROCESS_PRIORITY_LEVELS - 1U;
+    }
+
+    proc->priority = (uint8_t)level;
+    proc->run_next = 0;
+    if (process_run_tail[level] == 0) {
+        process_run_head[level] = proc;
+    } else {
+        process_run_tail[level]->run_next = proc;
+    }
+    process_run_tail[level] = proc;
+    process_ready_mask |= 1U << level;
+}
+
+static struct process *runqueue_pop(uint32_t level)
+{
+    struct process *proc = process_run_head[level];
+
+    process_run_head[level] = proc->run_next;
+    if (process_run_head[level] == 0) {
+        process_run_tail[level] = 0;
+        process_ready_mask &= ~(1U << level);
+    }
+    proc->run_next = 0;
+    return proc;
 }
 
-static int32_t find_next_ready_slot(uint32_t current_index)
+/* Unlink a READY process from the middle of its level (callers hold IRQs
+ * off). The levels are short, so a walk is fine. */
+static void runqueue_remove(struct process *proc)
 {
-    uint32_t step;
+    uint32_t level = proc->priority;
+    struct process *prev = 0;
+    struct process *it;
+
+    for (it = process_run_head[level]; it != 0; prev = it, it = it->run_next) {
+        if (it != proc) {
+            continue;
+        }
 
-    for (step = 1U; step <= PROCESS_MAX_COUNT; step++) {
-        uint32_t idx = (current_index + step) % PROCESS_MAX_COUNT;
-        if (process_table[idx].state == PROCESS_STATE_READY) {
-            return (int32_t)idx;
+        if (prev != 0) {
+            prev->run_next = it->run_next;
+        } else {
+            process_run_head[level] = it->run_next;
+        }
+        if (process_run_tail[level] == it) {
+            process_run_tail[level] = prev;
         }
+        if (process_run_head[level] == 0) {
+            process_ready_mask &= ~(1U << level);
+        }
+        it->run_next = 0;
+        return;
     }
+}
 
-    return -1;
+/* Dequeue the head of the highest non-empty level. A voluntary yield
+ * passes over the caller when it is alone on its level (it was queued
+ * last), so any other READY process runs first. */
+static struct process *runqueue_pick(const struct process *current, uint8_t voluntary)
+{
+    uint32_t mask = process_ready_mask;
+    uint32_t level;
+
+    if (mask == 0U) {
+        return 0;
+    }
+
+    level = (uint32_t)__builtin_ctz(mask);
+    if (voluntary != 0U && process_run_head[level] == current) {
+        uint32_t rest = mask & ~(1U << level);
+
+        if (rest != 0U) {
+            level = (uint32_t)__builtin_ctz(rest);
+        }
+    }
+
+    return runqueue_pop(level);
 }
 
-static void release_process_slot(uint32_t index)
+/* Periodic boost: forget all penalties so demoted tasks cannot starve
+ * behind a stream of short interactive bursts. */
+static void runqueue_boost(void)
 {
     struct process *proc;
+    uint32_t i;
+
+    for (i = 0U; i < PROCESS_PRIORITY_LEVELS; i++) {
+        process_run_head[i] = 0;
+        process_run_tail[i] = 0;
+    }
+    process_ready_mask = 0U;
+
+    for (proc = process_all_head; proc != 0; proc = proc->all_next) {
+        proc->penalty = 0U;
+        if (proc->state == PROCESS_STATE_READY) {
+            runqueue_push(proc);
+        }
+    }
+}
 
-    if (index >= PROCESS_MAX_COUNT) {
+/* Feedback for the slice that just ended: a full slice demotes, yielding
+ * before the first tick promotes. A slice cut short by a higher level
+ * keeps its progress. */
+static void process_account_slice(struct process *proc, uint8_t preempted)
+{
+    if (preempted != 0U) {
+        if (proc->slice_used >= process_slice_ticks(proc->priority)) {
+            if (proc->penalty < PROCESS_PENALTY_MAX) {
+                proc->penalty++;
+            }
+            proc->slice_used = 0U;
+        }
         return;
     }
 
-    proc = &process_table[index];
-    if (proc->state == PROCESS_STATE_UNUSED) {
+    if (proc->slice_used == 0U && proc->penalty > 0U) {
+        proc->penalty--;
+    }
+    proc->slice_used = 0U;
+}
+
+static void wait_queue_remove(struct wait_queue *wq, struct process *proc)
+{
+    struct process *prev = 0;
+    struct process *it;
+
+    for (it = wq->head; it != 0; prev = it, it = it->run_next) {
+        if (it != proc) {
+            continue;
+        }
+
+        if (prev != 0) {
+            prev->run_next = it->run_next;
+        } else {
+            wq->head = it->run_next;
+        }
+        if (wq->tail == it) {
+            wq->tail = prev;
+        }
+        it->run_next = 0;
+        return;
+    }
+}
+
+/* BLOCKED -> READY. The caller has already taken proc off its wait queue.
+ * IRQs are off: on this single CPU that also excludes every lock holder. */
+static void process_wake(struct process *proc, int32_t result)
+{
+    (void)timer_cancel(&proc->wait_timer);
+    proc->wait_queue = 0;
+    proc->wait_result = result;
+    proc->state = PROCESS_STATE_READY;
+    runqueue_push(proc);
+}
+
+/* wait_timer callback (timer interrupt context) */
+static void process_wait_timeout(void *arg)
+{
+    struct process *proc = arg;
+
+    if (proc->state != PROCESS_STATE_BLOCKED) {
         return;
     }
 
+    if (proc->wait_queue != 0) {
+        wait_queue_remove(proc->wait_queue, proc);
+    }
+    process_wake(proc, -1);
+}
+
+/* Tear down a dead process and return its PCB and PID. */
+static void release_process(struct process *proc)
+{
     if (proc->pid != 0U) {
         vfs_close_owned_by_pid(proc->pid);
     }
 
     if (proc->owns_address_space != 0U) {
-        elf_forget_address_space(proc->cr3);
+        /* A kernel thread may still be running on the dead process's
+         * page directory; move onto the kernel one so it can be freed. */
+        if (proc->cr3 == read_cr3()) {
+            write_cr3(process_kernel_cr3);
+        }
         process_destroy_address_space(proc->cr3);
     }
+    vma_space_destroy(proc->vmas);
 
     if (proc->kernel_stack_base != 0) {
-        kfree(proc->kernel_stack_base);
+        kstack_free(proc->kernel_stack_base);
     }
 
-    proc->pid = 0U;
+    process_unlink(proc);
+    pid_free(proc->pid);
     proc->state = PROCESS_STATE_UNUSED;
-    proc->esp = 0U;
-    proc->ebp = 0U;
-    proc->eip = 0U;
-    proc->cr3 = 0U;
-    proc->owns_address_space = 0U;
-    proc->kernel_stack_base = 0;
-    proc->kernel_stack_size = 0U;
-    proc->entry = 0;
-    proc->arg = 0;
-    proc->user_break = PROCESS_USER_HEAP_BASE;
-    proc->user_image_path[0] = '\0';
-    proc->name[0] = '\0';
-
-    if (process_total > 0U) {
-        process_total--;
-    }
+    kmem_cache_free(process_cache, proc);
 }
 
+/* Free every zombie except the one whose stack we may still be on. */
 static void process_reap_zombie(void)
 {
-    if (process_zombie_slot < 0) {
-        return;
-    }
+    struct process **link = &process_zombies;
 
-    if ((uint32_t)process_zombie_slot == process_current_index) {
-        return;
-    }
+    while (*link != 0) {
+        struct process *proc = *link;
+
+        if (proc == process_current) {
+            link = &proc->run_next;
+            continue;
+        }
 
-    release_process_slot((uint32_t)process_zombie_slot);
-    process_zombie_slot = -1;
+        *link = proc->run_next;
+        release_process(proc);
+    }
 }
 
 static void process_bootstrap(void)
@@ -334,7 +740,7 @@ static void process_bootstrap(void)
         __asm__ volatile ("sti");
     }
 
-    current = &process_table[process_current_index];
+    current = process_current;
     if (current->entry != 0) {
         current->entry(current->arg);
     }
@@ -353,17 +759,9 @@ static void process_bootstrap(void)
     }
 }
 
-static uint32_t process_has_ready(void)
+uint32_t process_has_ready(void)
 {
-    uint32_t i;
-
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        if (process_table[i].state == PROCESS_STATE_READY) {
-            return 1U;
-        }
-    }
-
-    return 0U;
+    return (uint32_t)(process_ready_mask != 0U);
 }
 
 static uint32_t process_kernel_stack_top(const struct process *proc, uint8_t use_live_esp)
@@ -394,45 +792,66 @@ void process_init(void)
 
     spinlock_init(&process_create_lock);
 
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        process_table[i].pid = 0U;
-        process_table[i].state = PROCESS_STATE_UNUSED;
-        process_table[i].esp = 0U;
-        process_table[i].ebp = 0U;
-        process_table[i].eip = 0U;
-        process_table[i].cr3 = 0U;
-        process_table[i].owns_address_space = 0U;
-        process_table[i].kernel_stack_base = 0;
-        process_table[i].kernel_stack_size = 0U;
-        process_table[i].entry = 0;
-        process_table[i].arg = 0;
-        process_table[i].user_break = PROCESS_USER_HEAP_BASE;
-        process_table[i].user_image_path[0] = '\0';
-        process_table[i].name[0] = '\0';
+    vma_init();
+
+    process_cache = kmem_cache_create("process", sizeof(struct process), 0);
+    bootstrap = process_cache != 0 ? kmem_cache_alloc(process_cache) : 0;
+    if (bootstrap == 0) {
+        serial_puts("[PROC] Failed to allocate bootstrap PCB\n");
+        return;
     }
 
+    for (i = 0U; i < PROCESS_PRIORITY_LEVELS; i++) {
+        process_run_head[i] = 0;
+        process_run_tail[i] = 0;
+    }
+    for (i = 0U; i < PROCESS_PID_HASH_BUCKETS; i++) {
+        process_pid_hash[i] = 0;
+    }
+    for (i = 0U; i < PROCESS_PID_WORDS; i++) {
+        process_pid_bitmap[i] = 0U;
+    }
+    process_pid_bitmap[0] = 1U;  /* PID 0 is never handed out */
+    process_ready_mask = 0U;
+    process_boost_accum = 0U;
+
     process_next_pid = 1U;
-    process_current_index = 0U;
+    process_all_head = 0;
+    process_all_tail = 0;
+    process_zombies = 0;
     process_total = 0U;
     process_preemption_enabled = 0U;
-    process_zombie_slot = -1;
 
-    bootstrap = &process_table[0];
-    bootstrap->pid = process_next_pid++;
+    bootstrap->pid = pid_alloc();
     bootstrap->state = PROCESS_STATE_RUNNING;
     bootstrap->esp = read_esp();
     bootstrap->ebp = read_ebp();
     bootstrap->eip = 0U;
     bootstrap->cr3 = read_cr3();
+    process_kernel_cr3 = bootstrap->cr3;
     bootstrap->owns_address_space = 0U;
+    bootstrap->kernel_stack_base = 0;
+    bootstrap->kernel_stack_size = 0U;
+    bootstrap->entry = 0;
+    bootstrap->arg = 0;
     bootstrap->user_break = PROCESS_USER_HEAP_BASE;
+    bootstrap->vmas = vma_space_create();
+    bootstrap->nice = PROCESS_NICE_DEFAULT;
+    bootstrap->penalty = 0U;
+    bootstrap->priority = 0U;
+    bootstrap->slice_used = 0U;
+    bootstrap->run_next = 0;
+    bootstrap->wait_queue = 0;
+    timer_setup(&bootstrap->wait_timer, process_wait_timeout, bootstrap);
+    bootstrap->wait_result = 0;
     bootstrap->user_image_path[0] = '\0';
     copy_name(bootstrap->name, "kernel_main", PROCESS_NAME_MAX_LEN);
 
-    process_total = 1U;
+    process_link(bootstrap);
+    process_current = bootstrap;
     process_initialized = 1U;
 
-    serial_puts("[PROC] Initialized PCB table\n");
+    serial_puts("[PROC] Initialized PCB cache and PID hash\n");
 }
 
 void process_set_preemption(uint8_t enabled)
@@ -447,20 +866,37 @@ uint8_t process_is_preemption_enabled(void)
 
 void process_preempt_from_irq(void)
 {
+    struct process *current;
+
     if (process_preemption_enabled == 0U || process_initialized == 0U) {
         return;
     }
 
-    process_yield();
+    if (++process_boost_accum >= PROCESS_BOOST_TICKS) {
+        process_boost_accum = 0U;
+        runqueue_boost();
+    }
+
+    current = process_current;
+    if (current->state == PROCESS_STATE_RUNNING) {
+        current->slice_used++;
+        if (current->slice_used < process_slice_ticks(current->priority) &&
+            (process_ready_mask & ((1U << current->priority) - 1U)) == 0U) {
+            return;
+        }
+    }
+
+    process_schedule(1U);
 }
 
-int32_t process_create_kernel(const char *name, process_entry_t entry, void *arg)
+static int32_t process_create_common(const char *name, process_entry_t entry, void *arg,
+                                     uint32_t space_mode)
 {
     uint32_t create_flags;
-    int32_t slot;
     struct process *proc;
     void *stack;
-    uint32_t process_cr3;
+    struct vma_space *vmas = 0;
+    uint32_t process_cr3 = 0U;
     uint32_t stack_top;
     uint32_t *sp;
     int32_t pid;
@@ -477,27 +913,53 @@ int32_t process_create_kernel(const char *name, process_entry_t entry, void *arg
         return -1;
     }
 
-    slot = find_free_slot();
-    if (slot < 0) {
+    proc = kmem_cache_alloc(process_cache);
+    if (proc == 0) {
         spinlock_unlock_irqrestore(&process_create_lock, create_flags);
-        serial_puts("[PROC] No free PCB slots\n");
+        serial_puts("[PROC] Failed to allocate PCB\n");
         return -1;
     }
 
-    stack = kmalloc(PROCESS_KERNEL_STACK_SIZE);
+    proc->pid = pid_alloc();
+    if (proc->pid == 0U) {
+        spinlock_unlock_irqrestore(&process_create_lock, create_flags);
+        kmem_cache_free(process_cache, proc);
+        serial_puts("[PROC] No free PIDs\n");
+        return -1;
+    }
+
+    stack = kstack_alloc();
     if (stack == 0) {
+        pid_free(proc->pid);
         spinlock_unlock_irqrestore(&process_create_lock, create_flags);
+        kmem_cache_free(process_cache, proc);
         serial_puts("[PROC] Failed to allocate kernel stack\n");
         return -1;
     }
 
-    if (process_create_address_space(&process_cr3) != 0) {
+    if ((space_mode == PROCESS_SPACE_CLONE && process_clone_address_space(&process_cr3) != 0)
+        || (space_mode == PROCESS_SPACE_NEW && process_create_address_space(&process_cr3) != 0)) {
+        pid_free(proc->pid);
         spinlock_unlock_irqrestore(&process_create_lock, create_flags);
-        kfree(stack);
+        kstack_free(stack);
+        kmem_cache_free(process_cache, proc);
         serial_puts("[PROC] Failed to allocate process address space\n");
         return -1;
     }
 
+    if (space_mode == PROCESS_SPACE_CLONE) {
+        vmas = vma_space_clone(process_current->vmas);
+        if (vmas == 0) {
+            pid_free(proc->pid);
+            spinlock_unlock_irqrestore(&process_create_lock, create_flags);
+            process_destroy_address_space(process_cr3);
+            kstack_free(stack);
+            kmem_cache_free(process_cache, proc);
+            serial_puts("[PROC] Failed to copy memory areas\n");
+            return -1;
+        }
+    }
+
     stack_top = (uint32_t)(uintptr_t)stack + PROCESS_KERNEL_STACK_SIZE;
     stack_top &= ~0x0FU;
 
@@ -510,29 +972,46 @@ int32_t process_create_kernel(const char *name, process_entry_t entry, void *arg
     *--sp = 0U;                                      /* esi */
     *--sp = 0U;                                      /* edi */
 
-    proc = &process_table[(uint32_t)slot];
-    proc->pid = process_next_pid++;
     proc->state = PROCESS_STATE_READY;
     proc->esp = (uint32_t)(uintptr_t)sp;
     proc->ebp = proc->esp;
     proc->eip = (uint32_t)(uintptr_t)process_bootstrap;
     proc->cr3 = process_cr3;
-    proc->owns_address_space = 1U;
+    proc->owns_address_space = (uint8_t)(space_mode != PROCESS_SPACE_BORROW);
     proc->kernel_stack_base = stack;
     proc->kernel_stack_size = PROCESS_KERNEL_STACK_SIZE;
     proc->entry = entry;
     proc->arg = arg;
     proc->user_break = PROCESS_USER_HEAP_BASE;
+    proc->vmas = vmas;
+    proc->nice = PROCESS_NICE_DEFAULT;
+    proc->penalty = 0U;
+    proc->slice_used = 0U;
+    proc->run_next = 0;
+    proc->wait_queue = 0;
+    timer_setup(&proc->wait_timer, process_wait_timeout, proc);
+    proc->wait_result = 0;
     proc->user_image_path[0] = '\0';
     copy_name(proc->name, name, PROCESS_NAME_MAX_LEN);
 
-    process_total++;
+    if (space_mode == PROCESS_SPACE_CLONE) {
+        const struct process *parent = process_current;
+
+        proc->nice = parent->nice;
+        proc->user_break = parent->user_break;
+        copy_name(proc->user_image_path, parent->user_image_path, PROCESS_IMAGE_PATH_MAX);
+    }
+    process_link(proc);
+    runqueue_push(proc);
+
     pid = (int32_t)proc->pid;
     copy_name(created_name, proc->name, sizeof(created_name));
 
     spinlock_unlock_irqrestore(&process_create_lock, create_flags);
 
-    serial_puts("[PROC] Created kernel process pid=");
+    serial_puts(space_mode == PROCESS_SPACE_CLONE ? "[PROC] Forked process pid="
+                : space_mode == PROCESS_SPACE_BORROW ? "[PROC] Created kernel thread pid="
+                : "[PROC] Created kernel process pid=");
     serial_put_u32((uint32_t)pid);
     serial_puts(" name=");
     serial_puts(created_name);
@@ -541,10 +1020,84 @@ int32_t process_create_kernel(const char *name, process_entry_t entry, void *arg
     return pid;
 }
 
-void process_yield(void)
+int32_t process_create_kernel(const char *name, process_entry_t entry, void *arg)
+{
+    return process_create_common(name, entry, arg, PROCESS_SPACE_NEW);
+}
+
+int32_t kthread_create(const char *name, process_entry_t entry, void *arg)
+{
+    return process_create_common(name, entry, arg, PROCESS_SPACE_BORROW);
+}
+
+int32_t process_fork_current(process_entry_t entry, void *arg)
+{
+    char name[PROCESS_NAME_MAX_LEN];
+
+    if (process_initialized == 0U) {
+        return -1;
+    }
+
+    copy_name(name, process_current->name, sizeof(name));
+    return process_create_common(name, entry, arg, PROCESS_SPACE_CLONE);
+}
+
+int process_exec_space_begin(uint32_t *old_cr3_out)
+{
+    uint32_t new_cr3;
+
+    if (old_cr3_out == 0 || process_initialized == 0U) {
+        return -1;
+    }
+
+    if (process_create_address_space(&new_cr3) != 0) {
+        return -1;
+    }
+
+    /* Kernel half is shared, so execution carries on unaffected */
+    *old_cr3_out = read_cr3();
+    write_cr3(new_cr3);
+    return 0;
+}
+
+void process_exec_space_abort(uint32_t old_cr3)
+{
+    uint32_t new_cr3 = read_cr3();
+
+    if (old_cr3 == 0U || old_cr3 == new_cr3) {
+        return;
+    }
+
+    write_cr3(old_cr3);
+    process_destroy_address_space(new_cr3);
+}
+
+void process_exec_space_commit(uint32_t old_cr3, struct vma_space *vmas)
+{
+    uint32_t irq_flags;
+    struct process *current;
+    struct vma_space *old_vmas;
+    uint8_t owned;
+
+    irq_flags = spinlock_irq_save();
+    current = process_current;
+    owned = current->owns_address_space;
+    old_vmas = current->vmas;
+    current->cr3 = read_cr3();
+    current->owns_address_space = 1U;
+    current->vmas = vmas;
+    current->user_break = PROCESS_USER_HEAP_BASE;
+    spinlock_irq_restore(irq_flags);
+
+    /* The boot page directory is not ours to free */
+    if (owned != 0U) {
+        process_destroy_address_space(old_cr3);
+    }
+    vma_space_destroy(old_vmas);
+}
+
+static void process_schedule(uint8_t preempted)
 {
-    int32_t next_slot;
-    uint32_t current_slot;
     uint32_t irq_flags;
     struct process *current;
     struct process *next;
@@ -559,12 +1112,20 @@ void process_yield(void)
 
     process_reap_zombie();
 
-    current_slot = process_current_index;
-    current = &process_table[current_slot];
-    current->cr3 = read_cr3();
-    next_slot = find_next_ready_slot(current_slot);
+    current = process_current;
+    /* Kernel threads keep cr3 == 0: they never own what is loaded */
+    if (current->cr3 != 0U) {
+        current->cr3 = read_cr3();
+    }
 
-    if (next_slot < 0) {
+    if (current->state == PROCESS_STATE_RUNNING) {
+        process_account_slice(current, preempted);
+        current->state = PROCESS_STATE_READY;
+        runqueue_push(current);
+    }
+    next = runqueue_pick(current, (uint8_t)(preempted == 0U));
+
+    if (next == 0 || next == current) {
         if (current->state == PROCESS_STATE_READY) {
             current->state = PROCESS_STATE_RUNNING;
         }
@@ -573,21 +1134,20 @@ void process_yield(void)
         return;
     }
 
-    next = &process_table[(uint32_t)next_slot];
-
-    if (current->state == PROCESS_STATE_RUNNING) {
-        current->state = PROCESS_STATE_READY;
-    }
-
     if (current->state == PROCESS_STATE_TERMINATED) {
-        process_zombie_slot = (int32_t)current_slot;
+        current->run_next = process_zombies;
+        process_zombies = current;
     }
 
     next->state = PROCESS_STATE_RUNNING;
-    process_current_index = (uint32_t)next_slot;
+    process_current = next;
+    vdso_set_pid(next->pid);
     tss_set_kernel_stack(process_kernel_stack_top(next, 0U));
 
-    if (next->cr3 != current->cr3) {
+    /* Lazy TLB: a kernel thread only touches the shared kernel half, so
+     * it runs on whatever page directory is loaded and the next switch
+     * back into that same process costs no CR3 write or TLB flush. */
+    if (next->cr3 != 0U && next->cr3 != read_cr3()) {
         write_cr3(next->cr3);
     }
 
@@ -597,6 +1157,142 @@ void process_yield(void)
     spinlock_irq_restore(irq_flags);
 }
 
+void process_yield(void)
+{
+    process_schedule(0U);
+}
+
+void wait_queue_init(struct wait_queue *wq)
+{
+    if (wq == 0) {
+        return;
+    }
+
+    wq->head = 0;
+    wq->tail = 0;
+}
+
+int process_wait(struct wait_queue *wq, struct spinlock *lock, uint64_t timeout_ns)
+{
+    uint32_t irq_flags;
+    struct process *current;
+    int rc;
+
+    if (wq == 0 || process_initialized == 0U) {
+        return -1;
+    }
+
+    irq_flags = spinlock_irq_save();
+    current = process_current;
+
+    /* Giving up the CPU before the slice ends counts as interactive */
+    process_account_slice(current, 0U);
+    current->state = PROCESS_STATE_BLOCKED;
+    current->wait_queue = wq;
+    current->wait_result = -1;
+    current->run_next = 0;
+    if (wq->tail != 0) {
+        wq->tail->run_next = current;
+    } else {
+        wq->head = current;
+    }
+    wq->tail = current;
+    if (timeout_ns != 0U) {
+        timer_add(&current->wait_timer, timeout_ns);
+    }
+
+    if (lock != 0) {
+        spinlock_unlock(lock);
+    }
+
+    while (current->state == PROCESS_STATE_BLOCKED) {
+        process_schedule(0U);
+        if (current->state == PROCESS_STATE_BLOCKED) {
+            /* Nothing else is READY: idle until an IRQ wakes somebody */
+            __asm__ volatile ("sti; hlt; cli");
+        }
+    }
+
+    /* Woken during that idle without switching away: the wake queued this
+     * task as READY, but it is the one running */
+    if (current->state == PROCESS_STATE_READY) {
+        runqueue_remove(current);
+        current->state = PROCESS_STATE_RUNNING;
+    }
+
+    if (lock != 0) {
+        spinlock_lock(lock);
+    }
+
+    rc = current->wait_result;
+    spinlock_irq_restore(irq_flags);
+    return rc;
+}
+
+void process_sleep_ns(uint64_t ns)
+{
+    struct wait_queue sleepers;
+
+    if (ns == 0U) {
+        process_yield();
+        return;
+    }
+
+    /* Nobody wakes this queue; only the timeout ends the wait */
+    wait_queue_init(&sleepers);
+    (void)process_wait(&sleepers, 0, ns);
+}
+
+uint32_t process_wake_one(struct wait_queue *wq)
+{
+    uint32_t irq_flags;
+    struct process *proc;
+
+    if (wq == 0) {
+        return 0U;
+    }
+
+    irq_flags = spinlock_irq_save();
+    proc = wq->head;
+    if (proc != 0) {
+        wait_queue_remove(wq, proc);
+        process_wake(proc, 0);
+    }
+    spinlock_irq_restore(irq_flags);
+
+    return proc != 0 ? 1U : 0U;
+}
+
+uint32_t process_wake_all(struct wait_queue *wq)
+{
+    uint32_t woken = 0U;
+
+    while (process_wake_one(wq) != 0U) {
+        woken++;
+    }
+
+    return woken;
+}
+
+int process_set_nice(uint32_t pid, uint8_t nice)
+{
+    uint32_t irq_flags;
+    struct process *proc;
+
+    if (process_initialized == 0U || nice > PROCESS_NICE_MAX) {
+        return -1;
+    }
+
+    irq_flags = spinlock_irq_save();
+    proc = find_process_by_pid(pid);
+    if (proc != 0) {
+        proc->nice = nice;
+    }
+    spinlock_irq_restore(irq_flags);
+
+    return proc != 0 ? 0 : -1;
+}
+
 void process_run_ready(void)
 {
     while (process_has_ready() != 0U) {
@@ -617,7 +1313,7 @@ void process_refresh_tss_stack(void)
 
     /* Keep TSS esp0 selection coherent with scheduler state updates. */
     irq_flags = spinlock_irq_save();
-    current = &process_table[process_current_index];
+    current = process_current;
     tss_set_kernel_stack(process_kernel_stack_top(current, 1U));
     spinlock_irq_restore(irq_flags);
 }
@@ -632,7 +1328,7 @@ uint32_t process_get_current_pid(void)
     }
 
     irq_flags = spinlock_irq_save();
-    pid = process_table[process_current_index].pid;
+    pid = process_current->pid;
     spinlock_irq_restore(irq_flags);
     return pid;
 }
@@ -649,7 +1345,7 @@ void process_terminate_current(void)
     }
 
     irq_flags = spinlock_irq_save();
-    current = &process_table[process_current_index];
+    current = process_current;
     current->state = PROCESS_STATE_TERMINATED;
     spinlock_irq_restore(irq_flags);
 
@@ -679,14 +1375,18 @@ int process_get_current_user_break(uint32_t *value)
     }
 
     irq_flags = spinlock_irq_save();
-    *value = process_table[process_current_index].user_break;
+    *value = process_current->user_break;
     spinlock_irq_restore(irq_flags);
     return 0;
 }
 
 int process_set_current_user_break(uint32_t value)
 {
+    struct process *current;
     uint32_t irq_flags;
+    uint32_t old_top;
+    uint32_t new_top;
+    int rc = 0;
 
     if (process_initialized == 0U) {
         return -1;
@@ -696,10 +1396,24 @@ int process_set_current_user_break(uint32_t value)
         return -1;
     }
 
+    /* The heap area covers [base, break) rounded out to whole pages */
     irq_flags = spinlock_irq_save();
-    process_table[process_current_index].user_break = value;
+    current = process_current;
+    old_top = (current->user_break + PAGE_SIZE - 1U) & PAGE_FRAME_MASK;
+    new_top = (value + PAGE_SIZE - 1U) & PAGE_FRAME_MASK;
+
+    if (new_top > old_top) {
+        rc = vma_map(current->vmas, old_top, new_top,
+                     VMA_TYPE_HEAP | VMA_READ | VMA_WRITE);
+    } else if (new_top < old_top) {
+        rc = vma_unmap(current->vmas, new_top, old_top);
+    }
+
+    if (rc == 0) {
+        current->user_break = value;
+    }
     spinlock_irq_restore(irq_flags);
-    return 0;
+    return rc;
 }
 
 int process_get_current_image_path(char *path, uint32_t path_len)
@@ -711,7 +1425,7 @@ int process_get_current_image_path(char *path, uint32_t path_len)
     }
 
     irq_flags = spinlock_irq_save();
-    copy_name(path, process_table[process_current_index].user_image_path, path_len);
+    copy_name(path, process_current->user_image_path, path_len);
     spinlock_irq_restore(irq_flags);
     return 0;
 }
@@ -725,7 +1439,7 @@ int process_set_current_image_path(const char *path)
     }
 
     irq_flags = spinlock_irq_save();
-    copy_name(process_table[process_current_index].user_image_path, path,
+    copy_name(process_current->user_image_path, path,
               PROCESS_IMAGE_PATH_MAX);
     spinlock_irq_restore(irq_flags);
     return 0;
@@ -737,23 +1451,38 @@ const struct process *process_get_current(void)
         return 0;
     }
 
-    return &process_table[process_current_index];
+    return process_current;
 }
 
 const struct process *process_get_by_pid(uint32_t pid)
 {
-    int32_t slot;
+    const struct process *proc;
+    uint32_t irq_flags;
 
     if (process_initialized == 0U) {
         return 0;
     }
 
-    slot = find_slot_by_pid(pid);
-    if (slot < 0) {
+    irq_flags = spinlock_irq_save();
+    proc = find_process_by_pid(pid);
+    spinlock_irq_restore(irq_flags);
+    return proc;
+}
+
+const struct process *process_next_after(uint32_t pid)
+{
+    const struct process *proc;
+    uint32_t irq_flags;
+
+    if (process_initialized == 0U) {
         return 0;
     }
 
-    return &process_table[(uint32_t)slot];
+    irq_flags = spinlock_irq_save();
+    proc = find_process_by_pid(pid);
+    proc = (proc != 0 && proc->all_next != 0) ? proc->all_next : process_all_head;
+    spinlock_irq_restore(irq_flags);
+    return proc;
 }
 
 uint32_t process_count(void)
@@ -763,7 +1492,7 @@ uint32_t process_count(void)
 
 void process_dump_table(void)
 {
-    uint32_t i;
+    const struct process *proc;
 
     if (process_initialized == 0U) {
         serial_puts("[PROC] process_dump_table before init\n");
@@ -771,17 +1500,13 @@ void process_dump_table(void)
     }
 
     serial_puts("[PROC] ---- PCB Table ----\n");
-    for (i = 0U; i < PROCESS_MAX_COUNT; i++) {
-        struct process *proc = &process_table[i];
-
-        if (proc->state == PROCESS_STATE_UNUSED) {
-            continue;
-        }
-
+    for (proc = process_all_head; proc != 0; proc = proc->all_next) {
         serial_puts("[PROC] pid=");
         serial_put_u32(proc->pid);
         serial_puts(" state=");
         serial_puts(process_state_string(proc->state));
+        serial_puts(" prio=");
+        serial_put_u32(proc->priority);
         serial_puts(" name=");
         serial_puts(proc->name);
         serial_puts("\n");
@@ -3,11 +3,25 @@
 
 #include <stdint.h>
 
-#define PROCESS_MAX_COUNT           16U
+#include "kstack.h"
+#include "timer.h"
+
+#define PROCESS_PID_MAX             1024U
 #define PROCESS_NAME_MAX_LEN        24U
-#define PROCESS_KERNEL_STACK_SIZE   4096U
+#define PROCESS_KERNEL_STACK_SIZE   KSTACK_SIZE
 #define PROCESS_IMAGE_PATH_MAX      128U
 
+/* Multi-level feedback run queue. Level 0 runs first; level L gets a time
+ * slice of (1 << L) scheduler ticks. A task starts each slice at level
+ * nice + penalty: using a whole slice raises the penalty (up to
+ * PROCESS_PENALTY_MAX), yielding early lowers it, and every
+ * PROCESS_BOOST_TICKS all penalties are reset. */
+#define PROCESS_PRIORITY_LEVELS     4U
+#define PROCESS_NICE_DEFAULT        0U
+#define PROCESS_NICE_MAX            (PROCESS_PRIORITY_LEVELS - 1U)
+#define PROCESS_PENALTY_MAX         2U
+#define PROCESS_BOOST_TICKS         100U
+
 enum process_state {
     PROCESS_STATE_UNUSED = 0,
     PROCESS_STATE_READY,
@@ -18,6 +32,18 @@ enum process_state {
 
 typedef void (*process_entry_t)(void *arg);
 
+struct spinlock;
+struct vma_space;
+struct process;
+
+/* FIFO of processes blocked on one event; waiters link through run_next. */
+struct wait_queue {
+    struct process *head;
+    struct process *tail;
+};
+
+#define WAIT_QUEUE_INITIALIZER { 0, 0 }
+
 struct process {
     uint32_t pid;
     enum process_state state;
@@ -31,30 +57,90 @@ struct process {
     process_entry_t entry;
     void *arg;
     uint32_t user_break;
+    struct vma_space *vmas;
+    uint8_t nice;
+    uint8_t penalty;
+    uint8_t priority;
+    uint8_t slice_used;
+    struct process *run_next;   /* run queue or zombie list */
+    struct process *hash_next;  /* PID hash chain */
+    struct process *all_next;   /* all processes, creation order */
+    struct process *all_prev;
+    struct wait_queue *wait_queue;  /* queue this BLOCKED process sits on */
+    struct timer wait_timer;        /* process_wait() timeout */
+    int32_t wait_result;
     char user_image_path[PROCESS_IMAGE_PATH_MAX];
     char name[PROCESS_NAME_MAX_LEN];
 };
 
-/* Initialize PCB table and register the bootstrap kernel process. */
+/* Initialize the PCB cache and PID hash and register the bootstrap kernel
+ * process. */
 void process_init(void);
 
 /* Create a kernel-mode process in READY state.
  * Returns PID (>0) on success, -1 on failure. */
 int32_t process_create_kernel(const char *name, process_entry_t entry, void *arg);
 
-/* Cooperative context switch to next READY process.
- * No-op if no other READY process exists. */
+/* Create a kernel thread in READY state. It has no page directory or
+ * memory areas of its own and runs on whichever address space is loaded
+ * when it is scheduled, so it must never touch user addresses.
+ * Returns PID (>0) on success, -1 on failure. */
+int32_t kthread_create(const char *name, process_entry_t entry, void *arg);
+
+/* Create a READY child of the current process whose user address space is a
+ * copy-on-write clone of the caller's. The child inherits name, image path
+ * and user break, and starts in entry(arg) on its own kernel stack.
+ * Returns PID (>0) on success, -1 on failure. */
+int32_t process_fork_current(process_entry_t entry, void *arg);
+
+/* exec support. begin() switches to a fresh, empty user address space;
+ * the loader populates it through ordinary user addresses. commit() makes
+ * it (and its area set) the current process's own and destroys the old
+ * one; abort() switches back and destroys the new one. Callers keep IRQs
+ * off across the sequence. */
+int process_exec_space_begin(uint32_t *old_cr3_out);
+void process_exec_space_abort(uint32_t old_cr3);
+void process_exec_space_commit(uint32_t old_cr3, struct vma_space *vmas);
+
+/* Cooperative context switch to the best READY process other than the
+ * caller, whatever its level. No-op if no other READY process exists. */
 void process_yield(void);
 
-/* Enable/disable PIT-driven preemptive scheduling. */
+/* Set the base priority level (0..PROCESS_NICE_MAX, higher runs later) of
+ * process 'pid'. Takes effect the next time it is queued. Returns 0 on
+ * success, -1 if pid is unknown or nice is out of range. */
+int process_set_nice(uint32_t pid, uint8_t nice);
+
+/* Wait queues. process_wait() blocks the current process on 'wq' until a
+ * wake call picks it or 'timeout_ns' nanoseconds pass (0 waits forever).
+ * 'lock', if given, must be held with IRQs off; it is dropped while the
+ * process sleeps and held again on return, so a waker that takes the same
+ * lock cannot be missed. Returns 0 when woken, -1 on timeout or before
+ * init. Not for IRQ context. */
+void wait_queue_init(struct wait_queue *wq);
+int process_wait(struct wait_queue *wq, struct spinlock *lock, uint64_t timeout_ns);
+
+/* Block the current process for at least 'ns' nanoseconds; 0 just yields. */
+void process_sleep_ns(uint64_t ns);
+
+/* Make the oldest waiter (or every waiter) READY. Return how many were
+ * woken. Safe from IRQ context. */
+uint32_t process_wake_one(struct wait_queue *wq);
+uint32_t process_wake_all(struct wait_queue *wq);
+
+/* Enable/disable timer-driven preemptive scheduling. */
 void process_set_preemption(uint8_t enabled);
 
 /* Return 1 when preemptive scheduling is enabled, else 0. */
 uint8_t process_is_preemption_enabled(void);
 
-/* Called from IRQ0 path to preempt current process on quantum expiry. */
+/* Called from the timer IRQ on every scheduler tick. Switches away when
+ * the current process has used up its slice or a higher level has work. */
 void process_preempt_from_irq(void);
 
+/* Return 1 when any process is waiting in the run queue, else 0. */
+uint32_t process_has_ready(void);
+
 /* Run cooperative switching until no READY processes remain. */
 void process_run_ready(void);
 
@@ -65,7 +151,9 @@ void process_refresh_tss_stack(void);
 uint32_t process_get_current_pid(void);
 void process_terminate_current(void) __attribute__((noreturn));
 
-/* Per-process user heap break helpers for sbrk. */
+/* Per-process user heap break helpers for sbrk. Setting the break also
+ * resizes the heap area, so it fails when the heap would run into another
+ * area. */
 uint32_t process_user_heap_base(void);
 uint32_t process_user_heap_limit(void);
 int process_get_current_user_break(uint32_t *value);
@@ -76,6 +164,9 @@ int process_set_current_image_path(const char *path);
 /* Access process metadata. */
 const struct process *process_get_current(void);
 const struct process *process_get_by_pid(uint32_t pid);
+/* Process created after 'pid', wrapping to the oldest; the oldest when
+ * 'pid' is 0 or gone. Returns 0 only before init. */
+const struct process *process_next_after(uint32_t pid);
 uint32_t process_count(void);
 
 /* Dump active PCB entries to serial debug output. */
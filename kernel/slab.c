@@ -0,0 +1,411 @@
+/* ==========================================================================
+ * ClaudeOS Slab Object Caches
+ * ==========================================================================
+ * Fixed-size object caches layered on kmalloc. Each cache owns a set of
+ * slabs; a slab is one kmalloc'd chunk holding a small header, a stack of
+ * free object indices and the object slots themselves.
+ *
+ *   slab:  [struct kmem_slab | pad to 16 | slot 0 | slot 1 | ... ]
+ *   slot:  [struct kmem_obj_header (16 bytes) | object payload ]
+ *
+ * Allocation pops an index from a partial slab's free stack and free pushes
+ * it back, so both are O(1) once a slab exists. The per-object header points
+ * back at its slab, which lets free validate ownership and catch double
+ * frees without scanning. Constructors run once when a slab is created, so
+ * objects keep their constructed state across free/alloc cycles.
+ *
+ * Slabs move between three lists (partial, full, empty). At most
+ * KMEM_MAX_EMPTY_SLABS empty slabs are kept per cache; the rest go back to
+ * the general heap.
+ * ========================================================================== */
+
+#include "slab.h"
+#include "heap.h"
+#include "serial.h"
+#include "spinlock.h"
+
+#define KMEM_OBJ_ALIGN          16U
+#define KMEM_SLAB_MIN_BYTES     4096U
+#define KMEM_SLAB_MIN_OBJECTS   4U
+#define KMEM_SLAB_MAX_OBJECTS   64U
+#define KMEM_MAX_EMPTY_SLABS    1U
+#define KMEM_OBJ_MAGIC          0x534C4142U  /* "SLAB" */
+#define KMEM_OBJ_LIVE           0x80000000U
+
+struct kmem_slab {
+    struct kmem_cache *cache;
+    struct kmem_slab *prev;
+    struct kmem_slab *next;
+    uint8_t *slots;
+    uint32_t in_use;
+    uint32_t free_top;
+    uint8_t free_stack[KMEM_SLAB_MAX_OBJECTS];
+};
+
+struct kmem_obj_header {
+    struct kmem_slab *slab;
+    uint32_t index;              /* slot index, KMEM_OBJ_LIVE when allocated */
+    uint32_t magic;
+    uint32_t reserved;
+};
+
+struct kmem_cache {
+    char name[KMEM_NAME_MAX_LEN];
+    uint8_t used;
+    uint32_t object_size;
+    uint32_t slot_size;
+    uint32_t objects_per_slab;
+    kmem_ctor_t ctor;
+    struct kmem_slab *partial;
+    struct kmem_slab *full;
+    struct kmem_slab *empty;
+    uint32_t empty_count;
+    uint32_t slab_count;
+    uint32_t active_objects;
+    uint32_t alloc_count;
+    uint32_t hit_count;
+    uint32_t miss_count;
+    struct spinlock lock;
+};
+
+static struct kmem_cache kmem_cache_pool[KMEM_MAX_CACHES];
+static struct spinlock kmem_pool_lock = SPINLOCK_INITIALIZER;
+
+static uint32_t align_up_u32(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1U) & ~(alignment - 1U);
+}
+
+static void serial_put_u32(uint32_t value)
+{
+    char buffer[11];
+    uint32_t i = 0U;
+
+    if (value == 0U) {
+        serial_putchar('0');
+        return;
+    }
+
+    while (value != 0U && i < (uint32_t)sizeof(buffer)) {
+        buffer[i] = (char)('0' + (value % 10U));
+        value /= 10U;
+        i++;
+    }
+
+    while (i > 0U) {
+        i--;
+        serial_putchar(buffer[i]);
+    }
+}
+
+/* hits * 100 / total without overflowing 32 bits on long uptimes */
+static uint32_t kmem_percent(uint32_t part, uint32_t total)
+{
+    if (total == 0U) {
+        return 0U;
+    }
+    if (part <= 0xFFFFFFFFU / 100U) {
+        return (part * 100U) / total;
+    }
+    return part / (total / 100U);
+}
+
+/* -------------------------------------------------------------------------
+ * Slab list helpers
+ * ------------------------------------------------------------------------- */
+
+static void slab_list_remove(struct kmem_slab **head, struct kmem_slab *slab)
+{
+    if (slab->prev != 0) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+
+    if (slab->next != 0) {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->prev = 0;
+    slab->next = 0;
+}
+
+static void slab_list_push(struct kmem_slab **head, struct kmem_slab *slab)
+{
+    slab->prev = 0;
+    slab->next = *head;
+    if (*head != 0) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static struct kmem_obj_header *slab_slot(struct kmem_slab *slab, uint32_t index)
+{
+    return (struct kmem_obj_header *)(void *)(slab->slots + index * slab->cache->slot_size);
+}
+
+/* Allocate and construct a new slab. Caller holds cache->lock. */
+static struct kmem_slab *slab_grow(struct kmem_cache *cache)
+{
+    uint32_t bytes;
+    uint8_t *raw;
+    struct kmem_slab *slab;
+
+    bytes = (uint32_t)sizeof(struct kmem_slab) + KMEM_OBJ_ALIGN +
+            cache->objects_per_slab * cache->slot_size;
+    raw = (uint8_t *)kmalloc(bytes);
+    if (raw == 0) {
+        return 0;
+    }
+
+    slab = (struct kmem_slab *)(void *)raw;
+    slab->cache = cache;
+    slab->prev = 0;
+    slab->next = 0;
+    slab->slots = (uint8_t *)(uintptr_t)align_up_u32(
+        (uint32_t)(uintptr_t)raw + (uint32_t)sizeof(struct kmem_slab), KMEM_OBJ_ALIGN);
+    slab->in_use = 0U;
+    slab->free_top = cache->objects_per_slab;
+
+    /* Stack top holds index 0 so fresh slabs hand out ascending addresses */
+    for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+        struct kmem_obj_header *header = slab_slot(slab, i);
+
+        header->slab = slab;
+        header->index = i;
+        header->magic = KMEM_OBJ_MAGIC;
+        header->reserved = 0U;
+        slab->free_stack[cache->objects_per_slab - 1U - i] = (uint8_t)i;
+
+        if (cache->ctor != 0) {
+            cache->ctor((void *)(header + 1));
+        }
+    }
+
+    cache->slab_count++;
+    return slab;
+}
+
+/* -------------------------------------------------------------------------
+ * Public API
+ * ------------------------------------------------------------------------- */
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t object_size,
+                                     kmem_ctor_t ctor)
+{
+    struct kmem_cache *cache = 0;
+    uint32_t flags;
+    uint32_t slot_size;
+    uint32_t per_slab;
+    uint32_t i;
+
+    if (object_size == 0U || object_size > 0x00100000U) {
+        return 0;
+    }
+
+    slot_size = align_up_u32((uint32_t)sizeof(struct kmem_obj_header) + (uint32_t)object_size,
+                             KMEM_OBJ_ALIGN);
+    per_slab = KMEM_SLAB_MIN_BYTES / slot_size;
+    if (per_slab < KMEM_SLAB_MIN_OBJECTS) {
+        per_slab = KMEM_SLAB_MIN_OBJECTS;
+    }
+    if (per_slab > KMEM_SLAB_MAX_OBJECTS) {
+        per_slab = KMEM_SLAB_MAX_OBJECTS;
+    }
+
+    flags = spinlock_lock_irqsave(&kmem_pool_lock);
+    for (i = 0U; i < KMEM_MAX_CACHES; i++) {
+        if (kmem_cache_pool[i].used == 0U) {
+            cache = &kmem_cache_pool[i];
+            cache->used = 1U;
+            break;
+        }
+    }
+    spinlock_unlock_irqrestore(&kmem_pool_lock, flags);
+
+    if (cache == 0) {
+        serial_puts("[SLAB] cache pool exhausted\n");
+        return 0;
+    }
+
+    i = 0U;
+    if (name != 0) {
+        while (name[i] != '\0' && i + 1U < KMEM_NAME_MAX_LEN) {
+            cache->name[i] = name[i];
+            i++;
+        }
+    }
+    cache->name[i] = '\0';
+
+    cache->object_size = (uint32_t)object_size;
+    cache->slot_size = slot_size;
+    cache->objects_per_slab = per_slab;
+    cache->ctor = ctor;
+    cache->partial = 0;
+    cache->full = 0;
+    cache->empty = 0;
+    cache->empty_count = 0U;
+    cache->slab_count = 0U;
+    cache->active_objects = 0U;
+    cache->alloc_count = 0U;
+    cache->hit_count = 0U;
+    cache->miss_count = 0U;
+    spinlock_init(&cache->lock);
+
+    return cache;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+    struct kmem_slab *slab;
+    struct kmem_obj_header *header;
+    uint32_t flags;
+    uint32_t index;
+
+    if (cache == 0) {
+        return 0;
+    }
+
+    flags = spinlock_lock_irqsave(&cache->lock);
+
+    slab = cache->partial;
+    if (slab == 0 && cache->empty != 0) {
+        slab = cache->empty;
+        slab_list_remove(&cache->empty, slab);
+        slab_list_push(&cache->partial, slab);
+        cache->empty_count--;
+    }
+
+    if (slab != 0) {
+        cache->hit_count++;
+    } else {
+        cache->miss_count++;
+        slab = slab_grow(cache);
+        if (slab == 0) {
+            spinlock_unlock_irqrestore(&cache->lock, flags);
+            return 0;
+        }
+        slab_list_push(&cache->partial, slab);
+    }
+
+    slab->free_top--;
+    index = slab->free_stack[slab->free_top];
+    header = slab_slot(slab, index);
+    header->index = index | KMEM_OBJ_LIVE;
+    slab->in_use++;
+
+    if (slab->free_top == 0U) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    cache->active_objects++;
+    cache->alloc_count++;
+
+    spinlock_unlock_irqrestore(&cache->lock, flags);
+    return (void *)(header + 1);
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+    struct kmem_obj_header *header;
+    struct kmem_slab *slab;
+    uint32_t flags;
+    uint32_t index;
+
+    if (cache == 0 || obj == 0) {
+        return;
+    }
+
+    header = (struct kmem_obj_header *)obj - 1;
+
+    flags = spinlock_lock_irqsave(&cache->lock);
+
+    slab = header->slab;
+    index = header->index & ~KMEM_OBJ_LIVE;
+    if (header->magic != KMEM_OBJ_MAGIC || slab == 0 || slab->cache != cache ||
+        index >= cache->objects_per_slab || slab_slot(slab, index) != header) {
+        spinlock_unlock_irqrestore(&cache->lock, flags);
+        serial_puts("[SLAB] free of foreign object rejected\n");
+        return;
+    }
+
+    if ((header->index & KMEM_OBJ_LIVE) == 0U) {
+        spinlock_unlock_irqrestore(&cache->lock, flags);
+        serial_puts("[SLAB] double free rejected\n");
+        return;
+    }
+
+    header->index = index;
+    if (slab->free_top == 0U) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+    slab->free_stack[slab->free_top] = (uint8_t)index;
+    slab->free_top++;
+    slab->in_use--;
+    cache->active_objects--;
+
+    if (slab->in_use == 0U) {
+        slab_list_remove(&cache->partial, slab);
+        if (cache->empty_count < KMEM_MAX_EMPTY_SLABS) {
+            slab_list_push(&cache->empty, slab);
+            cache->empty_count++;
+        } else {
+            /* Invalidate headers so stale pointers fail the magic check */
+            for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+                slab_slot(slab, i)->magic = 0U;
+            }
+            cache->slab_count--;
+            kfree(slab);
+        }
+    }
+
+    spinlock_unlock_irqrestore(&cache->lock, flags);
+}
+
+void kmem_cache_dump_stats(void)
+{
+    serial_puts("[SLAB] caches:\n");
+
+    for (uint32_t i = 0; i < KMEM_MAX_CACHES; i++) {
+        struct kmem_cache *cache = &kmem_cache_pool[i];
+        uint32_t flags;
+        uint32_t active;
+        uint32_t slabs;
+        uint32_t allocs;
+        uint32_t hits;
+        uint32_t misses;
+
+        if (cache->used == 0U) {
+            continue;
+        }
+
+        flags = spinlock_lock_irqsave(&cache->lock);
+        active = cache->active_objects;
+        slabs = cache->slab_count;
+        allocs = cache->alloc_count;
+        hits = cache->hit_count;
+        misses = cache->miss_count;
+        spinlock_unlock_irqrestore(&cache->lock, flags);
+
+        serial_puts("  ");
+        serial_puts(cache->name);
+        serial_puts(": size=");
+        serial_put_u32(cache->object_size);
+        serial_puts(" active=");
+        serial_put_u32(active);
+        serial_puts("/");
+        serial_put_u32(slabs * cache->objects_per_slab);
+        serial_puts(" slabs=");
+        serial_put_u32(slabs);
+        serial_puts(" hits=");
+        serial_put_u32(hits);
+        serial_puts(" misses=");
+        serial_put_u32(misses);
+        serial_puts(" hit_rate=");
+        serial_put_u32(kmem_percent(hits, allocs));
+        serial_puts("%\n");
+    }
+}
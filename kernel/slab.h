@@ -0,0 +1,29 @@
+#ifndef CLAUDE_SLAB_H
+#define CLAUDE_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KMEM_MAX_CACHES     16U
+#define KMEM_NAME_MAX_LEN   16U
+
+/* Object constructor; runs once per object when its slab is created.
+ * Objects must be returned to the cache in their constructed state. */
+typedef void (*kmem_ctor_t)(void *obj);
+
+struct kmem_cache;
+
+/* Create a cache of fixed-size objects backed by kmalloc'd slabs.
+ * Returns 0 when the cache pool is exhausted or size is invalid. */
+struct kmem_cache *kmem_cache_create(const char *name, size_t object_size,
+                                     kmem_ctor_t ctor);
+
+/* Allocate/free one object. Free rejects pointers not owned by the cache
+ * and double frees. */
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/* Print per-cache statistics (active objects, slabs, hit rate) to serial. */
+void kmem_cache_dump_stats(void);
+
+#endif /* CLAUDE_SLAB_H */
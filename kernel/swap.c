@@ -0,0 +1,206 @@
+/* ==========================================================================
+ * ClaudeOS Swap Device
+ * ==========================================================================
+ * Backing store for user pages evicted under memory pressure. The VMM picks
+ * the victims (a clock over PTE accessed bits) and rewrites their PTEs; this
+ * file only owns the device and its slots.
+ *
+ * The device is the secondary ATA master. It is used only when its first
+ * page carries the Linux swap signature, so a data disk attached there by
+ * mistake is never overwritten. Slot n is device page n (8 sectors).
+ *
+ * Each slot has an owner count like PMM frames: fork shares swapped-out
+ * pages between parent and child, and the slot is free once every PTE
+ * naming it has been faulted back in or unmapped. Allocation is next fit
+ * from a rotating hint.
+ * ========================================================================== */
+
+#include "swap.h"
+#include "ata.h"
+#include "serial.h"
+#include "spinlock.h"
+
+#include <stdint.h>
+
+#define SWAP_DRIVE              ATA_DRIVE_SECONDARY_MASTER
+#define SWAP_SECTOR_SIZE        512U
+#define SWAP_SECTORS_PER_PAGE   (PAGE_SIZE / SWAP_SECTOR_SIZE)
+#define SWAP_MAGIC              "SWAPSPACE2"
+#define SWAP_MAGIC_LEN          10U
+#define SWAP_SLOT_SHARED_MAX    0xFFU
+
+static uint8_t swap_slot_owners[SWAP_MAX_SLOTS];
+static uint32_t swap_slot_total;    /* usable slots are 1 .. total - 1 */
+static uint32_t swap_slot_free;
+static uint32_t swap_hint;
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+
+static void serial_put_dec(uint32_t value)
+{
+    char buf[11];
+    uint32_t i = 0;
+
+    if (value == 0U) {
+        serial_putchar('0');
+        return;
+    }
+
+    while (value > 0U && i < sizeof(buf)) {
+        buf[i] = (char)('0' + (value % 10U));
+        value /= 10U;
+        i++;
+    }
+
+    while (i > 0U) {
+        i--;
+        serial_putchar(buf[i]);
+    }
+}
+
+/* The signature occupies the last ten bytes of page 0 */
+static int swap_signature_present(void)
+{
+    uint8_t sector[SWAP_SECTOR_SIZE];
+
+    if (ata_pio_read28(SWAP_DRIVE, SWAP_SECTORS_PER_PAGE - 1U, 1U, sector) != 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < SWAP_MAGIC_LEN; i++) {
+        if (sector[SWAP_SECTOR_SIZE - SWAP_MAGIC_LEN + i] != (uint8_t)SWAP_MAGIC[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int swap_slot_valid(uint32_t slot)
+{
+    return slot != 0U && slot < swap_slot_total;
+}
+
+void swap_init(void)
+{
+    uint32_t pages;
+
+    spinlock_init(&swap_lock);
+    swap_slot_total = 0U;
+    swap_slot_free = 0U;
+    swap_hint = 1U;
+
+    ata_init();
+    if (ata_drive_present(SWAP_DRIVE) == 0U) {
+        serial_puts("[SWAP] no secondary ATA disk, swap disabled\n");
+        return;
+    }
+
+    if (swap_signature_present() == 0) {
+        serial_puts("[SWAP] secondary disk has no SWAPSPACE2 signature, swap disabled\n");
+        return;
+    }
+
+    pages = ata_drive_total_sectors(SWAP_DRIVE) / SWAP_SECTORS_PER_PAGE;
+    if (pages > SWAP_MAX_SLOTS) {
+        pages = SWAP_MAX_SLOTS;
+    }
+    if (pages < 2U) {
+        serial_puts("[SWAP] swap disk too small, swap disabled\n");
+        return;
+    }
+
+    for (uint32_t i = 0; i < pages; i++) {
+        swap_slot_owners[i] = 0U;
+    }
+
+    swap_slot_total = pages;
+    swap_slot_free = pages - 1U;
+
+    serial_puts("[SWAP] enabled, slots=");
+    serial_put_dec(swap_slot_free);
+    serial_puts("\n");
+}
+
+int swap_enabled(void)
+{
+    return swap_slot_total != 0U;
+}
+
+uint32_t swap_free_slot_count(void)
+{
+    return swap_slot_free;
+}
+
+uint32_t swap_alloc_slot(void)
+{
+    uint32_t flags;
+    uint32_t slot = 0U;
+
+    flags = spinlock_lock_irqsave(&swap_lock);
+    if (swap_slot_free != 0U) {
+        for (uint32_t step = 0; step < swap_slot_total; step++) {
+            uint32_t candidate = swap_hint;
+
+            swap_hint = (swap_hint + 1U < swap_slot_total) ? swap_hint + 1U : 1U;
+            if (swap_slot_owners[candidate] == 0U) {
+                swap_slot_owners[candidate] = 1U;
+                swap_slot_free--;
+                slot = candidate;
+                break;
+            }
+        }
+    }
+    spinlock_unlock_irqrestore(&swap_lock, flags);
+
+    return slot;
+}
+
+int swap_dup_slot(uint32_t slot)
+{
+    uint32_t flags;
+    int rc = -1;
+
+    flags = spinlock_lock_irqsave(&swap_lock);
+    if (swap_slot_valid(slot) != 0 && swap_slot_owners[slot] != 0U &&
+        swap_slot_owners[slot] < SWAP_SLOT_SHARED_MAX) {
+        swap_slot_owners[slot]++;
+        rc = 0;
+    }
+    spinlock_unlock_irqrestore(&swap_lock, flags);
+
+    return rc;
+}
+
+void swap_free_slot(uint32_t slot)
+{
+    uint32_t flags;
+
+    flags = spinlock_lock_irqsave(&swap_lock);
+    if (swap_slot_valid(slot) != 0 && swap_slot_owners[slot] != 0U) {
+        swap_slot_owners[slot]--;
+        if (swap_slot_owners[slot] == 0U) {
+            swap_slot_free++;
+        }
+    }
+    spinlock_unlock_irqrestore(&swap_lock, flags);
+}
+
+int swap_write_page(uint32_t slot, const void *page)
+{
+    if (page == 0 || swap_slot_valid(slot) == 0) {
+        return -1;
+    }
+
+    /* Swap contents die with the boot, so skip the cache flush */
+    return ata_pio_write28(SWAP_DRIVE, slot * SWAP_SECTORS_PER_PAGE,
+                           (uint8_t)SWAP_SECTORS_PER_PAGE, page, 0U);
+}
+
+int swap_read_page(uint32_t slot, void *page)
+{
+    if (page == 0 || swap_slot_valid(slot) == 0) {
+        return -1;
+    }
+
+    return ata_pio_read28(SWAP_DRIVE, slot * SWAP_SECTORS_PER_PAGE,
+                          (uint8_t)SWAP_SECTORS_PER_PAGE, page);
+}
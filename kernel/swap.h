@@ -0,0 +1,58 @@
+#ifndef CLAUDE_SWAP_H
+#define CLAUDE_SWAP_H
+
+#include <stdint.h>
+
+#include "paging.h"
+
+/* Swap lives on the secondary-channel master, formatted like a Linux swap
+ * area (page 0 ends with "SWAPSPACE2", e.g. from mkswap). Page n of the
+ * device is slot n; slot 0 holds the header and is never handed out. */
+#define SWAP_MAX_SLOTS      65536U  /* 256MB of swap */
+
+/*
+ * A swapped-out page keeps a non-present PTE: the slot number in the frame
+ * field, PAGE_SWAPPED, and the page's PAGE_WRITABLE / PAGE_USER / PAGE_COW
+ * bits so it comes back with the permissions it left with.
+ */
+#define SWAP_PTE_KEEP_FLAGS (PAGE_WRITABLE | PAGE_USER | PAGE_COW)
+
+static inline uint32_t swap_make_pte(uint32_t slot, uint32_t pte)
+{
+    return (slot << 12) | PAGE_SWAPPED | (pte & SWAP_PTE_KEEP_FLAGS);
+}
+
+static inline int swap_pte_is_swapped(uint32_t pte)
+{
+    return (pte & (PAGE_PRESENT | PAGE_SWAPPED)) == PAGE_SWAPPED;
+}
+
+static inline uint32_t swap_pte_slot(uint32_t pte)
+{
+    return pte >> 12;
+}
+
+/* Look for a swap device and enable it. Runs after the ATA probe. */
+void swap_init(void);
+
+/* Returns 1 when a swap device is active, else 0. */
+int swap_enabled(void);
+
+/* Number of unused slots. */
+uint32_t swap_free_slot_count(void);
+
+/* Reserve a slot with one owner. Returns the slot, or 0 when swap is
+ * full or disabled. */
+uint32_t swap_alloc_slot(void);
+
+/* Add an owner to a slot (fork). Returns 0 or -1. */
+int swap_dup_slot(uint32_t slot);
+
+/* Drop one owner; the slot is reusable when the last one is gone. */
+void swap_free_slot(uint32_t slot);
+
+/* Transfer one page between a kernel buffer and a slot. Returns 0 or -1. */
+int swap_write_page(uint32_t slot, const void *page);
+int swap_read_page(uint32_t slot, void *page);
+
+#endif /* CLAUDE_SWAP_H */
@@ -2,15 +2,6 @@
 
 #include "process.h"
 
-static inline void sync_wait_hint(void)
-{
-    if (process_is_preemption_enabled() != 0U) {
-        process_yield();
-    } else {
-        __asm__ volatile ("pause");
-    }
-}
-
 void semaphore_init(struct semaphore *sem, int32_t initial_count)
 {
     if (sem == 0) {
@@ -23,25 +14,38 @@ void semaphore_init(struct semaphore *sem, int32_t initial_count)
 
     sem->count = initial_count;
     spinlock_init(&sem->lock);
+    wait_queue_init(&sem->waiters);
 }
 
-void semaphore_wait(struct semaphore *sem)
+int semaphore_wait_timeout(struct semaphore *sem, uint64_t timeout_ns)
 {
     uint32_t flags;
+    int rc = 0;
 
+    if (sem == 0) {
+        return -1;
+    }
+
+    flags = spinlock_lock_irqsave(&sem->lock);
+    if (sem->count > 0) {
+        sem->count--;
+    } else {
+        /* A successful wake carries the signaller's token with it */
+        rc = process_wait(&sem->waiters, &sem->lock, timeout_ns);
+    }
+    spinlock_unlock_irqrestore(&sem->lock, flags);
+    return rc;
+}
+
+void semaphore_wait(struct semaphore *sem)
+{
     if (sem == 0) {
         return;
     }
 
-    for (;;) {
-        flags = spinlock_lock_irqsave(&sem->lock);
-        if (sem->count > 0) {
-            sem->count--;
-            spinlock_unlock_irqrestore(&sem->lock, flags);
-            return;
-        }
-        spinlock_unlock_irqrestore(&sem->lock, flags);
-        sync_wait_hint();
+    /* Only fails before the scheduler is up, when nobody can block */
+    while (semaphore_wait_timeout(sem, 0U) != 0) {
+        __asm__ volatile ("pause");
     }
 }
 
@@ -54,7 +58,9 @@ void semaphore_signal(struct semaphore *sem)
     }
 
     flags = spinlock_lock_irqsave(&sem->lock);
-    sem->count++;
+    if (process_wake_one(&sem->waiters) == 0U) {
+        sem->count++;
+    }
     spinlock_unlock_irqrestore(&sem->lock, flags);
 }
 
@@ -99,3 +105,64 @@ void mutex_unlock(struct mutex *mutex)
 
     semaphore_signal(&mutex->sem);
 }
+
+void condvar_init(struct condvar *cv)
+{
+    if (cv == 0) {
+        return;
+    }
+
+    spinlock_init(&cv->lock);
+    wait_queue_init(&cv->waiters);
+}
+
+int condvar_wait_timeout(struct condvar *cv, struct mutex *mutex, uint64_t timeout_ns)
+{
+    uint32_t flags;
+    int rc;
+
+    if (cv == 0 || mutex == 0) {
+        return -1;
+    }
+
+    /* Queue up before dropping the mutex so a signal sent in between
+     * still finds us. */
+    flags = spinlock_lock_irqsave(&cv->lock);
+    mutex_unlock(mutex);
+    rc = process_wait(&cv->waiters, &cv->lock, timeout_ns);
+    spinlock_unlock_irqrestore(&cv->lock, flags);
+
+    mutex_lock(mutex);
+    return rc;
+}
+
+void condvar_wait(struct condvar *cv, struct mutex *mutex)
+{
+    (void)condvar_wait_timeout(cv, mutex, 0U);
+}
+
+void condvar_signal(struct condvar *cv)
+{
+    uint32_t flags;
+
+    if (cv == 0) {
+        return;
+    }
+
+    flags = spinlock_lock_irqsave(&cv->lock);
+    (void)process_wake_one(&cv->waiters);
+    spinlock_unlock_irqrestore(&cv->lock, flags);
+}
+
+void condvar_broadcast(struct condvar *cv)
+{
+    uint32_t flags;
+
+    if (cv == 0) {
+        return;
+    }
+
+    flags = spinlock_lock_irqsave(&cv->lock);
+    (void)process_wake_all(&cv->waiters);
+    spinlock_unlock_irqrestore(&cv->lock, flags);
+}
@@ -3,20 +3,28 @@
 
 #include <stdint.h>
 
+#include "process.h"
 #include "spinlock.h"
 
 struct semaphore {
     int32_t count;
     struct spinlock lock;
+    struct wait_queue waiters;
 };
 
 /* Initialize counting semaphore with initial token count (>= 0). */
 void semaphore_init(struct semaphore *sem, int32_t initial_count);
 
-/* Busy-waiting semaphore operations (wait must not be called in IRQ context). */
+/* Blocking semaphore operations (wait must not be called in IRQ context).
+ * A waiter sleeps on the semaphore's wait queue; signal hands its token
+ * straight to the oldest waiter instead of bumping the count. */
 void semaphore_wait(struct semaphore *sem);
 void semaphore_signal(struct semaphore *sem);
 
+/* Like semaphore_wait, but give up after 'timeout_ns' nanoseconds
+ * (0 waits forever). Returns 0 with a token taken, -1 on timeout. */
+int semaphore_wait_timeout(struct semaphore *sem, uint64_t timeout_ns);
+
 /* Read current semaphore value. */
 int32_t semaphore_value(struct semaphore *sem);
 
@@ -29,4 +37,19 @@ void mutex_init(struct mutex *mutex);
 void mutex_lock(struct mutex *mutex);
 void mutex_unlock(struct mutex *mutex);
 
+struct condvar {
+    struct spinlock lock;
+    struct wait_queue waiters;
+};
+
+/* Condition variable used with a mutex. wait atomically releases 'mutex'
+ * and sleeps until signalled, then takes 'mutex' again; callers recheck
+ * their condition in a loop. The timeout variant returns -1 if
+ * 'timeout_ns' nanoseconds pass first (the mutex is still re-taken). */
+void condvar_init(struct condvar *cv);
+void condvar_wait(struct condvar *cv, struct mutex *mutex);
+int condvar_wait_timeout(struct condvar *cv, struct mutex *mutex, uint64_t timeout_ns);
+void condvar_signal(struct condvar *cv);
+void condvar_broadcast(struct condvar *cv);
+
 #endif /* CLAUDE_SYNC_H */
@@ -2,18 +2,18 @@
 
 #include <stdint.h>
 
+#include "clock.h"
 #include "console.h"
 #include "elf.h"
 #include "fb.h"
-#include "heap.h"
 #include "keyboard.h"
 #include "paging.h"
-#include "pit.h"
-#include "pmm.h"
 #include "process.h"
 #include "serial.h"
+#include "slab.h"
 #include "spinlock.h"
 #include "usermode.h"
+#include "vmm.h"
 #include "vfs.h"
 #include "vga.h"
 #include "wm.h"
@@ -27,9 +27,13 @@
 
 static uint8_t syscall_trace_once = 0U;
 static struct spinlock syscall_write_lock = SPINLOCK_INITIALIZER;
+static struct kmem_cache *syscall_fork_ctx_cache;
 
-struct fork_child_exec_context {
-    char path[PROCESS_IMAGE_PATH_MAX];
+/* Parent's INT 0x80 frame; the child resumes from it with eax = 0 */
+struct fork_child_context {
+    struct isr_regs regs;
+    uint32_t user_esp;
+    uint32_t user_ss;
 };
 
 struct syscall_user_kbd_event {
@@ -64,11 +68,11 @@ static uint8_t syscall_validate_user_range(uint32_t addr, uint32_t len)
     return 1U;
 }
 
-static uint8_t syscall_validate_user_mapping(uint32_t addr, uint32_t len)
+/* Validate a user buffer and fault in any demand-zero pages it covers.
+ * 'write' is set when the kernel is about to store into the buffer. */
+static uint8_t syscall_validate_user_mapping(uint32_t addr, uint32_t len,
+                                             uint32_t write)
 {
-    uint32_t end;
-    uint32_t page;
-
     if (len == 0U) {
         return 1U;
     }
@@ -77,17 +81,7 @@ static uint8_t syscall_validate_user_mapping(uint32_t addr, uint32_t len)
         return 0U;
     }
 
-    end = addr + len;
-    page = addr & PAGE_FRAME_MASK;
-
-    while (page < end) {
-        if (paging_get_phys_addr(page) == 0U) {
-            return 0U;
-        }
-        page += PAGE_SIZE;
-    }
-
-    return 1U;
+    return (uint8_t)(vmm_prefault_user_range(addr, len, write) == 0);
 }
 
 static uint8_t syscall_validate_user_addr(uint32_t addr)
@@ -96,7 +90,7 @@ static uint8_t syscall_validate_user_addr(uint32_t addr)
         return 0U;
     }
 
-    return (uint8_t)(paging_get_phys_addr(addr) != 0U);
+    return (uint8_t)(vmm_prefault_user_range(addr, 1U, 0U) == 0);
 }
 
 static int32_t syscall_copy_user_cstring(uint32_t user_addr, char *dst,
@@ -128,55 +122,24 @@ static int32_t syscall_copy_user_cstring(uint32_t user_addr, char *dst,
     return -1;
 }
 
-static void syscall_copy_kernel_cstring(char *dst, uint32_t dst_size, const char *src)
-{
-    uint32_t i = 0U;
-
-    if (dst == 0 || dst_size == 0U) {
-        return;
-    }
-
-    if (src == 0) {
-        dst[0] = '\0';
-        return;
-    }
-
-    while (i + 1U < dst_size && src[i] != '\0') {
-        dst[i] = src[i];
-        i++;
-    }
-
-    dst[i] = '\0';
-}
-
 static void syscall_fork_child_entry(void *arg)
 {
-    struct fork_child_exec_context *ctx = (struct fork_child_exec_context *)arg;
-    struct elf_user_image loaded;
-    char path[PROCESS_IMAGE_PATH_MAX];
+    struct fork_child_context *ctx = (struct fork_child_context *)arg;
+    struct isr_regs regs;
+    uint32_t user_esp;
+    uint32_t user_ss;
 
     if (ctx == 0) {
         return;
     }
 
-    syscall_copy_kernel_cstring(path, sizeof(path), ctx->path);
-    kfree(ctx);
-
-    if (path[0] == '\0') {
-        return;
-    }
+    regs = ctx->regs;
+    user_esp = ctx->user_esp;
+    user_ss = ctx->user_ss;
+    kmem_cache_free(syscall_fork_ctx_cache, ctx);
 
-    if (elf_load_user_image_from_vfs(path, &loaded) != 0) {
-        serial_puts("[PROC] fork child exec load failed\n");
-        return;
-    }
-
-    (void)process_set_current_image_path(path);
-    (void)process_set_current_user_break(process_user_heap_base());
     process_refresh_tss_stack();
-
-    serial_puts("[PROC] fork child entering user image\n");
-    usermode_enter_ring3(loaded.entry, loaded.stack_top);
+    usermode_resume_ring3(&regs, user_esp, user_ss);
 }
 
 static int32_t syscall_write(uint32_t fd, uint32_t user_buf, uint32_t len)
@@ -197,7 +160,7 @@ static int32_t syscall_write(uint32_t fd, uint32_t user_buf, uint32_t len)
         return -1;
     }
 
-    if (syscall_validate_user_mapping(user_buf, len) == 0U) {
+    if (syscall_validate_user_mapping(user_buf, len, 0U) == 0U) {
         return -1;
     }
 
@@ -256,7 +219,7 @@ static int32_t syscall_read(uint32_t fd, uint32_t user_buf, uint32_t len)
         return -1;
     }
 
-    if (syscall_validate_user_mapping(user_buf, len) == 0U) {
+    if (syscall_validate_user_mapping(user_buf, len, 1U) == 0U) {
         return -1;
     }
 
@@ -277,26 +240,29 @@ static int32_t syscall_close(uint32_t fd)
     return 0;
 }
 
-static int32_t syscall_fork(void)
+static int32_t syscall_fork(const struct isr_regs *regs)
 {
-    char current_path[PROCESS_IMAGE_PATH_MAX];
-    struct fork_child_exec_context *ctx;
+    const uint32_t *user_frame = (const uint32_t *)(const void *)(regs + 1);
+    struct fork_child_context *ctx;
     int32_t pid;
 
-    if (process_get_current_image_path(current_path, sizeof(current_path)) != 0 ||
-        current_path[0] == '\0') {
+    if ((regs->cs & 0x3U) != 0x3U) {
         return -1;
     }
 
-    ctx = (struct fork_child_exec_context *)kmalloc(sizeof(*ctx));
+    ctx = (struct fork_child_context *)kmem_cache_alloc(syscall_fork_ctx_cache);
     if (ctx == 0) {
         return -1;
     }
 
-    syscall_copy_kernel_cstring(ctx->path, sizeof(ctx->path), current_path);
-    pid = process_create_kernel("fork_user", syscall_fork_child_entry, ctx);
+    ctx->regs = *regs;
+    ctx->regs.eax = 0U;
+    ctx->user_esp = user_frame[0];
+    ctx->user_ss = user_frame[1];
+
+    pid = process_fork_current(syscall_fork_child_entry, ctx);
     if (pid < 0) {
-        kfree(ctx);
+        kmem_cache_free(syscall_fork_ctx_cache, ctx);
         return -1;
     }
 
@@ -323,6 +289,8 @@ static uint32_t syscall_exec(uint32_t user_path)
     usermode_enter_ring3(loaded.entry, loaded.stack_top);
 }
 
+/* Growth only moves the break: pages are demand-zero filled on first touch
+ * by the page-fault handler. Shrinking releases whatever was populated. */
 static uint32_t syscall_sbrk(int32_t increment)
 {
     uint32_t old_break;
@@ -350,54 +318,15 @@ static uint32_t syscall_sbrk(int32_t increment)
     old_mapped_top = align_up_u32(old_break, PAGE_SIZE);
     new_mapped_top = align_up_u32(new_break, PAGE_SIZE);
 
-    if (new_mapped_top > old_mapped_top) {
-        uint32_t page = old_mapped_top;
-
-        while (page < new_mapped_top) {
-            uint32_t phys = pmm_alloc_frame();
-            if (phys == 0U) {
-                while (page > old_mapped_top) {
-                    uint32_t rollback_phys;
-
-                    page -= PAGE_SIZE;
-                    rollback_phys = paging_unmap_page(page);
-                    if (rollback_phys != 0U) {
-                        pmm_free_frame(rollback_phys);
-                    }
-                }
-                return SYSCALL_RET_ENOMEM;
-            }
-
-            if (paging_map_page(page, phys, PAGE_USER | PAGE_WRITABLE) != 0) {
-                pmm_free_frame(phys);
-                while (page > old_mapped_top) {
-                    uint32_t rollback_phys;
-
-                    page -= PAGE_SIZE;
-                    rollback_phys = paging_unmap_page(page);
-                    if (rollback_phys != 0U) {
-                        pmm_free_frame(rollback_phys);
-                    }
-                }
-                return SYSCALL_RET_ENOMEM;
-            }
-
-            page += PAGE_SIZE;
-        }
-    } else if (new_mapped_top < old_mapped_top) {
-        uint32_t page = new_mapped_top;
-
-        while (page < old_mapped_top) {
-            uint32_t phys = paging_unmap_page(page);
-            if (phys != 0U) {
-                pmm_free_frame(phys);
-            }
-            page += PAGE_SIZE;
-        }
+    /* Drop the pages before the area shrinks, so none outlive it */
+    if (new_mapped_top < old_mapped_top &&
+        paging_unmap_range(new_mapped_top, old_mapped_top - new_mapped_top, 1, 0) != 0) {
+        return SYSCALL_RET_ENOMEM;
     }
 
+    /* Fails when growth would run into another area */
     if (process_set_current_user_break(new_break) != 0) {
-        return SYSCALL_RET_EINVAL;
+        return SYSCALL_RET_ENOMEM;
     }
 
     return old_break;
@@ -450,7 +379,7 @@ static int32_t syscall_fb_present(uint32_t user_pixels, uint32_t width, uint32_t
     }
     len *= height;
 
-    if (syscall_validate_user_mapping(user_pixels, len) == 0U) {
+    if (syscall_validate_user_mapping(user_pixels, len, 0U) == 0U) {
         return -1;
     }
 
@@ -466,7 +395,7 @@ static int32_t syscall_kbd_read(uint32_t user_event_ptr)
         return -1;
     }
 
-    if (syscall_validate_user_mapping(user_event_ptr, sizeof(user_event)) == 0U) {
+    if (syscall_validate_user_mapping(user_event_ptr, sizeof(user_event), 1U) == 0U) {
         return -1;
     }
 
@@ -483,14 +412,81 @@ static int32_t syscall_kbd_read(uint32_t user_event_ptr)
     return 1;
 }
 
+static uint32_t syscall_mmap(uint32_t user_args)
+{
+    struct syscall_mmap_args args;
+    uint32_t known = SYSCALL_MAP_PRIVATE | SYSCALL_MAP_FIXED | SYSCALL_MAP_ANONYMOUS;
+    uint32_t addr;
+
+    if (syscall_validate_user_mapping(user_args, sizeof(args), 0U) == 0U) {
+        return SYSCALL_RET_EINVAL;
+    }
+    args = *(const struct syscall_mmap_args *)(uintptr_t)user_args;
+
+    if ((args.flags & ~known) != 0U || (args.flags & SYSCALL_MAP_PRIVATE) == 0U) {
+        return SYSCALL_RET_EINVAL;
+    }
+
+    if ((args.flags & SYSCALL_MAP_ANONYMOUS) != 0U) {
+        args.fd = -1;
+        args.offset = 0U;
+    } else if (args.fd < 0) {
+        return SYSCALL_RET_EINVAL;
+    }
+
+    if (vmm_mmap(args.addr, args.len, args.prot,
+                 ((args.flags & SYSCALL_MAP_FIXED) != 0U) ? 1U : 0U,
+                 args.fd, args.offset, &addr) != 0) {
+        return SYSCALL_RET_ENOMEM;
+    }
+
+    return addr;
+}
+
+static int32_t syscall_munmap(uint32_t addr, uint32_t len)
+{
+    return (vmm_munmap(addr, len) == 0) ? 0 : -1;
+}
+
+static int32_t syscall_mprotect(uint32_t addr, uint32_t len, uint32_t prot)
+{
+    return (vmm_mprotect(addr, len, prot) == 0) ? 0 : -1;
+}
+
 static uint32_t syscall_ticks_ms(void)
 {
-    return (pit_get_ticks() * 1000U) / PIT_TARGET_FREQ;
+    return clock_monotonic_ms();
+}
+
+static int32_t syscall_clock_gettime(uint32_t clock_id, uint32_t user_ts)
+{
+    struct syscall_timespec ts;
+    uint32_t nsec;
+
+    if (clock_id != SYSCALL_CLOCK_REALTIME && clock_id != SYSCALL_CLOCK_MONOTONIC) {
+        return -1;
+    }
+
+    if (syscall_validate_user_mapping(user_ts, sizeof(ts), 1U) == 0U) {
+        return -1;
+    }
+
+    ts.tv_sec = (int32_t)clock_div64(clock_monotonic_ns(), 1000000000U, &nsec);
+    ts.tv_nsec = (int32_t)nsec;
+
+    *(struct syscall_timespec *)(uintptr_t)user_ts = ts;
+    return 0;
+}
+
+static uint32_t syscall_sleep_ms(uint32_t ms)
+{
+    process_sleep_ns((uint64_t)ms * 1000000U);
+    return 0U;
 }
 
-static uint32_t syscall_dispatch(uint32_t number, uint32_t arg0, uint32_t arg1,
-                                 uint32_t arg2, uint32_t arg3, uint32_t arg4,
-                                 uint32_t arg5)
+static uint32_t syscall_dispatch(const struct isr_regs *regs, uint32_t number,
+                                 uint32_t arg0, uint32_t arg1, uint32_t arg2,
+                                 uint32_t arg3, uint32_t arg4, uint32_t arg5)
 {
     (void)arg3;
     (void)arg4;
@@ -510,7 +506,7 @@ static uint32_t syscall_dispatch(uint32_t number, uint32_t arg0, uint32_t arg1,
         case SYSCALL_CLOSE:
             return (uint32_t)(int32_t)syscall_close(arg0);
         case SYSCALL_FORK:
-            return (uint32_t)(int32_t)syscall_fork();
+            return (uint32_t)(int32_t)syscall_fork(regs);
         case SYSCALL_EXEC:
             return syscall_exec(arg0);
         case SYSCALL_GETPID:
@@ -525,6 +521,16 @@ static uint32_t syscall_dispatch(uint32_t number, uint32_t arg0, uint32_t arg1,
             return (uint32_t)(int32_t)syscall_lseek(arg0, (int32_t)arg1, arg2);
         case SYSCALL_FB_PRESENT:
             return (uint32_t)(int32_t)syscall_fb_present(arg0, arg1, arg2);
+        case SYSCALL_MMAP:
+            return syscall_mmap(arg0);
+        case SYSCALL_MUNMAP:
+            return (uint32_t)(int32_t)syscall_munmap(arg0, arg1);
+        case SYSCALL_MPROTECT:
+            return (uint32_t)(int32_t)syscall_mprotect(arg0, arg1, arg2);
+        case SYSCALL_SLEEP_MS:
+            return syscall_sleep_ms(arg0);
+        case SYSCALL_CLOCK_GETTIME:
+            return (uint32_t)syscall_clock_gettime(arg0, arg1);
         default:
             return SYSCALL_RET_ENOSYS;
     }
@@ -534,6 +540,8 @@ void syscall_init(void)
 {
     syscall_trace_once = 0U;
     spinlock_init(&syscall_write_lock);
+    syscall_fork_ctx_cache = kmem_cache_create("fork_ctx",
+                                               sizeof(struct fork_child_context), 0);
     serial_puts("[SYSCALL] INT 0x80 interface initialized\n");
 }
 
@@ -548,6 +556,6 @@ void syscall_handler(struct isr_regs *regs)
         syscall_trace_once = 1U;
     }
 
-    regs->eax = syscall_dispatch(regs->eax, regs->ebx, regs->ecx, regs->edx,
-                                 regs->esi, regs->edi, regs->ebp);
+    regs->eax = syscall_dispatch(regs, regs->eax, regs->ebx, regs->ecx,
+                                 regs->edx, regs->esi, regs->edi, regs->ebp);
 }
@@ -17,10 +17,47 @@
 #define SYSCALL_TICKS_MS 12U
 #define SYSCALL_LSEEK    13U
 #define SYSCALL_FB_PRESENT 14U
+#define SYSCALL_MMAP     15U
+#define SYSCALL_MUNMAP   16U
+#define SYSCALL_MPROTECT 17U
+#define SYSCALL_SLEEP_MS 18U
+#define SYSCALL_CLOCK_GETTIME 19U
 
 #define SYSCALL_O_READ   0x1U
 #define SYSCALL_O_WRITE  0x2U
 
+/* mmap/mprotect protection bits (same values as VMA_READ/WRITE/EXEC) */
+#define SYSCALL_PROT_READ     0x1U
+#define SYSCALL_PROT_WRITE    0x2U
+#define SYSCALL_PROT_EXEC     0x4U
+
+/* mmap flags; only private mappings are supported */
+#define SYSCALL_MAP_SHARED    0x01U
+#define SYSCALL_MAP_PRIVATE   0x02U
+#define SYSCALL_MAP_FIXED     0x10U
+#define SYSCALL_MAP_ANONYMOUS 0x20U
+
+/* SYSCALL_CLOCK_GETTIME clock ids. There is no RTC driver, so REALTIME
+ * also counts from boot. */
+#define SYSCALL_CLOCK_REALTIME  0U
+#define SYSCALL_CLOCK_MONOTONIC 1U
+
+/* SYSCALL_CLOCK_GETTIME fills this (the user libc's struct timespec) */
+struct syscall_timespec {
+    int32_t tv_sec;
+    int32_t tv_nsec;
+};
+
+/* SYSCALL_MMAP takes a pointer to this block in ebx */
+struct syscall_mmap_args {
+    uint32_t addr;
+    uint32_t len;
+    uint32_t prot;
+    uint32_t flags;
+    int32_t fd;
+    uint32_t offset;
+};
+
 /* Initialize syscall subsystem state (INT 0x80 gate is installed by idt_init). */
 void syscall_init(void);
 
@@ -0,0 +1,133 @@
+/* ==========================================================================
+ * ClaudeOS Kernel Timers
+ * ==========================================================================
+ * One-shot timers kept on a single list sorted by nanosecond deadline.
+ * Arming walks the list to its slot; the timer interrupt only ever looks at
+ * the head, so an interrupt with nothing due costs one comparison. Timer
+ * counts are small (one per sleeping or timed-waiting process), which keeps
+ * the sorted insert cheaper than a wheel would be here.
+ *
+ * With the LAPIC one-shot timer the head's deadline is what the timer is
+ * armed for; with the PIT fallback the list is checked on every tick.
+ * Deadlines are 64-bit nanoseconds and never wrap.
+ * ========================================================================== */
+
+#include "timer.h"
+
+#include "clock.h"
+#include "lapic.h"
+#include "spinlock.h"
+
+static struct timer *timer_list;
+
+void timer_setup(struct timer *timer, timer_fn_t fn, void *arg)
+{
+    if (timer == 0) {
+        return;
+    }
+
+    timer->next = 0;
+    timer->expires = 0U;
+    timer->fn = fn;
+    timer->arg = arg;
+    timer->pending = 0U;
+}
+
+static void timer_unlink(struct timer *timer)
+{
+    struct timer **link = &timer_list;
+
+    while (*link != 0 && *link != timer) {
+        link = &(*link)->next;
+    }
+    if (*link == timer) {
+        *link = timer->next;
+    }
+
+    timer->next = 0;
+    timer->pending = 0U;
+}
+
+void timer_add(struct timer *timer, uint64_t delay_ns)
+{
+    struct timer **link = &timer_list;
+    uint64_t now;
+    uint64_t slack;
+    uint32_t irq_flags;
+
+    if (timer == 0 || timer->fn == 0) {
+        return;
+    }
+
+    irq_flags = spinlock_irq_save();
+    if (timer->pending != 0U) {
+        timer_unlink(timer);
+    }
+
+    /* A coarse clock may be most of a step past its last reading; never
+     * end a sleep early */
+    now = clock_monotonic_ns();
+    slack = clock_resolution_ns();
+    if (delay_ns > 0xFFFFFFFFFFFFFFFFULL - now - slack) {
+        timer->expires = 0xFFFFFFFFFFFFFFFFULL;
+    } else {
+        timer->expires = now + delay_ns + slack;
+    }
+
+    /* After any timer due at the same time: equal deadlines fire FIFO */
+    while (*link != 0 && (*link)->expires <= timer->expires) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    timer->pending = 1U;
+
+    /* A new earliest deadline must not wait for the next scheduler tick */
+    if (timer_list == timer) {
+        lapic_timer_reprogram();
+    }
+    spinlock_irq_restore(irq_flags);
+}
+
+uint8_t timer_cancel(struct timer *timer)
+{
+    uint32_t irq_flags;
+    uint8_t was_pending;
+
+    if (timer == 0) {
+        return 0U;
+    }
+
+    irq_flags = spinlock_irq_save();
+    was_pending = timer->pending;
+    if (was_pending != 0U) {
+        timer_unlink(timer);
+    }
+    spinlock_irq_restore(irq_flags);
+
+    return was_pending;
+}
+
+void timer_run_expired(void)
+{
+    uint64_t now = clock_monotonic_ns();
+
+    while (timer_list != 0 && timer_list->expires <= now) {
+        struct timer *timer = timer_list;
+
+        timer_list = timer->next;
+        timer->next = 0;
+        timer->pending = 0U;
+        timer->fn(timer->arg);
+    }
+}
+
+int timer_next_deadline(uint64_t *deadline)
+{
+    if (timer_list == 0) {
+        return -1;
+    }
+
+    *deadline = timer_list->expires;
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef CLAUDE_TIMER_H
+#define CLAUDE_TIMER_H
+
+#include <stdint.h>
+
+/* Callback run from timer interrupt context, with IRQs off, when a timer
+ * expires. */
+typedef void (*timer_fn_t)(void *arg);
+
+/* One-shot kernel timer. Callers embed it in their own objects; the list
+ * links through 'next', so arming never allocates. */
+struct timer {
+    struct timer *next;
+    uint64_t expires;   /* clock_monotonic_ns() deadline */
+    timer_fn_t fn;
+    void *arg;
+    uint8_t pending;
+};
+
+/* Prepare an idle timer that will call fn(arg). */
+void timer_setup(struct timer *timer, timer_fn_t fn, void *arg);
+
+/* Arm 'timer' to fire once at least 'delay_ns' nanoseconds have passed.
+ * With the LAPIC timer it fires at that deadline; with the PIT fallback on
+ * the first tick after it. A pending timer is re-armed. */
+void timer_add(struct timer *timer, uint64_t delay_ns);
+
+/* Disarm 'timer'. Returns 1 if it was pending, 0 if it had already fired
+ * or was never armed. */
+uint8_t timer_cancel(struct timer *timer);
+
+/* Run every expired timer. Called with IRQs off by the LAPIC timer
+ * interrupt, or by the PIT handler on each tick. */
+void timer_run_expired(void);
+
+/* Store the earliest pending deadline in *deadline and return 0, or return
+ * -1 when no timer is armed. IRQs must be off. */
+int timer_next_deadline(uint64_t *deadline);
+
+#endif /* CLAUDE_TIMER_H */
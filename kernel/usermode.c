@@ -132,6 +132,39 @@ void usermode_enter_ring3(uint32_t entry_eip, uint32_t user_esp)
     }
 }
 
+void usermode_resume_ring3(const struct isr_regs *regs, uint32_t user_esp,
+                           uint32_t user_ss)
+{
+    struct {
+        struct isr_regs regs;
+        uint32_t user_esp;
+        uint32_t user_ss;
+    } frame;
+
+    frame.regs = *regs;
+    frame.user_esp = user_esp;
+    frame.user_ss = user_ss;
+
+    /* Same unwind as the ISR common stub, from a frame on this stack */
+    __asm__ volatile (
+        "cli\n\t"
+        "mov %[frame], %%esp\n\t"
+        "pop %%gs\n\t"
+        "pop %%fs\n\t"
+        "pop %%es\n\t"
+        "pop %%ds\n\t"
+        "popa\n\t"
+        "add $8, %%esp\n\t"
+        "iret\n\t"
+        :
+        : [frame] "r"(&frame)
+        : "memory");
+
+    for (;;) {
+        __asm__ volatile ("hlt");
+    }
+}
+
 void usermode_run_ring3_test(void)
 {
     if (usermode_prepare_ring3_test() != 0) {
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "isr.h"
+
 #define USER_CS_SELECTOR       0x20U
 #define USER_DS_SELECTOR       0x28U
 #define USER_CS_SELECTOR_R3    (USER_CS_SELECTOR | 0x3U)
@@ -20,4 +22,12 @@ void usermode_run_ring3_test(void);
 void usermode_enter_ring3(uint32_t entry_eip, uint32_t user_esp)
     __attribute__((noreturn));
 
+/*
+ * Return to ring 3 with the exact register state in regs (e.g. a copy of
+ * the parent's INT 0x80 frame for a forked child). user_esp/user_ss are
+ * the CPU-pushed words that follow the frame on a privilege change.
+ */
+void usermode_resume_ring3(const struct isr_regs *regs, uint32_t user_esp,
+                           uint32_t user_ss) __attribute__((noreturn));
+
 #endif /* CLAUDE_USERMODE_H */
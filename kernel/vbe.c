@@ -59,13 +59,37 @@ static void serial_put_hex32(uint32_t value)
     }
 }
 
+/* With PSE and a 4MB-aligned aperture the mapping is rounded up to whole
+ * 4MB pages: one TLB entry per 4MB instead of 1024. The LFB sits in a PCI
+ * memory BAR, so the extra tail only exposes more of the same aperture. */
+static int vbe_map_framebuffer_large(uint32_t fb_phys, uint32_t map_bytes)
+{
+    uint32_t large_count = (map_bytes + LARGE_PAGE_SIZE - 1U) / LARGE_PAGE_SIZE;
+
+    if (paging_large_pages_enabled() == 0 || (fb_phys & ~LARGE_PAGE_MASK) != 0U ||
+        large_count * LARGE_PAGE_SIZE > VBE_LFB_VIRT_MAX_BYTES) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < large_count; i++) {
+        if (paging_map_large(VBE_LFB_VIRT_BASE + (i * LARGE_PAGE_SIZE),
+                             fb_phys + (i * LARGE_PAGE_SIZE), PAGE_WRITABLE) != 0) {
+            for (uint32_t j = 0; j < i; j++) {
+                (void)paging_unmap_large(VBE_LFB_VIRT_BASE + (j * LARGE_PAGE_SIZE));
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int vbe_map_framebuffer(uint32_t fb_phys, uint32_t fb_size, uint32_t *fb_virt_out)
 {
     uint32_t phys_base;
     uint32_t phys_offset;
     uint32_t map_bytes;
     uint32_t page_count;
-    uint32_t mapped_pages = 0U;
 
     if (fb_virt_out == 0 || fb_size == 0U) {
         return -1;
@@ -83,19 +107,16 @@ static int vbe_map_framebuffer(uint32_t fb_phys, uint32_t fb_size, uint32_t *fb_
         return -1;
     }
 
-    page_count = (map_bytes + PAGE_SIZE - 1U) / PAGE_SIZE;
+    if (vbe_map_framebuffer_large(phys_base, map_bytes) == 0) {
+        *fb_virt_out = VBE_LFB_VIRT_BASE + phys_offset;
+        return 0;
+    }
 
-    for (uint32_t i = 0; i < page_count; i++) {
-        uint32_t virt_page = VBE_LFB_VIRT_BASE + (i * PAGE_SIZE);
-        uint32_t phys_page = phys_base + (i * PAGE_SIZE);
+    page_count = (map_bytes + PAGE_SIZE - 1U) / PAGE_SIZE;
 
-        if (paging_map_page(virt_page, phys_page, PAGE_WRITABLE) != 0) {
-            for (uint32_t j = 0; j < mapped_pages; j++) {
-                (void)paging_unmap_page(VBE_LFB_VIRT_BASE + (j * PAGE_SIZE));
-            }
-            return -1;
-        }
-        mapped_pages++;
+    if (paging_map_range(VBE_LFB_VIRT_BASE, phys_base, page_count * PAGE_SIZE,
+                         PAGE_WRITABLE) != 0) {
+        return -1;
     }
 
     *fb_virt_out = VBE_LFB_VIRT_BASE + phys_offset;
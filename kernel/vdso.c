@@ -0,0 +1,108 @@
+/* ==========================================================================
+ * ClaudeOS Shared Kernel Data Page
+ * ==========================================================================
+ * One pinned frame, written by the kernel through its vmalloc mapping and
+ * mapped read-only at VDSO_USER_VA in every user address space. The libc
+ * reads time and its own PID from it without an INT 0x80 round trip.
+ *
+ * Updates are bracketed by a sequence counter (odd while a write is in
+ * progress). The only writers run with IRQs off on this single CPU, so the
+ * counter only protects readers that get preempted mid-read.
+ *
+ * The PID field holds whichever process is running: the scheduler rewrites
+ * it on every switch, so each reader sees its own.
+ * ========================================================================== */
+
+#include "vdso.h"
+
+#include "clock.h"
+#include "paging.h"
+#include "pit.h"
+#include "pmm.h"
+#include "serial.h"
+#include "vmalloc.h"
+
+static struct vdso_data *vdso_page;
+static uint32_t vdso_phys;
+
+static inline void vdso_write_begin(void)
+{
+    vdso_page->seq++;
+    __asm__ volatile ("" : : : "memory");
+}
+
+static inline void vdso_write_end(void)
+{
+    __asm__ volatile ("" : : : "memory");
+    vdso_page->seq++;
+}
+
+void vdso_init(void)
+{
+    uint8_t *page = (uint8_t *)vmalloc(PAGE_SIZE);
+    uint64_t tsc_base;
+    uint32_t tsc_mult;
+
+    if (page == 0) {
+        serial_puts("[VDSO] no memory for the data page\n");
+        return;
+    }
+
+    for (uint32_t i = 0U; i < PAGE_SIZE; i++) {
+        page[i] = 0U;
+    }
+
+    /* Pinned like the zero page, so user unmaps never free it */
+    vdso_phys = paging_get_phys_addr((uint32_t)(uintptr_t)page);
+    if (vdso_phys == 0U || pmm_pin_frame(vdso_phys) != 0) {
+        vfree(page);
+        vdso_phys = 0U;
+        serial_puts("[VDSO] failed to pin the data page\n");
+        return;
+    }
+
+    clock_get_tsc_params(&tsc_base, &tsc_mult);
+
+    vdso_page = (struct vdso_data *)page;
+    vdso_page->ticks = pit_get_ticks();
+    vdso_page->tick_hz = PIT_TARGET_FREQ;
+    vdso_page->tsc_khz = clock_tsc_khz();
+    vdso_page->tsc_mult = tsc_mult;
+    vdso_page->tsc_shift = CLOCK_TSC_SHIFT;
+    vdso_page->tsc_base_lo = (uint32_t)tsc_base;
+    vdso_page->tsc_base_hi = (uint32_t)(tsc_base >> 32);
+
+    serial_puts("[VDSO] data page ready\n");
+}
+
+int vdso_map_current(void)
+{
+    if (vdso_page == 0) {
+        return -1;
+    }
+
+    /* Pinned, so the mapping needs no reference of its own */
+    return paging_map_page(VDSO_USER_VA, vdso_phys, PAGE_USER);
+}
+
+void vdso_update_ticks(uint32_t ticks)
+{
+    if (vdso_page == 0) {
+        return;
+    }
+
+    vdso_write_begin();
+    vdso_page->ticks = ticks;
+    vdso_write_end();
+}
+
+void vdso_set_pid(uint32_t pid)
+{
+    if (vdso_page == 0) {
+        return;
+    }
+
+    vdso_write_begin();
+    vdso_page->pid = pid;
+    vdso_write_end();
+}
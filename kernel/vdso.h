@@ -0,0 +1,36 @@
+#ifndef CLAUDE_VDSO_H
+#define CLAUDE_VDSO_H
+
+#include <stdint.h>
+
+/* User address of the shared read-only data page (above the stack, below
+ * the kernel split; outside the mmap window) */
+#define VDSO_USER_VA        0xBFFFF000U
+
+/* Layout shared with the user libc (user/libc/syscall.c mirrors it).
+ * Readers retry while 'seq' is odd or changed under them. */
+struct vdso_data {
+    volatile uint32_t seq;
+    uint32_t ticks;         /* PIT ticks since boot */
+    uint32_t tick_hz;
+    uint32_t tsc_khz;       /* 0: no TSC clock, use ticks */
+    uint32_t tsc_mult;      /* ns = ((tsc - base) * mult) >> tsc_shift */
+    uint32_t tsc_shift;
+    uint32_t tsc_base_lo;
+    uint32_t tsc_base_hi;
+    uint32_t pid;           /* PID of the running process */
+};
+
+/* Allocate and fill the data page. Call after clock_init() and
+ * vmalloc_init(). */
+void vdso_init(void);
+
+/* Map the page read-only at VDSO_USER_VA in the current address space.
+ * The libc relies on it, so exec fails without it. Returns 0 or -1. */
+int vdso_map_current(void);
+
+/* Writers: the tick handler (PIT or LAPIC) and the scheduler (IRQs off). */
+void vdso_update_ticks(uint32_t ticks);
+void vdso_set_pid(uint32_t pid);
+
+#endif /* CLAUDE_VDSO_H */
@@ -38,7 +38,8 @@ static int32_t vfs_empty_lookup(const struct vfs_node *dir, const char *name,
 static const struct vfs_node_ops vfs_empty_dir_ops = {
     .lookup = vfs_empty_lookup,
     .read = 0,
-    .write = 0
+    .write = 0,
+    .map_page = 0
 };
 
 static int32_t vfs_canonicalize_path(const char *input, char *output,
@@ -469,39 +470,49 @@ int32_t vfs_open(const char *path, uint32_t flags)
     return VFS_ERR_NO_SPACE;
 }
 
-int32_t vfs_read(int32_t fd, void *buffer, uint32_t size)
+/* Look up an open descriptor the caller may read from; vfs_lock held */
+static int32_t vfs_readable_file_locked(int32_t fd, uint32_t caller_pid,
+                                        struct vfs_open_file **file_out)
 {
-    int32_t idx;
-    uint32_t irq_flags;
-    uint32_t caller_pid;
+    int32_t idx = vfs_fd_to_index(fd);
     struct vfs_open_file *file;
-    int32_t bytes_read;
-
-    if (buffer == 0 && size != 0U) {
-        return VFS_ERR_INVALID;
-    }
 
-    idx = vfs_fd_to_index(fd);
     if (idx < 0) {
         return VFS_ERR_BAD_FD;
     }
 
-    caller_pid = process_get_current_pid();
-    irq_flags = spinlock_lock_irqsave(&vfs_lock);
     file = &vfs_open_files[(uint32_t)idx];
     if (file->in_use == 0U) {
-        spinlock_unlock_irqrestore(&vfs_lock, irq_flags);
         return VFS_ERR_BAD_FD;
     }
 
-    if (vfs_owner_allows_access(file, caller_pid) == 0U) {
-        spinlock_unlock_irqrestore(&vfs_lock, irq_flags);
+    if (vfs_owner_allows_access(file, caller_pid) == 0U ||
+        (file->flags & VFS_OPEN_READ) == 0U) {
         return VFS_ERR_ACCESS;
     }
 
-    if ((file->flags & VFS_OPEN_READ) == 0U) {
+    *file_out = file;
+    return VFS_OK;
+}
+
+int32_t vfs_read(int32_t fd, void *buffer, uint32_t size)
+{
+    uint32_t irq_flags;
+    uint32_t caller_pid;
+    struct vfs_open_file *file;
+    int32_t bytes_read;
+    int32_t rc;
+
+    if (buffer == 0 && size != 0U) {
+        return VFS_ERR_INVALID;
+    }
+
+    caller_pid = process_get_current_pid();
+    irq_flags = spinlock_lock_irqsave(&vfs_lock);
+    rc = vfs_readable_file_locked(fd, caller_pid, &file);
+    if (rc != VFS_OK) {
         spinlock_unlock_irqrestore(&vfs_lock, irq_flags);
-        return VFS_ERR_ACCESS;
+        return rc;
     }
 
     if (file->node.ops == 0 || file->node.ops->read == 0) {
@@ -523,6 +534,54 @@ int32_t vfs_read(int32_t fd, void *buffer, uint32_t size)
     return bytes_read;
 }
 
+int32_t vfs_pread(int32_t fd, uint32_t offset, void *buffer, uint32_t size)
+{
+    uint32_t irq_flags;
+    struct vfs_open_file *file;
+    int32_t rc;
+
+    if (buffer == 0 && size != 0U) {
+        return VFS_ERR_INVALID;
+    }
+
+    irq_flags = spinlock_lock_irqsave(&vfs_lock);
+    rc = vfs_readable_file_locked(fd, process_get_current_pid(), &file);
+    if (rc == VFS_OK) {
+        if (file->node.ops == 0 || file->node.ops->read == 0) {
+            rc = VFS_ERR_NOT_SUPPORTED;
+        } else {
+            rc = file->node.ops->read(&file->node, offset, (uint8_t *)buffer, size);
+        }
+    }
+    spinlock_unlock_irqrestore(&vfs_lock, irq_flags);
+
+    return rc;
+}
+
+int32_t vfs_map_page(int32_t fd, uint32_t offset, uint32_t *phys_out)
+{
+    uint32_t irq_flags;
+    struct vfs_open_file *file;
+    int32_t rc;
+
+    if (phys_out == 0) {
+        return VFS_ERR_INVALID;
+    }
+
+    irq_flags = spinlock_lock_irqsave(&vfs_lock);
+    rc = vfs_readable_file_locked(fd, process_get_current_pid(), &file);
+    if (rc == VFS_OK) {
+        if (file->node.ops == 0 || file->node.ops->map_page == 0) {
+            rc = VFS_ERR_NOT_SUPPORTED;
+        } else {
+            rc = file->node.ops->map_page(&file->node, offset, phys_out);
+        }
+    }
+    spinlock_unlock_irqrestore(&vfs_lock, irq_flags);
+
+    return rc;
+}
+
 int32_t vfs_write(int32_t fd, const void *buffer, uint32_t size)
 {
     int32_t idx;
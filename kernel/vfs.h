@@ -42,6 +42,11 @@ struct vfs_node_ops {
                     uint8_t *buffer, uint32_t size);
     int32_t (*write)(const struct vfs_node *node, uint32_t offset,
                      const uint8_t *buffer, uint32_t size);
+    /* Optional: physical address of a page holding file bytes
+     * [offset, offset + 4KB) that may be mapped read-only in place.
+     * Filesystems whose data does not sit in memory leave this 0. */
+    int32_t (*map_page)(const struct vfs_node *node, uint32_t offset,
+                        uint32_t *phys_out);
 };
 
 struct vfs_node {
@@ -67,6 +72,14 @@ int32_t vfs_open(const char *path, uint32_t flags);
 int32_t vfs_read(int32_t fd, void *buffer, uint32_t size);
 int32_t vfs_write(int32_t fd, const void *buffer, uint32_t size);
 int32_t vfs_seek(int32_t fd, int32_t offset, uint32_t whence);
+
+/* Read at an absolute offset without moving the descriptor position. */
+int32_t vfs_pread(int32_t fd, uint32_t offset, void *buffer, uint32_t size);
+
+/* Ask the filesystem for an in-place mappable page of a readable file
+ * (see vfs_node_ops.map_page). Returns VFS_OK or VFS_ERR_NOT_SUPPORTED
+ * when the page has to be copied instead. */
+int32_t vfs_map_page(int32_t fd, uint32_t offset, uint32_t *phys_out);
 int32_t vfs_close(int32_t fd);
 
 /* Close all open descriptors owned by the given process id. */
@@ -0,0 +1,421 @@
+/* ==========================================================================
+ * ClaudeOS Virtual Memory Areas
+ * ==========================================================================
+ * Every user address space carries a small set of areas describing what may
+ * live in its lower 3GB: ELF image segments, the heap, the stack and
+ * anonymous mappings. The page tables say what is mapped right now; the
+ * areas say what is allowed to be, and how a missing page gets filled.
+ *
+ * Areas are kept in an array sorted by address and never overlap, so a
+ * lookup is a binary search over the area end addresses. Sets are small
+ * (a handful of entries per process), which keeps insert and remove, a
+ * memmove of a few dozen bytes, cheaper than rebalancing a tree. The array
+ * starts inside the set and moves to the kernel heap, doubling, when a
+ * process outgrows it; touching areas with identical flags are always
+ * merged, so mprotect churn does not leave fragments behind.
+ *
+ * One lock covers all sets; callers copy areas out instead of holding
+ * pointers into a set.
+ * ========================================================================== */
+
+#include "vma.h"
+#include "heap.h"
+#include "paging.h"
+#include "serial.h"
+#include "slab.h"
+#include "spinlock.h"
+
+#include <stdint.h>
+
+struct vma_space {
+    uint32_t count;
+    uint32_t capacity;
+    struct vma *areas;      /* inline_areas, or a kmalloc'd array */
+    struct vma inline_areas[VMA_INLINE_AREAS];
+};
+
+static struct kmem_cache *vma_space_cache;
+static struct spinlock vma_lock = SPINLOCK_INITIALIZER;
+
+/* Index of the first area ending above 'addr' (count when there is none) */
+static uint32_t vma_lower_bound(const struct vma_space *space, uint32_t addr)
+{
+    uint32_t lo = 0U;
+    uint32_t hi = space->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2U;
+
+        if (space->areas[mid].end <= addr) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void vma_remove_slots(struct vma_space *space, uint32_t first, uint32_t last)
+{
+    uint32_t removed = last - first;
+
+    for (uint32_t i = last; i < space->count; i++) {
+        space->areas[i - removed] = space->areas[i];
+    }
+    space->count -= removed;
+}
+
+static void vma_insert_slot(struct vma_space *space, uint32_t index, const struct vma *area)
+{
+    for (uint32_t i = space->count; i > index; i--) {
+        space->areas[i] = space->areas[i - 1U];
+    }
+    space->areas[index] = *area;
+    space->count++;
+}
+
+/* Make room for 'needed' areas. Returns 0, or -1 with the set unchanged. */
+static int vma_reserve(struct vma_space *space, uint32_t needed)
+{
+    uint32_t capacity = space->capacity;
+    struct vma *areas;
+
+    if (needed <= capacity) {
+        return 0;
+    }
+
+    while (capacity < needed) {
+        capacity *= 2U;
+    }
+
+    areas = (struct vma *)kmalloc(capacity * (uint32_t)sizeof(struct vma));
+    if (areas == 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < space->count; i++) {
+        areas[i] = space->areas[i];
+    }
+    if (space->areas != space->inline_areas) {
+        kfree(space->areas);
+    }
+    space->areas = areas;
+    space->capacity = capacity;
+    return 0;
+}
+
+/* Fold every touching pair with identical flags among areas first - 1 ..
+ * last (the ones a change may have made mergeable) */
+static void vma_merge_range(struct vma_space *space, uint32_t first, uint32_t last)
+{
+    uint32_t i = (first > 0U) ? first - 1U : 0U;
+
+    while (i < last && i + 1U < space->count) {
+        if (space->areas[i].end == space->areas[i + 1U].start &&
+            space->areas[i].flags == space->areas[i + 1U].flags) {
+            space->areas[i].end = space->areas[i + 1U].end;
+            vma_remove_slots(space, i + 1U, i + 2U);
+            last--;
+        } else {
+            i++;
+        }
+    }
+}
+
+static int vma_range_valid(uint32_t start, uint32_t end)
+{
+    return start < end &&
+           (start & (PAGE_SIZE - 1U)) == 0U &&
+           (end & (PAGE_SIZE - 1U)) == 0U;
+}
+
+void vma_init(void)
+{
+    spinlock_init(&vma_lock);
+
+    vma_space_cache = kmem_cache_create("vma_space", sizeof(struct vma_space), 0);
+    if (vma_space_cache == 0) {
+        serial_puts("[VMA] Failed to create area cache\n");
+    }
+}
+
+struct vma_space *vma_space_create(void)
+{
+    struct vma_space *space;
+
+    if (vma_space_cache == 0) {
+        return 0;
+    }
+
+    space = (struct vma_space *)kmem_cache_alloc(vma_space_cache);
+    if (space != 0) {
+        space->count = 0U;
+        space->capacity = VMA_INLINE_AREAS;
+        space->areas = space->inline_areas;
+    }
+    return space;
+}
+
+struct vma_space *vma_space_clone(const struct vma_space *src)
+{
+    struct vma_space *space = vma_space_create();
+    uint32_t flags;
+
+    if (space == 0 || src == 0) {
+        return space;
+    }
+
+    flags = spinlock_lock_irqsave(&vma_lock);
+    if (vma_reserve(space, src->count) != 0) {
+        spinlock_unlock_irqrestore(&vma_lock, flags);
+        vma_space_destroy(space);
+        return 0;
+    }
+    space->count = src->count;
+    for (uint32_t i = 0; i < src->count; i++) {
+        space->areas[i] = src->areas[i];
+    }
+    spinlock_unlock_irqrestore(&vma_lock, flags);
+
+    return space;
+}
+
+void vma_space_destroy(struct vma_space *space)
+{
+    if (space != 0) {
+        if (space->areas != space->inline_areas) {
+            kfree(space->areas);
+        }
+        kmem_cache_free(vma_space_cache, space);
+    }
+}
+
+int vma_find(const struct vma_space *space, uint32_t addr, struct vma *out)
+{
+    uint32_t flags;
+    uint32_t index;
+    int rc = -1;
+
+    if (space == 0 || out == 0) {
+        return -1;
+    }
+
+    flags = spinlock_lock_irqsave(&vma_lock);
+    index = vma_lower_bound(space, addr);
+    if (index < space->count && space->areas[index].start <= addr) {
+        *out = space->areas[index];
+        rc = 0;
+    }
+    spinlock_unlock_irqrestore(&vma_lock, flags);
+
+    return rc;
+}
+
+int vma_map(struct vma_space *space, uint32_t start, uint32_t end, uint32_t flags)
+{
+    struct vma area;
+    uint32_t irq_flags;
+    uint32_t index;
+    uint8_t merge_prev;
+    uint8_t merge_next;
+    int rc = 0;
+
+    if (space == 0 || vma_range_valid(start, end) == 0) {
+        return -1;
+    }
+
+    irq_flags = spinlock_lock_irqsave(&vma_lock);
+    index = vma_lower_bound(space, start);
+
+    if (index < space->count && space->areas[index].start < end) {
+        spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+        return -1;
+    }
+
+    merge_prev = (uint8_t)(index > 0U && space->areas[index - 1U].end == start &&
+                           space->areas[index - 1U].flags == flags);
+    merge_next = (uint8_t)(index < space->count && space->areas[index].start == end &&
+                           space->areas[index].flags == flags);
+
+    if (merge_prev != 0U && merge_next != 0U) {
+        space->areas[index - 1U].end = space->areas[index].end;
+        vma_remove_slots(space, index, index + 1U);
+    } else if (merge_prev != 0U) {
+        space->areas[index - 1U].end = end;
+    } else if (merge_next != 0U) {
+        space->areas[index].start = start;
+    } else if (vma_reserve(space, space->count + 1U) == 0) {
+        area.start = start;
+        area.end = end;
+        area.flags = flags;
+        vma_insert_slot(space, index, &area);
+    } else {
+        rc = -1;
+    }
+
+    spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+    return rc;
+}
+
+int vma_unmap(struct vma_space *space, uint32_t start, uint32_t end)
+{
+    uint32_t irq_flags;
+    uint32_t index;
+    uint32_t first;
+
+    if (space == 0 || vma_range_valid(start, end) == 0) {
+        return -1;
+    }
+
+    irq_flags = spinlock_lock_irqsave(&vma_lock);
+    index = vma_lower_bound(space, start);
+
+    /* Hole punched in the middle of one area: split it in two */
+    if (index < space->count && space->areas[index].start < start &&
+        space->areas[index].end > end) {
+        struct vma tail = space->areas[index];
+
+        if (vma_reserve(space, space->count + 1U) != 0) {
+            spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+            return -1;
+        }
+
+        tail.start = end;
+        space->areas[index].end = start;
+        vma_insert_slot(space, index + 1U, &tail);
+        spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+        return 0;
+    }
+
+    if (index < space->count && space->areas[index].start < start) {
+        space->areas[index].end = start;
+        index++;
+    }
+
+    first = index;
+    while (index < space->count && space->areas[index].end <= end) {
+        index++;
+    }
+
+    if (index < space->count && space->areas[index].start < end) {
+        space->areas[index].start = end;
+    }
+
+    vma_remove_slots(space, first, index);
+    spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+    return 0;
+}
+
+int vma_find_gap(const struct vma_space *space, uint32_t lo, uint32_t hi,
+                 uint32_t size, uint32_t *start_out)
+{
+    uint32_t flags;
+    uint32_t cursor = lo;
+    int rc = -1;
+
+    if (space == 0 || start_out == 0 || size == 0U || lo >= hi) {
+        return -1;
+    }
+
+    flags = spinlock_lock_irqsave(&vma_lock);
+    for (uint32_t i = vma_lower_bound(space, lo); i <= space->count; i++) {
+        uint32_t limit = (i < space->count && space->areas[i].start < hi) ?
+                         space->areas[i].start : hi;
+
+        if (limit > cursor && limit - cursor >= size) {
+            *start_out = cursor;
+            rc = 0;
+            break;
+        }
+
+        if (i == space->count || space->areas[i].start >= hi) {
+            break;
+        }
+        cursor = space->areas[i].end;
+    }
+    spinlock_unlock_irqrestore(&vma_lock, flags);
+
+    return rc;
+}
+
+int vma_protect(struct vma_space *space, uint32_t start, uint32_t end, uint32_t prot)
+{
+    uint32_t irq_flags;
+    uint32_t first;
+    uint32_t last;
+    uint32_t needed = 0U;
+    uint32_t cursor = start;
+
+    if (space == 0 || vma_range_valid(start, end) == 0 || (prot & ~VMA_PROT_MASK) != 0U) {
+        return -1;
+    }
+
+    irq_flags = spinlock_lock_irqsave(&vma_lock);
+
+    /* Check coverage and permissions before changing anything */
+    first = vma_lower_bound(space, start);
+    for (last = first; last < space->count && cursor < end; last++) {
+        if (space->areas[last].start > cursor ||
+            ((space->areas[last].flags & VMA_TYPE_FILE) != 0U && (prot & VMA_WRITE) != 0U)) {
+            break;
+        }
+        cursor = space->areas[last].end;
+    }
+
+    if (cursor < end) {
+        spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+        return -1;
+    }
+
+    /* Edges inside an area split it */
+    needed += (space->areas[first].start < start) ? 1U : 0U;
+    needed += (space->areas[last - 1U].end > end) ? 1U : 0U;
+    if (vma_reserve(space, space->count + needed) != 0) {
+        spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+        return -1;
+    }
+
+    if (space->areas[first].start < start) {
+        struct vma tail = space->areas[first];
+
+        tail.start = start;
+        space->areas[first].end = start;
+        first++;
+        last++;
+        vma_insert_slot(space, first, &tail);
+    }
+
+    if (space->areas[last - 1U].end > end) {
+        struct vma tail = space->areas[last - 1U];
+
+        tail.start = end;
+        space->areas[last - 1U].end = end;
+        vma_insert_slot(space, last, &tail);
+    }
+
+    for (uint32_t i = first; i < last; i++) {
+        space->areas[i].flags = (space->areas[i].flags & ~VMA_PROT_MASK) | prot;
+    }
+
+    /* Undo splits that the new rights made pointless (e.g. mprotect back) */
+    vma_merge_range(space, first, last);
+
+    spinlock_unlock_irqrestore(&vma_lock, irq_flags);
+    return 0;
+}
+
+uint32_t vma_count(const struct vma_space *space)
+{
+    uint32_t flags;
+    uint32_t count;
+
+    if (space == 0) {
+        return 0U;
+    }
+
+    flags = spinlock_lock_irqsave(&vma_lock);
+    count = space->count;
+    spinlock_unlock_irqrestore(&vma_lock, flags);
+    return count;
+}
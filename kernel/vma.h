@@ -0,0 +1,75 @@
+#ifndef CLAUDE_VMA_H
+#define CLAUDE_VMA_H
+
+#include <stdint.h>
+
+/* Areas stored inside the set itself (image segments, heap, stack and a few
+ * mmaps); larger sets move to a kmalloc'd array that doubles as needed */
+#define VMA_INLINE_AREAS    16U
+
+/* Access rights */
+#define VMA_READ            0x01U
+#define VMA_WRITE           0x02U
+#define VMA_EXEC            0x04U
+#define VMA_PROT_MASK       0x07U
+
+/* Backing. IMAGE pages are populated by the ELF loader and FILE pages by
+ * mmap (read-only file mappings); the other types are anonymous memory,
+ * zero-filled on first touch by the fault handler. */
+#define VMA_TYPE_IMAGE      0x010U
+#define VMA_TYPE_HEAP       0x020U
+#define VMA_TYPE_STACK      0x040U
+#define VMA_TYPE_ANON       0x080U
+#define VMA_TYPE_FILE       0x100U
+#define VMA_TYPE_MASK       0x1F0U
+#define VMA_TYPE_POPULATED  (VMA_TYPE_IMAGE | VMA_TYPE_FILE)
+
+struct vma {
+    uint32_t start;     /* page aligned, inclusive */
+    uint32_t end;       /* page aligned, exclusive */
+    uint32_t flags;     /* VMA_READ/WRITE/EXEC | one VMA_TYPE_* */
+};
+
+/* Address-sorted, non-overlapping set of areas for one user address space */
+struct vma_space;
+
+/* Create the descriptor cache. Runs before the first process is set up. */
+void vma_init(void);
+
+/* Allocate an empty set, or a copy of 'src' for fork. Return 0 on failure. */
+struct vma_space *vma_space_create(void);
+struct vma_space *vma_space_clone(const struct vma_space *src);
+
+/* Release a set; 0 is ignored. Does not touch page tables. */
+void vma_space_destroy(struct vma_space *space);
+
+/* Binary-search the area containing 'addr' and copy it to 'out'.
+ * Returns 0 when found, -1 otherwise. */
+int vma_find(const struct vma_space *space, uint32_t addr, struct vma *out);
+
+/* Add [start, end) with 'flags'. Fails on misalignment, overlap with an
+ * existing area, or when the table cannot grow. Adjacent areas with
+ * identical flags are merged. Returns 0 or -1. */
+int vma_map(struct vma_space *space, uint32_t start, uint32_t end, uint32_t flags);
+
+/* Remove [start, end) from the set, trimming or splitting areas that cross
+ * its edges. Returns -1 only when a split needs a slot and the table cannot
+ * grow (the set is then unchanged). */
+int vma_unmap(struct vma_space *space, uint32_t start, uint32_t end);
+
+/* First-fit search for 'size' free bytes inside [lo, hi). Returns 0 and
+ * the start address, or -1 when no gap is large enough. */
+int vma_find_gap(const struct vma_space *space, uint32_t lo, uint32_t hi,
+                 uint32_t size, uint32_t *start_out);
+
+/* Replace the access rights of [start, end), splitting areas at the edges
+ * and merging the result with neighbours that end up with identical flags.
+ * The range must be fully covered by areas, FILE areas never become
+ * writable, and edge splits need room; otherwise -1 is returned and the set
+ * is unchanged. */
+int vma_protect(struct vma_space *space, uint32_t start, uint32_t end, uint32_t prot);
+
+/* Number of areas in the set (0 for a null set). */
+uint32_t vma_count(const struct vma_space *space);
+
+#endif /* CLAUDE_VMA_H */
@@ -0,0 +1,187 @@
+/* ==========================================================================
+ * ClaudeOS vmalloc Area
+ * ==========================================================================
+ * Large kernel buffers (ELF images, framebuffer back buffers) get their own
+ * 64MB virtual range instead of competing with small objects in the kmalloc
+ * heap. Each area is mapped page by page from whatever frames the PMM hands
+ * out, so physical fragmentation never blocks a large allocation.
+ *
+ * Areas are kept in a small address-sorted table and placed first-fit. Every
+ * area is followed by one unmapped guard page (and the range starts with
+ * one), so running off either end of a buffer faults instead of corrupting
+ * a neighbour.
+ *
+ * Page tables for the whole range are created by vmalloc_init() at boot.
+ * Process address spaces copy kernel PDEs when they are created, so PDEs
+ * added later would not be visible in existing processes.
+ * ========================================================================== */
+
+#include "vmalloc.h"
+#include "paging.h"
+#include "pmm.h"
+#include "serial.h"
+#include "spinlock.h"
+
+#include <stdint.h>
+
+struct vmalloc_area {
+    uint32_t start;
+    uint32_t pages;     /* mapped pages, excluding the trailing guard */
+};
+
+static struct vmalloc_area vmalloc_areas[VMALLOC_MAX_AREAS];
+static uint32_t vmalloc_area_count;
+static uint32_t vmalloc_ready;
+static struct spinlock vmalloc_lock = SPINLOCK_INITIALIZER;
+
+static void vmalloc_unmap_pages(uint32_t start, uint32_t pages)
+{
+    if (pages != 0U) {
+        (void)paging_unmap_range(start, pages * PAGE_SIZE, 1, 0);
+    }
+}
+
+/* Page count of the area starting at 'start', or 0 if there is none */
+static uint32_t vmalloc_area_pages(uint32_t start)
+{
+    uint32_t flags = spinlock_lock_irqsave(&vmalloc_lock);
+    uint32_t pages = 0U;
+
+    for (uint32_t i = 0; i < vmalloc_area_count; i++) {
+        if (vmalloc_areas[i].start == start) {
+            pages = vmalloc_areas[i].pages;
+            break;
+        }
+    }
+
+    spinlock_unlock_irqrestore(&vmalloc_lock, flags);
+    return pages;
+}
+
+/* Remove the area starting at 'start'; returns its page count or 0 */
+static uint32_t vmalloc_remove_area(uint32_t start)
+{
+    uint32_t flags = spinlock_lock_irqsave(&vmalloc_lock);
+    uint32_t pages = 0U;
+
+    for (uint32_t i = 0; i < vmalloc_area_count; i++) {
+        if (vmalloc_areas[i].start != start) {
+            continue;
+        }
+
+        pages = vmalloc_areas[i].pages;
+        for (uint32_t j = i; j + 1U < vmalloc_area_count; j++) {
+            vmalloc_areas[j] = vmalloc_areas[j + 1U];
+        }
+        vmalloc_area_count--;
+        break;
+    }
+
+    spinlock_unlock_irqrestore(&vmalloc_lock, flags);
+    return pages;
+}
+
+void vmalloc_init(void)
+{
+    spinlock_init(&vmalloc_lock);
+    vmalloc_area_count = 0U;
+    vmalloc_ready = 0U;
+
+    for (uint32_t va = VMALLOC_START; va < VMALLOC_END; va += 0x00400000U) {
+        if (paging_ensure_table(va, PAGE_WRITABLE) != 0) {
+            serial_puts("[VMALLOC] page table preallocation failed\n");
+            return;
+        }
+    }
+
+    vmalloc_ready = 1U;
+    serial_puts("[VMALLOC] initialized at 0xC4000000-0xC8000000\n");
+}
+
+void *vmalloc(size_t size)
+{
+    uint32_t pages;
+    uint32_t span;
+    uint32_t cursor;
+    uint32_t slot;
+    uint32_t flags;
+
+    if (size == 0U || size > (size_t)(VMALLOC_END - VMALLOC_START - 2U * PAGE_SIZE)) {
+        return 0;
+    }
+
+    pages = ((uint32_t)size + PAGE_SIZE - 1U) / PAGE_SIZE;
+    span = (pages + 1U) * PAGE_SIZE;   /* area plus trailing guard page */
+
+    flags = spinlock_lock_irqsave(&vmalloc_lock);
+    if (vmalloc_ready == 0U || vmalloc_area_count >= VMALLOC_MAX_AREAS) {
+        spinlock_unlock_irqrestore(&vmalloc_lock, flags);
+        return 0;
+    }
+
+    /* First fit between sorted areas; the leading page stays a guard */
+    cursor = VMALLOC_START + PAGE_SIZE;
+    for (slot = 0U; slot < vmalloc_area_count; slot++) {
+        if (vmalloc_areas[slot].start - cursor >= span) {
+            break;
+        }
+        cursor = vmalloc_areas[slot].start + (vmalloc_areas[slot].pages + 1U) * PAGE_SIZE;
+    }
+
+    if (slot == vmalloc_area_count && VMALLOC_END - cursor < span) {
+        spinlock_unlock_irqrestore(&vmalloc_lock, flags);
+        serial_puts("[VMALLOC] out of virtual space\n");
+        return 0;
+    }
+
+    for (uint32_t j = vmalloc_area_count; j > slot; j--) {
+        vmalloc_areas[j] = vmalloc_areas[j - 1U];
+    }
+    vmalloc_areas[slot].start = cursor;
+    vmalloc_areas[slot].pages = pages;
+    vmalloc_area_count++;
+    spinlock_unlock_irqrestore(&vmalloc_lock, flags);
+
+    /* The range is reserved; map it without holding the lock */
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t phys = pmm_alloc_frame();
+
+        if (phys == 0U || paging_map_page(cursor + i * PAGE_SIZE, phys, PAGE_WRITABLE) != 0) {
+            if (phys != 0U) {
+                pmm_free_frame(phys);
+            }
+            vmalloc_unmap_pages(cursor, i);
+            (void)vmalloc_remove_area(cursor);
+            serial_puts("[VMALLOC] out of physical frames\n");
+            return 0;
+        }
+    }
+
+    return (void *)(uintptr_t)cursor;
+}
+
+void vfree(void *ptr)
+{
+    uint32_t start = (uint32_t)(uintptr_t)ptr;
+    uint32_t pages;
+
+    if (ptr == 0) {
+        return;
+    }
+
+    if (start < VMALLOC_START || start >= VMALLOC_END || (start & (PAGE_SIZE - 1U)) != 0U) {
+        serial_puts("[VMALLOC] vfree of foreign pointer ignored\n");
+        return;
+    }
+
+    pages = vmalloc_area_pages(start);
+    if (pages == 0U) {
+        serial_puts("[VMALLOC] vfree of unknown area ignored\n");
+        return;
+    }
+
+    /* Unmap before releasing the range, or a concurrent vmalloc could be
+     * placed there and have its fresh pages torn down */
+    vmalloc_unmap_pages(start, pages);
+    (void)vmalloc_remove_area(start);
+}
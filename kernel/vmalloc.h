@@ -0,0 +1,23 @@
+#ifndef CLAUDE_VMALLOC_H
+#define CLAUDE_VMALLOC_H
+
+#include <stddef.h>
+
+/* Kernel virtual range for large, virtually contiguous allocations */
+#define VMALLOC_START       0xC4000000U
+#define VMALLOC_END         0xC8000000U
+#define VMALLOC_MAX_AREAS   64U
+
+/* Preallocate page tables for the vmalloc range. Must run before the first
+ * process address space is created so every address space shares them. */
+void vmalloc_init(void);
+
+/* Allocate 'size' bytes of page-granular, virtually contiguous kernel memory
+ * backed by scattered PMM frames. An unmapped guard page follows every area.
+ * Returns 0 on failure. */
+void *vmalloc(size_t size);
+
+/* Unmap and release an area returned by vmalloc(). */
+void vfree(void *ptr);
+
+#endif /* CLAUDE_VMALLOC_H */
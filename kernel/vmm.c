@@ -0,0 +1,885 @@
+/* ==========================================================================
+ * ClaudeOS Virtual Memory Fault Handling
+ * ==========================================================================
+ * Resolves recoverable page faults:
+ *
+ * Copy-on-write. Fork shares user frames read-only with PAGE_COW set, and
+ * the first write from either side lands here.
+ *   - frame still shared  -> copy it into a fresh frame, map that writable,
+ *                            drop one share of the old frame
+ *   - last owner          -> just make the existing mapping writable again
+ *
+ * Demand-zero anonymous memory. The heap, the stack and other anonymous
+ * areas of the process's VMA set are populated on first touch; sbrk only
+ * resizes the heap area. A read maps the pinned, shared zero frame
+ * read-only + PAGE_COW (or plain read-only in an area without write
+ * access), a write (or a later write to the zero frame) gets a private
+ * zeroed frame. When a whole 4MB-aligned chunk of the heap is reserved and
+ * still untouched, the first fault in it maps one zeroed 4MB page instead
+ * (PSE), so large heaps such as DOOM's zone cost one TLB entry per 4MB.
+ * The 4MB are zeroed with vmm_lock dropped and IRQs back on; only the
+ * faulting task can reach the chunk, and it is stuck in the fault.
+ * fork splits those back into 4KB pages.
+ *
+ * mmap. Anonymous mappings are ANON areas in the window above the heap and
+ * fill on demand like the heap. File mappings are read-only and populated
+ * up front: pages the filesystem can expose in place (initrd) are mapped
+ * directly, the rest are private copies. The area goes in first and the
+ * file is read with vmm_lock dropped, into kernel-only mappings the clock
+ * leaves alone. mprotect rewrites the areas and
+ * leaves anonymous pages read-only + PAGE_COW, so the first write after it
+ * comes back through here and is checked against the area.
+ *
+ * Swap. When a user page needs a frame and the PMM has none left, a clock
+ * sweeps the user page tables of every process (reached through the
+ * physmap): a privately owned page that was accessed since the last pass
+ * loses its accessed bit, one that was not is written to a swap slot and
+ * its PTE becomes a non-present swap entry. A fault on such an entry reads
+ * the page back into a fresh frame. Shared (COW), pinned and kernel-image
+ * frames and 4MB pages are never evicted. Fresh mappings start with the
+ * accessed bit set, so a page faulted in moments ago survives one pass.
+ *
+ * Disk I/O never runs under vmm_lock. Eviction picks the page and a slot
+ * under the lock, drops it for the write (IRQs back as the entering context
+ * had them), then retakes it and only installs the swap entry if the PTE is
+ * unchanged; swap-in rechecks its entry the same way before mapping.
+ *
+ * Copies go frame to frame through the physmap. Frames above it use a
+ * static bounce buffer instead; vmm_lock (taken with IRQs off) serializes
+ * its users, and none of them holds it across a drop.
+ * ========================================================================== */
+
+#include "vmm.h"
+#include "heap.h"
+#include "paging.h"
+#include "pmm.h"
+#include "process.h"
+#include "serial.h"
+#include "spinlock.h"
+#include "swap.h"
+#include "vmalloc.h"
+#include "vfs.h"
+#include "vma.h"
+
+#define VMM_USER_KERNEL_SPLIT   0xC0000000U
+#define VMM_CR0_WP              0x00010000U
+/* Pages evicted per reclaim call, so the next few allocations are cheap */
+#define VMM_RECLAIM_BATCH       16U
+
+static uint8_t vmm_copy_buffer[PAGE_SIZE];
+static uint32_t vmm_zero_phys;
+static struct spinlock vmm_lock = SPINLOCK_INITIALIZER;
+/* EFLAGS to run with while vmm_lock is dropped: the IF of the context that
+ * entered the VMM. Valid while vmm_lock is held. */
+static uint32_t vmm_unlocked_eflags;
+/* Clock hand: process PID and next user address in its space */
+static uint32_t vmm_clock_pid;
+static uint32_t vmm_clock_va;
+
+static inline uint32_t vmm_read_cr2(void)
+{
+    uint32_t value;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline uint32_t vmm_read_cr3(void)
+{
+    uint32_t value;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void vmm_invlpg(uint32_t virt_addr)
+{
+    __asm__ volatile ("invlpg (%0)" : : "r"(virt_addr) : "memory");
+}
+
+/* Take vmm_lock with IRQs off. 'regs' is the faulting context, or 0 for a
+ * syscall (which runs with the caller's IRQ state). */
+static uint32_t vmm_lock_enter(const struct isr_regs *regs)
+{
+    uint32_t flags = spinlock_lock_irqsave(&vmm_lock);
+
+    vmm_unlocked_eflags = (regs != 0) ? regs->eflags : flags;
+    return flags;
+}
+
+/* Let IRQs (and the scheduler) in around slow work. Anything read from the
+ * page tables before the gap must be checked again after it, and the
+ * bounce buffer must not be in use across it. */
+static uint32_t vmm_lock_drop(void)
+{
+    uint32_t eflags = vmm_unlocked_eflags;
+
+    spinlock_unlock(&vmm_lock);
+    spinlock_irq_restore(eflags);
+    return eflags;
+}
+
+static void vmm_lock_retake(uint32_t eflags)
+{
+    (void)spinlock_irq_save();
+    spinlock_lock(&vmm_lock);
+    vmm_unlocked_eflags = eflags;
+}
+
+static void vmm_copy_page(uint8_t *dst, const uint8_t *src)
+{
+    const uint32_t *s = (const uint32_t *)(const void *)src;
+    uint32_t *d = (uint32_t *)(void *)dst;
+
+    for (uint32_t i = 0; i < PAGE_SIZE / 4U; i++) {
+        d[i] = s[i];
+    }
+}
+
+static void vmm_zero_page(uint8_t *dst)
+{
+    uint32_t *d = (uint32_t *)(void *)dst;
+
+    for (uint32_t i = 0; i < PAGE_SIZE / 4U; i++) {
+        d[i] = 0U;
+    }
+}
+
+/* PTE of user page 'va' in the address space 'cr3' of process 'pid', reached
+ * through the physmap; 0 when the process, its space or the page table is
+ * gone (it may have exited while vmm_lock was dropped) */
+static uint32_t *vmm_space_pte(uint32_t pid, uint32_t cr3, uint32_t va)
+{
+    const struct process *proc = process_get_by_pid(pid);
+    const uint32_t *pd;
+    uint32_t *pt;
+    uint32_t pde;
+
+    if (proc == 0 || proc->cr3 != cr3 || proc->owns_address_space == 0U ||
+        proc->state == PROCESS_STATE_TERMINATED) {
+        return 0;
+    }
+
+    pd = (const uint32_t *)phys_to_virt(cr3 & PAGE_FRAME_MASK);
+    if (pd == 0) {
+        return 0;
+    }
+
+    pde = pd[va >> 22];
+    if ((pde & (PAGE_PRESENT | PAGE_USER | PAGE_LARGE)) != (PAGE_PRESENT | PAGE_USER)) {
+        return 0;
+    }
+
+    pt = (uint32_t *)phys_to_virt(pde & PAGE_FRAME_MASK);
+    if (pt == 0) {
+        return 0;
+    }
+
+    return pt + ((va >> 12) & 0x3FFU);
+}
+
+/* Advance the clock through one address space to the next page worth
+ * evicting: a present, privately owned user page in the physmap whose
+ * accessed bit is clear. Accessed bits passed on the way are cleared.
+ * Returns 0 with the page and its PTE (the hand moves past it), or -1 after
+ * the last page (the hand wraps to address 0). */
+static int vmm_clock_pick(uint32_t cr3, uint32_t *va_out, uint32_t *pte_out)
+{
+    const uint32_t *pd = (const uint32_t *)phys_to_virt(cr3 & PAGE_FRAME_MASK);
+    uint32_t current = ((vmm_read_cr3() & PAGE_FRAME_MASK) == (cr3 & PAGE_FRAME_MASK)) ? 1U : 0U;
+    uint32_t va = vmm_clock_va;
+
+    while (pd != 0 && va < VMM_USER_KERNEL_SPLIT) {
+        uint32_t pde = pd[va >> 22];
+        uint32_t *pt;
+
+        pt = ((pde & (PAGE_PRESENT | PAGE_USER | PAGE_LARGE)) == (PAGE_PRESENT | PAGE_USER)) ?
+             (uint32_t *)phys_to_virt(pde & PAGE_FRAME_MASK) : 0;
+        if (pt == 0) {
+            va = (va & LARGE_PAGE_MASK) + LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        for (uint32_t pti = (va >> 12) & 0x3FFU; pti < 1024U; pti++, va += PAGE_SIZE) {
+            uint32_t pte = pt[pti];
+            uint32_t phys = pte & PAGE_FRAME_MASK;
+
+            if ((pte & (PAGE_PRESENT | PAGE_USER)) != (PAGE_PRESENT | PAGE_USER) ||
+                phys == vmm_zero_phys || pmm_frame_is_private(phys) == 0 ||
+                phys_to_virt(phys) == 0) {
+                continue;
+            }
+
+            if ((pte & PAGE_ACCESSED) != 0U) {
+                pt[pti] = pte & ~PAGE_ACCESSED;
+                if (current != 0U) {
+                    vmm_invlpg(va);
+                }
+                continue;
+            }
+
+            vmm_clock_va = va + PAGE_SIZE;
+            *va_out = va;
+            *pte_out = pte;
+            return 0;
+        }
+    }
+
+    vmm_clock_va = 0U;
+    return -1;
+}
+
+/* Write a picked page to a fresh slot with vmm_lock dropped, then turn its
+ * PTE into a swap entry. The accessed bit was clear and no TLB holds the
+ * entry, so any use of the page during the write sets it again; the PTE
+ * must still be exactly 'pte' afterwards or the copy is thrown away.
+ * Returns 0 when the frame was freed. */
+static int vmm_swap_out(uint32_t pid, uint32_t cr3, uint32_t va, uint32_t pte)
+{
+    uint32_t phys = pte & PAGE_FRAME_MASK;
+    const void *data = phys_to_virt(phys);
+    uint32_t *entry;
+    uint32_t slot;
+    uint32_t eflags;
+    int rc;
+
+    slot = swap_alloc_slot();
+    if (slot == 0U) {
+        return -1;
+    }
+
+    eflags = vmm_lock_drop();
+    rc = swap_write_page(slot, data);
+    vmm_lock_retake(eflags);
+
+    entry = vmm_space_pte(pid, cr3, va);
+    if (rc != 0 || entry == 0 || *entry != pte) {
+        swap_free_slot(slot);
+        return -1;
+    }
+
+    *entry = swap_make_pte(slot, pte);
+    if ((vmm_read_cr3() & PAGE_FRAME_MASK) == (cr3 & PAGE_FRAME_MASK)) {
+        vmm_invlpg(va);
+    }
+    pmm_free_frame(phys);
+    return 0;
+}
+
+/* Evict up to 'want' user pages to swap. Two laps of the clock at most:
+ * the first may do nothing but clear accessed bits. Each write drops
+ * vmm_lock, so the process is looked up again for every page. */
+static uint32_t vmm_reclaim(uint32_t want)
+{
+    uint32_t freed = 0U;
+    uint32_t laps;
+
+    if (swap_enabled() == 0) {
+        return 0U;
+    }
+
+    laps = 2U * process_count();
+    for (uint32_t step = 0; step < laps && freed < want; ) {
+        const struct process *proc = process_get_by_pid(vmm_clock_pid);
+        uint32_t va;
+        uint32_t pte;
+
+        if (swap_free_slot_count() == 0U) {
+            break;
+        }
+
+        if (proc != 0 && proc->owns_address_space != 0U &&
+            proc->state != PROCESS_STATE_TERMINATED) {
+            if (vmm_clock_pick(proc->cr3, &va, &pte) == 0) {
+                if (vmm_swap_out(proc->pid, proc->cr3, va, pte) == 0) {
+                    freed++;
+                }
+                continue;
+            }
+        } else {
+            vmm_clock_va = 0U;
+        }
+
+        proc = process_next_after(vmm_clock_pid);
+        vmm_clock_pid = (proc != 0) ? proc->pid : 0U;
+        step++;
+    }
+
+    return freed;
+}
+
+/* Frame for a user page: when the PMM is dry, push cold pages to swap.
+ * That drops vmm_lock, so callers recheck what they read before. */
+static uint32_t vmm_alloc_frame(void)
+{
+    uint32_t phys = pmm_alloc_frame();
+
+    if (phys == 0U && vmm_reclaim(VMM_RECLAIM_BATCH) != 0U) {
+        phys = pmm_alloc_frame();
+    }
+    return phys;
+}
+
+/* Bring a swapped-out page back with the permissions it had. The read
+ * runs with vmm_lock dropped; if the entry changed meanwhile (an unmap)
+ * the frame is dropped and the access simply retries. */
+static int vmm_swap_in(uint32_t page, uint32_t entry)
+{
+    uint32_t slot = swap_pte_slot(entry);
+    uint32_t phys = vmm_alloc_frame();
+    uint8_t *data;
+    uint8_t *buffer;
+    uint32_t eflags;
+    int rc;
+
+    if (phys == 0U) {
+        serial_puts("[VMM] out of frames for swap-in\n");
+        return -1;
+    }
+
+    /* Read before mapping when the frame is in the physmap; otherwise into
+     * a private buffer (the static bounce buffer is not safe unlocked) */
+    data = (uint8_t *)phys_to_virt(phys);
+    buffer = (data != 0) ? data : (uint8_t *)kmalloc(PAGE_SIZE);
+    if (buffer == 0) {
+        pmm_free_frame(phys);
+        return -1;
+    }
+
+    eflags = vmm_lock_drop();
+    rc = swap_read_page(slot, buffer);
+    vmm_lock_retake(eflags);
+
+    if (rc == 0 && paging_get_entry(page) == entry) {
+        rc = paging_map_page(page, phys, PAGE_WRITABLE | PAGE_ACCESSED);
+        if (rc == 0 && data == 0) {
+            vmm_copy_page((uint8_t *)(uintptr_t)page, buffer);
+        }
+        if (rc == 0) {
+            swap_free_slot(slot);
+            rc = paging_protect_range(page, PAGE_SIZE, entry & SWAP_PTE_KEEP_FLAGS);
+        } else {
+            pmm_free_frame(phys);
+        }
+    } else if (rc == 0) {
+        pmm_free_frame(phys);
+    } else {
+        serial_puts("[VMM] swap read failed\n");
+        pmm_free_frame(phys);
+    }
+
+    if (data == 0) {
+        kfree(buffer);
+    }
+    return rc;
+}
+
+/* Find the anonymous area of the current process that covers 'page' */
+static int vmm_find_anon_area(uint32_t page, struct vma *area)
+{
+    const struct process *proc = process_get_current();
+
+    if (proc == 0 || vma_find(proc->vmas, page, area) != 0) {
+        return -1;
+    }
+
+    return (area->flags & VMA_TYPE_POPULATED) != 0U ? -1 : 0;
+}
+
+/* Writes are refused only inside an area without write access; pages
+ * outside any area keep the plain copy-on-write behaviour */
+static int vmm_write_allowed(uint32_t page)
+{
+    const struct process *proc = process_get_current();
+    struct vma area;
+
+    if (proc == 0 || vma_find(proc->vmas, page, &area) != 0) {
+        return 1;
+    }
+
+    return (area.flags & VMA_WRITE) != 0U;
+}
+
+/* Back a whole untouched 4MB heap chunk with one zeroed large page */
+static int vmm_demand_zero_large(uint32_t page, const struct vma *area)
+{
+    uint32_t chunk = page & LARGE_PAGE_MASK;
+    uint32_t phys;
+    uint32_t eflags;
+
+    /* A present PDE means some 4KB page of the chunk is already in use */
+    if (paging_large_pages_enabled() == 0 || (area->flags & VMA_TYPE_HEAP) == 0U ||
+        chunk < area->start || area->end - chunk < LARGE_PAGE_SIZE ||
+        paging_pde_present(chunk) != 0) {
+        return -1;
+    }
+
+    phys = pmm_alloc_frames(PMM_MAX_ORDER);
+    if (phys == 0U) {
+        return -1;
+    }
+
+    if (paging_map_large(chunk, phys, PAGE_USER | PAGE_WRITABLE) != 0) {
+        pmm_free_frames(phys, PMM_MAX_ORDER);
+        return -1;
+    }
+
+    /* Milliseconds of work: do it with IRQs on. The clock never evicts
+     * from 4MB pages, so the mapping is unchanged when the lock is back. */
+    eflags = vmm_lock_drop();
+    for (uint32_t offset = 0; offset < LARGE_PAGE_SIZE; offset += PAGE_SIZE) {
+        vmm_zero_page((uint8_t *)(uintptr_t)(chunk + offset));
+    }
+    vmm_lock_retake(eflags);
+    return 0;
+}
+
+static int vmm_demand_zero(uint32_t page, uint32_t write)
+{
+    struct vma area;
+    uint32_t phys;
+    uint32_t zeroed;
+
+    if (vmm_find_anon_area(page, &area) != 0 || (area.flags & VMA_READ) == 0U) {
+        return -1;
+    }
+
+    if ((area.flags & VMA_WRITE) == 0U) {
+        /* Never writable: the zero frame without PAGE_COW stays read-only */
+        if (write != 0U || vmm_zero_phys == 0U) {
+            return -1;
+        }
+        return paging_map_page(page, vmm_zero_phys, PAGE_USER);
+    }
+
+    if (vmm_demand_zero_large(page, &area) == 0) {
+        return 0;
+    }
+
+    if (write == 0U && vmm_zero_phys != 0U) {
+        return paging_map_page(page, vmm_zero_phys, PAGE_USER | PAGE_COW);
+    }
+
+    phys = pmm_alloc_zeroed_frame();
+    zeroed = (phys != 0U) ? 1U : 0U;
+    if (phys == 0U) {
+        phys = vmm_alloc_frame();
+    }
+    if (phys == 0U) {
+        serial_puts("[VMM] out of frames for demand-zero page\n");
+        return -1;
+    }
+
+    if (paging_map_page(page, phys, PAGE_USER | PAGE_WRITABLE | PAGE_ACCESSED) != 0) {
+        pmm_free_frame(phys);
+        return -1;
+    }
+
+    if (zeroed == 0U) {
+        vmm_zero_page((uint8_t *)(uintptr_t)page);
+    }
+    return 0;
+}
+
+/* Not-present fault: swapped-out page or untouched anonymous memory */
+static int vmm_fault_in(uint32_t page, uint32_t write)
+{
+    uint32_t entry = paging_get_entry(page);
+
+    if (swap_pte_is_swapped(entry) != 0) {
+        return vmm_swap_in(page, entry);
+    }
+    return vmm_demand_zero(page, write);
+}
+
+static int vmm_resolve_cow(uint32_t page)
+{
+    uint32_t entry = paging_get_entry(page);
+    uint32_t flags;
+    uint32_t old_phys;
+    uint32_t new_phys;
+    uint32_t new_flags;
+    uint8_t *dst;
+    const uint8_t *src;
+
+    if (paging_get_page_flags(page, &flags) != 0 || (flags & PAGE_COW) == 0U) {
+        return -1;
+    }
+
+    new_flags = (flags & ~(PAGE_COW | PAGE_PRESENT)) | PAGE_WRITABLE;
+    old_phys = paging_get_phys_addr(page) & PAGE_FRAME_MASK;
+
+    if (pmm_frame_is_shared(old_phys) == 0) {
+        /* Last owner: reuse the frame in place */
+        (void)paging_unmap_page(page);
+        return paging_map_page(page, old_phys, new_flags);
+    }
+
+    /* First write to the shared zero frame: a pre-zeroed frame needs no
+     * fill at all */
+    if (old_phys == vmm_zero_phys) {
+        new_phys = pmm_alloc_zeroed_frame();
+        if (new_phys != 0U) {
+            (void)paging_unmap_page(page);
+            if (paging_map_page(page, new_phys, new_flags) != 0) {
+                pmm_free_frame(new_phys);
+                (void)paging_map_page(page, old_phys, flags & ~PAGE_PRESENT);
+                return -1;
+            }
+            return 0;
+        }
+    }
+
+    new_phys = vmm_alloc_frame();
+    if (new_phys == 0U) {
+        serial_puts("[VMM] out of frames for copy-on-write\n");
+        return -1;
+    }
+
+    /* Reclaim may have dropped vmm_lock; once the frame turned private it
+     * could even have been evicted. Let the write fault again. */
+    if (paging_get_entry(page) != entry) {
+        pmm_free_frame(new_phys);
+        return 0;
+    }
+
+    /* With both frames in the physmap the new one is filled before it is
+     * mapped; otherwise the old contents go through the bounce buffer */
+    dst = (uint8_t *)phys_to_virt(new_phys);
+    src = (const uint8_t *)phys_to_virt(old_phys);
+    if (dst != 0 && src != 0) {
+        if (old_phys == vmm_zero_phys) {
+            vmm_zero_page(dst);
+        } else {
+            vmm_copy_page(dst, src);
+        }
+    } else if (old_phys != vmm_zero_phys) {
+        vmm_copy_page(vmm_copy_buffer, (const uint8_t *)(uintptr_t)page);
+    }
+
+    (void)paging_unmap_page(page);
+    if (paging_map_page(page, new_phys, new_flags) != 0) {
+        pmm_free_frame(new_phys);
+        (void)paging_map_page(page, old_phys, flags & ~PAGE_PRESENT);
+        return -1;
+    }
+
+    if (dst == 0 || src == 0) {
+        if (old_phys == vmm_zero_phys) {
+            vmm_zero_page((uint8_t *)(uintptr_t)page);
+        } else {
+            vmm_copy_page((uint8_t *)(uintptr_t)page, vmm_copy_buffer);
+        }
+    }
+
+    /* Drop this address space's share of the old frame */
+    pmm_free_frame(old_phys);
+    return 0;
+}
+
+void vmm_init(void)
+{
+    uint8_t *zero_page;
+    uint32_t cr0;
+
+    spinlock_init(&vmm_lock);
+
+    /* The zero frame stays mapped in the vmalloc area; pinning it makes
+     * every pmm_free_frame() from a user unmap a no-op */
+    zero_page = (uint8_t *)vmalloc(PAGE_SIZE);
+    if (zero_page != 0) {
+        vmm_zero_page(zero_page);
+        vmm_zero_phys = paging_get_phys_addr((uint32_t)(uintptr_t)zero_page);
+        if (pmm_pin_frame(vmm_zero_phys) != 0) {
+            vmm_zero_phys = 0U;
+        }
+    }
+    if (vmm_zero_phys == 0U) {
+        serial_puts("[VMM] zero page unavailable, heap reads get private frames\n");
+    }
+
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= VMM_CR0_WP;
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0) : "memory");
+
+    serial_puts("[VMM] CR0.WP enabled (copy-on-write)\n");
+}
+
+int vmm_handle_page_fault(struct isr_regs *regs)
+{
+    uint32_t fault_addr = vmm_read_cr2();
+    uint32_t flags;
+    int rc = -1;
+
+    if (regs == 0 || fault_addr >= VMM_USER_KERNEL_SPLIT) {
+        return -1;
+    }
+
+    flags = vmm_lock_enter(regs);
+    if ((regs->err_code & VMM_PF_PRESENT) == 0U) {
+        rc = vmm_fault_in(fault_addr & PAGE_FRAME_MASK,
+                          regs->err_code & VMM_PF_WRITE);
+    } else if ((regs->err_code & VMM_PF_WRITE) != 0U &&
+               vmm_write_allowed(fault_addr & PAGE_FRAME_MASK) != 0) {
+        rc = vmm_resolve_cow(fault_addr & PAGE_FRAME_MASK);
+    }
+    spinlock_unlock_irqrestore(&vmm_lock, flags);
+
+    return rc;
+}
+
+int vmm_prefault_user_range(uint32_t addr, uint32_t len, uint32_t write)
+{
+    uint32_t end = addr + len;
+    uint32_t flags;
+    int rc = 0;
+
+    if (len == 0U) {
+        return 0;
+    }
+
+    if (end < addr || end > VMM_USER_KERNEL_SPLIT) {
+        return -1;
+    }
+
+    flags = vmm_lock_enter(0);
+
+    for (uint32_t page = addr & PAGE_FRAME_MASK; page < end && rc == 0; page += PAGE_SIZE) {
+        uint32_t pte_flags;
+
+        if (paging_get_page_flags(page, &pte_flags) != 0 &&
+            (vmm_fault_in(page, write) != 0 ||
+             paging_get_page_flags(page, &pte_flags) != 0)) {
+            rc = -1;
+        } else if ((pte_flags & PAGE_USER) == 0U) {
+            rc = -1;    /* PROT_NONE */
+        } else if (write != 0U && (pte_flags & PAGE_WRITABLE) == 0U) {
+            rc = (vmm_write_allowed(page) != 0) ? vmm_resolve_cow(page) : -1;
+        }
+    }
+
+    spinlock_unlock_irqrestore(&vmm_lock, flags);
+    return rc;
+}
+
+static struct vma_space *vmm_current_vmas(void)
+{
+    const struct process *proc = process_get_current();
+
+    return (proc != 0) ? proc->vmas : 0;
+}
+
+/* Round a length up to whole pages; 0 for empty or overflowing lengths */
+static uint32_t vmm_page_round(uint32_t len)
+{
+    if (len == 0U || len > 0xFFFFFFFFU - (PAGE_SIZE - 1U)) {
+        return 0U;
+    }
+
+    return (len + PAGE_SIZE - 1U) & PAGE_FRAME_MASK;
+}
+
+/* Is [addr, addr + size) page aligned and inside the mmap window? */
+static int vmm_mmap_range_valid(uint32_t addr, uint32_t size)
+{
+    return (addr & (PAGE_SIZE - 1U)) == 0U && size != 0U &&
+           addr >= process_user_heap_limit() && addr < VMM_MMAP_END &&
+           size <= VMM_MMAP_END - addr;
+}
+
+/* PTE flags for the present pages of an area */
+static uint32_t vmm_area_page_flags(uint32_t area_flags)
+{
+    uint32_t page_flags = ((area_flags & VMA_PROT_MASK) != 0U) ? PAGE_USER : 0U;
+
+    if ((area_flags & VMA_TYPE_POPULATED) == 0U) {
+        page_flags |= PAGE_COW;
+    }
+    return page_flags;
+}
+
+/* Map one page of a file area: in place when the filesystem allows,
+ * otherwise a fresh kernel-only writable frame. Sets *copy_out when the
+ * page still has to be filled. Runs under vmm_lock. */
+static int vmm_map_file_page(uint32_t page, int32_t fd, uint32_t offset,
+                             uint32_t page_flags, uint32_t *copy_out)
+{
+    uint32_t phys;
+    uint32_t zeroed;
+
+    *copy_out = 0U;
+    if (vfs_map_page(fd, offset, &phys) == VFS_OK) {
+        return paging_map_page(page, phys, page_flags);
+    }
+
+    phys = pmm_alloc_zeroed_frame();
+    zeroed = (phys != 0U) ? 1U : 0U;
+    if (phys == 0U) {
+        phys = vmm_alloc_frame();
+    }
+    if (phys == 0U) {
+        serial_puts("[VMM] out of frames for file mapping\n");
+        return -1;
+    }
+
+    if (paging_map_page(page, phys, PAGE_WRITABLE) != 0) {
+        pmm_free_frame(phys);
+        return -1;
+    }
+
+    if (zeroed == 0U) {
+        vmm_zero_page((uint8_t *)(uintptr_t)page);
+    }
+    *copy_out = 1U;
+    return 0;
+}
+
+/* Fill a file area that is already in the set. Called without vmm_lock:
+ * the reads may be disk I/O, and only the mapping task (stuck in mmap)
+ * can reach the kernel-only pages meanwhile. The tail past end of file
+ * stays zero. */
+static int vmm_populate_file(uint32_t start, uint32_t size, int32_t fd,
+                             uint32_t offset, uint32_t page_flags)
+{
+    uint32_t flags;
+    int rc = 0;
+
+    for (uint32_t done = 0U; rc == 0 && done < size; done += PAGE_SIZE) {
+        uint32_t page = start + done;
+        uint32_t copy;
+
+        flags = vmm_lock_enter(0);
+        rc = vmm_map_file_page(page, fd, offset + done, page_flags, &copy);
+        spinlock_unlock_irqrestore(&vmm_lock, flags);
+
+        if (rc == 0 && copy != 0U &&
+            vfs_pread(fd, offset + done, (void *)(uintptr_t)page, PAGE_SIZE) < 0) {
+            rc = -1;
+        }
+    }
+
+    if (rc == 0) {
+        flags = vmm_lock_enter(0);
+        rc = paging_protect_range(start, size, page_flags);
+        spinlock_unlock_irqrestore(&vmm_lock, flags);
+    }
+    return rc;
+}
+
+int vmm_mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t fixed,
+             int32_t fd, uint32_t offset, uint32_t *addr_out)
+{
+    struct vma_space *space = vmm_current_vmas();
+    uint32_t size = vmm_page_round(len);
+    uint32_t type = (fd < 0) ? VMA_TYPE_ANON : VMA_TYPE_FILE;
+    uint32_t start = addr;
+    uint32_t flags;
+    int rc = 0;
+
+    if (space == 0 || addr_out == 0 || size == 0U || (prot & ~VMA_PROT_MASK) != 0U) {
+        return -1;
+    }
+
+    if (type == VMA_TYPE_FILE &&
+        ((prot & VMA_WRITE) != 0U || (offset & (PAGE_SIZE - 1U)) != 0U ||
+         offset > 0xFFFFFFFFU - size)) {
+        return -1;
+    }
+
+    if (fixed != 0U &&
+        (vmm_mmap_range_valid(addr, size) == 0 || vmm_munmap(addr, size) != 0)) {
+        return -1;
+    }
+
+    flags = vmm_lock_enter(0);
+
+    /* Honour a free, valid hint; otherwise first fit in the window */
+    if (fixed == 0U &&
+        (vmm_mmap_range_valid(addr, size) == 0 ||
+         vma_find_gap(space, addr, addr + size, size, &start) != 0) &&
+        vma_find_gap(space, process_user_heap_limit(), VMM_MMAP_END, size, &start) != 0) {
+        rc = -1;
+    }
+
+    if (rc == 0) {
+        rc = vma_map(space, start, start + size, type | prot);
+    }
+
+    spinlock_unlock_irqrestore(&vmm_lock, flags);
+
+    /* The area now reserves the range; fill it with IRQs on */
+    if (rc == 0 && type == VMA_TYPE_FILE &&
+        vmm_populate_file(start, size, fd, offset, vmm_area_page_flags(type | prot)) != 0) {
+        flags = vmm_lock_enter(0);
+        (void)paging_unmap_range(start, size, 1, 0);
+        (void)vma_unmap(space, start, start + size);
+        spinlock_unlock_irqrestore(&vmm_lock, flags);
+        rc = -1;
+    }
+
+    if (rc == 0) {
+        *addr_out = start;
+    }
+    return rc;
+}
+
+int vmm_munmap(uint32_t addr, uint32_t len)
+{
+    struct vma_space *space = vmm_current_vmas();
+    uint32_t size = vmm_page_round(len);
+    uint32_t flags;
+    int rc;
+
+    if (space == 0 || vmm_mmap_range_valid(addr, size) == 0) {
+        return -1;
+    }
+
+    /* Pages first: if that fails nothing changed, while the area set can
+     * only fail (table full) after the pages are gone, which leaves no
+     * mapping outside an area */
+    flags = vmm_lock_enter(0);
+    rc = paging_unmap_range(addr, size, 1, 0);
+    if (rc == 0) {
+        rc = vma_unmap(space, addr, addr + size);
+    }
+    spinlock_unlock_irqrestore(&vmm_lock, flags);
+
+    return rc;
+}
+
+int vmm_mprotect(uint32_t addr, uint32_t len, uint32_t prot)
+{
+    struct vma_space *space = vmm_current_vmas();
+    uint32_t size = vmm_page_round(len);
+    uint32_t end = addr + size;
+    uint32_t flags;
+    int rc;
+
+    if (space == 0 || vmm_mmap_range_valid(addr, size) == 0) {
+        return -1;
+    }
+
+    /* Split 4MB pages before the areas change; after that the per-area
+     * rewrites below cannot fail half way */
+    flags = vmm_lock_enter(0);
+    rc = paging_split_range(addr, size);
+    if (rc == 0) {
+        rc = vma_protect(space, addr, end, prot);
+    }
+
+    /* The range is now covered by areas; apply each one's page flags */
+    for (uint32_t va = addr; rc == 0 && va < end; ) {
+        struct vma area;
+        uint32_t chunk_end;
+
+        if (vma_find(space, va, &area) != 0) {
+            rc = -1;
+            break;
+        }
+
+        chunk_end = (area.end < end) ? area.end : end;
+        rc = paging_protect_range(va, chunk_end - va, vmm_area_page_flags(area.flags));
+        va = chunk_end;
+    }
+    spinlock_unlock_irqrestore(&vmm_lock, flags);
+
+    return rc;
+}
@@ -0,0 +1,44 @@
+#ifndef CLAUDE_VMM_H
+#define CLAUDE_VMM_H
+
+#include <stdint.h>
+
+#include "isr.h"
+
+/* End of the user window for mmap; it starts at the heap limit, and the
+ * ELF stack area sits above it */
+#define VMM_MMAP_END        0xBF000000U
+
+/* Page-fault error code bits */
+#define VMM_PF_PRESENT      0x1U
+#define VMM_PF_WRITE        0x2U
+#define VMM_PF_USER         0x4U
+
+/* Set up the shared zero frame and enable CR0.WP so kernel-mode writes
+ * honour read-only (copy-on-write) user pages. Runs after vmalloc_init(). */
+void vmm_init(void);
+
+/* Try to resolve a page fault (vector 14). Returns 0 when the faulting
+ * access can be retried, -1 when the fault is fatal. */
+int vmm_handle_page_fault(struct isr_regs *regs);
+
+/* Make sure every page of a user range is mapped (populating demand-zero
+ * heap pages), and privately writable if 'write' is set. Used by syscalls
+ * before touching user buffers. Returns 0 or -1. */
+int vmm_prefault_user_range(uint32_t addr, uint32_t len, uint32_t write);
+
+/* Map 'len' bytes into the current process: anonymous zero-fill memory
+ * when fd < 0, otherwise a read-only copy-free (where the filesystem
+ * allows) view of an open file from page-aligned 'offset'. 'prot' is a
+ * VMA_READ/WRITE/EXEC mask. Without 'fixed', 'addr' is only a hint; with
+ * it, whatever was mapped at [addr, addr + len) is replaced. Returns 0 and
+ * the start address, or -1. */
+int vmm_mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t fixed,
+             int32_t fd, uint32_t offset, uint32_t *addr_out);
+
+/* Unmap / change access rights of part of the mmap window.
+ * Returns 0 or -1. */
+int vmm_munmap(uint32_t addr, uint32_t len);
+int vmm_mprotect(uint32_t addr, uint32_t len, uint32_t prot);
+
+#endif /* CLAUDE_VMM_H */
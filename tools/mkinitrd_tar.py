@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Create the ClaudeOS initrd as a ustar archive whose regular-file data is
+page aligned.
+
+The kernel embeds the archive at a page-aligned address and lets user
+programs mmap initrd files by mapping the archive pages directly. That only
+works when every file's data starts on a 4 KiB boundary, which plain tar does
+not guarantee. Before each file that would land off a boundary, this tool
+inserts a pax extended header ('x') holding a single "comment" record sized
+to push the file's data onto the next boundary. Readers ignore the comment,
+so the result is still an ordinary tar archive.
+
+Usage: mkinitrd_tar.py <output.tar> <root directory>
+"""
+
+from __future__ import annotations
+
+import sys
+from pathlib import Path
+
+
+BLOCK_SIZE = 512
+PAGE_SIZE = 4096
+
+
+def octal_field(value: int, width: int) -> bytes:
+    return ("%0*o" % (width - 1, value)).encode("ascii") + b"\0"
+
+
+def make_header(name: str, size: int, typeflag: bytes, mode: int) -> bytes:
+    encoded = name.encode("utf-8")
+    prefix = b""
+    if len(encoded) > 100:
+        split = encoded.rfind(b"/", 0, 156)
+        if split <= 0 or len(encoded) - split - 1 > 100:
+            raise ValueError("path too long for ustar: %s" % name)
+        prefix = encoded[:split]
+        encoded = encoded[split + 1:]
+
+    header = bytearray(BLOCK_SIZE)
+    header[0:len(encoded)] = encoded
+    header[100:108] = octal_field(mode, 8)
+    header[108:116] = octal_field(0, 8)
+    header[116:124] = octal_field(0, 8)
+    header[124:136] = octal_field(size, 12)
+    header[136:148] = octal_field(0, 12)
+    header[148:156] = b" " * 8
+    header[156:157] = typeflag
+    header[257:263] = b"ustar\0"
+    header[263:265] = b"00"
+    header[345:345 + len(prefix)] = prefix
+
+    checksum = sum(header)
+    header[148:156] = ("%06o" % checksum).encode("ascii") + b"\0 "
+    return bytes(header)
+
+
+def pad_block(data: bytes) -> bytes:
+    remainder = len(data) % BLOCK_SIZE
+    if remainder == 0:
+        return data
+    return data + b"\0" * (BLOCK_SIZE - remainder)
+
+
+def comment_record(length: int) -> bytes:
+    """One pax record of exactly 'length' bytes: '<len> comment=<fill>\\n'."""
+    if length == 0:
+        return b""
+    body_len = length - len(str(length)) - len(" comment=") - 1
+    return ("%d comment=%s\n" % (length, "x" * body_len)).encode("ascii")
+
+
+def alignment_padding(offset: int, name: str) -> bytes:
+    """Entries to add at 'offset' so the next header's data is page aligned."""
+    header_target = PAGE_SIZE - BLOCK_SIZE
+    if offset % PAGE_SIZE == header_target:
+        return b""
+
+    # pax header block plus 'blocks' data blocks, then the file header
+    blocks = ((header_target - offset - BLOCK_SIZE) % PAGE_SIZE) // BLOCK_SIZE
+    record = comment_record(blocks * BLOCK_SIZE)
+    pax_name = "PaxHeaders/" + name.rsplit("/", 1)[-1]
+    return make_header(pax_name[:100], len(record), b"x", 0o644) + record
+
+
+def build_archive(root: Path) -> bytes:
+    out = bytearray()
+
+    for path in sorted(root.rglob("*")):
+        name = "./" + path.relative_to(root).as_posix()
+
+        if path.is_dir():
+            out += make_header(name + "/", 0, b"5", 0o755)
+            continue
+
+        data = path.read_bytes()
+        out += alignment_padding(len(out), name)
+        out += make_header(name, len(data), b"0", 0o644)
+        assert len(out) % PAGE_SIZE == 0
+        out += pad_block(data)
+
+    out += b"\0" * (2 * BLOCK_SIZE)
+    return bytes(out)
+
+
+def main() -> int:
+    if len(sys.argv) != 3:
+        print("usage: %s <output.tar> <root directory>" % sys.argv[0], file=sys.stderr)
+        return 1
+
+    archive = build_archive(Path(sys.argv[2]))
+    Path(sys.argv[1]).write_bytes(archive)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -181,16 +181,11 @@ void DG_DrawFrame(void)
 
 void DG_SleepMs(uint32_t ms)
 {
-    uint32_t deadline;
-
     if (ms == 0U) {
         return;
     }
 
-    deadline = ticks_ms() + ms;
-    while ((int32_t)(deadline - ticks_ms()) > 0) {
-        __asm__ volatile ("pause");
-    }
+    (void)sleep_ms(ms);
 }
 
 uint32_t DG_GetTicksMs(void)
@@ -4,5 +4,6 @@
 extern int errno;
 
 #define EISDIR 21
+#define EINVAL 22
 
 #endif /* CLAUDE_USER_LIBC_ERRNO_H */
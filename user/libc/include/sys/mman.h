@@ -0,0 +1,26 @@
+#ifndef CLAUDE_USER_LIBC_SYS_MMAN_H
+#define CLAUDE_USER_LIBC_SYS_MMAN_H
+
+#include <stddef.h>
+
+#include "sys/types.h"
+
+#define PROT_NONE      0x0
+#define PROT_READ      0x1
+#define PROT_WRITE     0x2
+#define PROT_EXEC      0x4
+
+/* Only MAP_PRIVATE mappings are supported; file mappings are read-only */
+#define MAP_SHARED     0x01
+#define MAP_PRIVATE    0x02
+#define MAP_FIXED      0x10
+#define MAP_ANONYMOUS  0x20
+#define MAP_ANON       MAP_ANONYMOUS
+
+#define MAP_FAILED     ((void *)-1)
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+int mprotect(void *addr, size_t len, int prot);
+
+#endif /* CLAUDE_USER_LIBC_SYS_MMAN_H */
@@ -0,0 +1,26 @@
+#ifndef CLAUDE_USER_LIBC_TIME_H
+#define CLAUDE_USER_LIBC_TIME_H
+
+#include <stdint.h>
+
+typedef int32_t time_t;
+typedef int32_t clockid_t;
+
+/* Both count from boot: there is no RTC driver */
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+    time_t tv_sec;
+    long tv_nsec;
+};
+
+/* Read 'clock_id' with nanosecond resolution (TSC-based when the kernel
+ * could calibrate it). Returns 0, or -1 with errno set. */
+int clock_gettime(clockid_t clock_id, struct timespec *ts);
+
+/* Block for at least *req (rounded up to whole milliseconds). Never
+ * interrupted early, so *rem, if given, is always zeroed. */
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+#endif /* CLAUDE_USER_LIBC_TIME_H */
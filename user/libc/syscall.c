@@ -1,4 +1,7 @@
+#include "errno.h"
+#include "time.h"
 #include "unistd.h"
+#include "sys/mman.h"
 
 #include <stdint.h>
 
@@ -16,6 +19,101 @@
 #define SYSCALL_TICKS_MS 12U
 #define SYSCALL_LSEEK 13U
 #define SYSCALL_FB_PRESENT 14U
+#define SYSCALL_MMAP 15U
+#define SYSCALL_MUNMAP 16U
+#define SYSCALL_MPROTECT 17U
+#define SYSCALL_SLEEP_MS 18U
+#define SYSCALL_CLOCK_GETTIME 19U
+
+/* Matches the kernel's struct syscall_mmap_args */
+struct mmap_args {
+    uint32_t addr;
+    uint32_t len;
+    uint32_t prot;
+    uint32_t flags;
+    int32_t fd;
+    uint32_t offset;
+};
+
+/* Read-only kernel data page; matches the kernel's struct vdso_data */
+#define VDSO_USER_VA 0xBFFFF000U
+
+struct vdso_data {
+    volatile uint32_t seq;
+    uint32_t ticks;
+    uint32_t tick_hz;
+    uint32_t tsc_khz;
+    uint32_t tsc_mult;
+    uint32_t tsc_shift;
+    uint32_t tsc_base_lo;
+    uint32_t tsc_base_hi;
+    uint32_t pid;
+};
+
+static inline const volatile struct vdso_data *vdso_data(void)
+{
+    return (const volatile struct vdso_data *)(uintptr_t)VDSO_USER_VA;
+}
+
+static inline uint64_t vdso_rdtsc(void)
+{
+    uint32_t lo;
+    uint32_t hi;
+
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* 64-by-32 division in two divl steps (no libgcc helper needed) */
+static uint64_t vdso_div64(uint64_t n, uint32_t d, uint32_t *rem)
+{
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+
+    __asm__ ("divl %4" : "=a"(q_lo), "=d"(r) : "a"((uint32_t)n), "d"(r), "rm"(d));
+
+    if (rem != 0) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+/* Nanoseconds since boot, computed from the data page without a syscall.
+ * Retries while the kernel is mid-update (odd or changed sequence). */
+static uint64_t vdso_monotonic_ns(void)
+{
+    const volatile struct vdso_data *data = vdso_data();
+    uint32_t seq;
+    uint32_t ticks;
+    uint32_t tick_hz;
+    uint32_t khz;
+    uint32_t mult;
+    uint32_t shift;
+    uint64_t base;
+    uint64_t delta;
+
+    do {
+        seq = data->seq;
+        __asm__ volatile ("" : : : "memory");
+        ticks = data->ticks;
+        tick_hz = data->tick_hz;
+        khz = data->tsc_khz;
+        mult = data->tsc_mult;
+        shift = data->tsc_shift;
+        base = ((uint64_t)data->tsc_base_hi << 32) | data->tsc_base_lo;
+        __asm__ volatile ("" : : : "memory");
+    } while ((seq & 1U) != 0U || data->seq != seq);
+
+    if (khz == 0U) {
+        return (uint64_t)ticks * (1000000000U / tick_hz);
+    }
+
+    delta = vdso_rdtsc() - base;
+    return (((uint64_t)(uint32_t)(delta >> 32) * mult) << (32U - shift))
+           + (((uint64_t)(uint32_t)delta * mult) >> shift);
+}
 
 static inline uint32_t syscall3(uint32_t number, uint32_t arg0, uint32_t arg1,
                                 uint32_t arg2)
@@ -66,7 +164,7 @@ int exec(const char *path)
 
 int getpid(void)
 {
-    return (int)(int32_t)syscall3(SYSCALL_GETPID, 0U, 0U, 0U);
+    return (int)vdso_data()->pid;
 }
 
 int proc_count(void)
@@ -96,7 +194,77 @@ int fb_present(const void *pixels, uint32_t width, uint32_t height)
 
 uint32_t ticks_ms(void)
 {
-    return syscall3(SYSCALL_TICKS_MS, 0U, 0U, 0U);
+    return (uint32_t)vdso_div64(vdso_monotonic_ns(), 1000000U, 0);
+}
+
+int sleep_ms(uint32_t ms)
+{
+    return (int)(int32_t)syscall3(SYSCALL_SLEEP_MS, ms, 0U, 0U);
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec *ts)
+{
+    uint32_t nsec;
+
+    if (ts == 0 || (clock_id != CLOCK_REALTIME && clock_id != CLOCK_MONOTONIC)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ts->tv_sec = (time_t)vdso_div64(vdso_monotonic_ns(), 1000000000U, &nsec);
+    ts->tv_nsec = (long)nsec;
+    return 0;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+    uint32_t ms;
+
+    if (req == 0 || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000L) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Millisecond granularity, rounded up so we never wake early */
+    if ((uint32_t)req->tv_sec >= 0xFFFFFFFFU / 1000U) {
+        ms = 0xFFFFFFFFU;
+    } else {
+        ms = (uint32_t)req->tv_sec * 1000U + ((uint32_t)req->tv_nsec + 999999U) / 1000000U;
+    }
+    (void)sleep_ms(ms);
+
+    if (rem != 0) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return 0;
+}
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+    struct mmap_args args;
+
+    args.addr = (uint32_t)(uintptr_t)addr;
+    args.len = (uint32_t)len;
+    args.prot = (uint32_t)prot;
+    args.flags = (uint32_t)flags;
+    args.fd = fd;
+    args.offset = (uint32_t)offset;
+
+    return (void *)(uintptr_t)syscall3(SYSCALL_MMAP, (uint32_t)(uintptr_t)&args,
+                                       0U, 0U);
+}
+
+int munmap(void *addr, size_t len)
+{
+    return (int)(int32_t)syscall3(SYSCALL_MUNMAP, (uint32_t)(uintptr_t)addr,
+                                  (uint32_t)len, 0U);
+}
+
+int mprotect(void *addr, size_t len, int prot)
+{
+    return (int)(int32_t)syscall3(SYSCALL_MPROTECT, (uint32_t)(uintptr_t)addr,
+                                  (uint32_t)len, (uint32_t)prot);
 }
 
 void *sbrk(int32_t increment)
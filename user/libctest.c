@@ -1,12 +1,235 @@
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
+#include "time.h"
 #include "unistd.h"
+#include "sys/mman.h"
 #include <stdint.h>
 
 #define LIBCTEST_BUF_LEN  160U
 #define LIBCTEST_HEAP_PROBE_BYTES  (20U * 1024U * 1024U)
 #define LIBCTEST_HEAP_PROBE_STEP   4096U
+#define LIBCTEST_SLEEP_MS          10U
+#define LIBCTEST_SLEEP_ROUNDS      5U
+#define LIBCTEST_PAGE_SIZE         4096U
+#define LIBCTEST_MAP_FILE          "/hello.txt"
+#define LIBCTEST_CHILD_WAIT_ROUNDS 100U
+#define LIBCTEST_SYSCALL_GETPID    9U
+
+/* Anonymous maps: write and read back, upgrade a read-only map with
+ * mprotect, and check a map placed after munmap starts out zeroed */
+static void libctest_mmap(void)
+{
+    volatile uint8_t *page;
+    uint32_t i;
+
+    page = (volatile uint8_t *)mmap(0, LIBCTEST_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *)page == MAP_FAILED) {
+        printf("[LIBC] mmap anonymous failed\n");
+        return;
+    }
+    for (i = 0U; i < LIBCTEST_PAGE_SIZE; i++) {
+        page[i] = (uint8_t)i;
+    }
+    for (i = 0U; i < LIBCTEST_PAGE_SIZE; i++) {
+        if (page[i] != (uint8_t)i) {
+            break;
+        }
+    }
+    printf((i == LIBCTEST_PAGE_SIZE) ? "[LIBC] mmap anonymous readback ok\n" :
+                                       "[LIBC] mmap anonymous readback mismatch\n");
+
+    if (munmap((void *)page, LIBCTEST_PAGE_SIZE) != 0) {
+        printf("[LIBC] munmap failed\n");
+        return;
+    }
+
+    page = (volatile uint8_t *)mmap(0, LIBCTEST_PAGE_SIZE, PROT_READ,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *)page == MAP_FAILED) {
+        printf("[LIBC] mmap after munmap failed\n");
+        return;
+    }
+    for (i = 0U; i < LIBCTEST_PAGE_SIZE; i++) {
+        if (page[i] != 0U) {
+            break;
+        }
+    }
+    printf((i == LIBCTEST_PAGE_SIZE) ? "[LIBC] mmap after munmap zeroed ok\n" :
+                                       "[LIBC] mmap after munmap not zeroed\n");
+
+    if (mprotect((void *)page, LIBCTEST_PAGE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        printf("[LIBC] mprotect PROT_WRITE failed\n");
+    } else {
+        page[0] = 0xA5U;
+        printf((page[0] == 0xA5U) ? "[LIBC] mprotect PROT_WRITE ok\n" :
+                                    "[LIBC] mprotect PROT_WRITE lost the write\n");
+    }
+    (void)munmap((void *)page, LIBCTEST_PAGE_SIZE);
+}
+
+/* A read-only file map must show the same bytes read() returns */
+static void libctest_file_map(void)
+{
+    char expect[LIBCTEST_BUF_LEN];
+    const char *mapped;
+    ssize_t nread;
+    int fd;
+
+    fd = open(LIBCTEST_MAP_FILE, O_READ);
+    if (fd < 0) {
+        printf("[LIBC] open %s failed\n", LIBCTEST_MAP_FILE);
+        return;
+    }
+    nread = read(fd, expect, sizeof(expect));
+    if (nread <= 0) {
+        printf("[LIBC] read %s failed\n", LIBCTEST_MAP_FILE);
+        (void)close(fd);
+        return;
+    }
+
+    mapped = (const char *)mmap(0, LIBCTEST_PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if ((const void *)mapped == MAP_FAILED) {
+        printf("[LIBC] mmap %s failed\n", LIBCTEST_MAP_FILE);
+        return;
+    }
+    if (memcmp(mapped, expect, (size_t)nread) == 0) {
+        printf("[LIBC] mmap %s matches read (%u bytes)\n",
+               LIBCTEST_MAP_FILE, (unsigned)nread);
+    } else {
+        printf("[LIBC] mmap %s differs from read\n", LIBCTEST_MAP_FILE);
+    }
+    (void)munmap((void *)mapped, LIBCTEST_PAGE_SIZE);
+}
+
+/* There is no wait(): poll until the process count drops back */
+static void libctest_wait_child(int before)
+{
+    uint32_t round;
+
+    for (round = 0U; round < LIBCTEST_CHILD_WAIT_ROUNDS; round++) {
+        if (proc_count() <= before) {
+            return;
+        }
+        (void)sleep_ms(LIBCTEST_SLEEP_MS);
+    }
+    printf("[LIBC] child did not exit\n");
+}
+
+/* getpid() reads the vdso page; ask the kernel directly to cross-check */
+static int libctest_syscall_getpid(void)
+{
+    uint32_t ret;
+
+    __asm__ volatile ("int $0x80"
+                      : "=a"(ret)
+                      : "a"(LIBCTEST_SYSCALL_GETPID), "b"(0U), "c"(0U), "d"(0U)
+                      : "memory", "cc");
+    return (int)ret;
+}
+
+static void libctest_check_getpid(const char *who)
+{
+    int vdso_pid = getpid();
+    int kernel_pid = libctest_syscall_getpid();
+
+    if (vdso_pid == kernel_pid) {
+        printf("[LIBC] %s getpid ok (pid=%d)\n", who, vdso_pid);
+    } else {
+        printf("[LIBC] %s getpid=%d but kernel pid=%d\n", who, vdso_pid, kernel_pid);
+    }
+}
+
+/* The vdso pid must follow the process across fork in both directions */
+static void libctest_fork_getpid(void)
+{
+    int before;
+    int pid;
+
+    before = proc_count();
+    pid = fork();
+    if (pid < 0) {
+        printf("[LIBC] fork failed\n");
+        return;
+    }
+    if (pid == 0) {
+        libctest_check_getpid("child");
+        exit(0);
+    }
+
+    libctest_wait_child(before);
+    libctest_check_getpid("parent");
+}
+
+static uint64_t libctest_timespec_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000U + (uint64_t)ts->tv_nsec;
+}
+
+/* CLOCK_MONOTONIC must move forward by at least the time slept */
+static void libctest_clock_monotonic(void)
+{
+    struct timespec before;
+    struct timespec after;
+    uint64_t elapsed_ns;
+    uint32_t elapsed_us;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &before) != 0) {
+        printf("[LIBC] clock_gettime failed\n");
+        return;
+    }
+    (void)sleep_ms(LIBCTEST_SLEEP_MS);
+    if (clock_gettime(CLOCK_MONOTONIC, &after) != 0) {
+        printf("[LIBC] clock_gettime failed\n");
+        return;
+    }
+
+    if (libctest_timespec_ns(&after) <= libctest_timespec_ns(&before)) {
+        printf("[LIBC] CLOCK_MONOTONIC went backwards\n");
+        return;
+    }
+    elapsed_ns = libctest_timespec_ns(&after) - libctest_timespec_ns(&before);
+    /* No libgcc for a 64-bit divide; a 10ms sleep fits in 32 bits */
+    elapsed_us = (elapsed_ns > 0xFFFFFFFFU) ? 0xFFFFFFFFU / 1000U :
+                                              (uint32_t)elapsed_ns / 1000U;
+    if (elapsed_ns >= (uint64_t)LIBCTEST_SLEEP_MS * 1000000U) {
+        printf("[LIBC] CLOCK_MONOTONIC ok across sleep_ms(%u) (%u us)\n",
+               (unsigned)LIBCTEST_SLEEP_MS, (unsigned)elapsed_us);
+    } else {
+        printf("[LIBC] CLOCK_MONOTONIC advanced only %u us across sleep_ms(%u)\n",
+               (unsigned)elapsed_us, (unsigned)LIBCTEST_SLEEP_MS);
+    }
+}
+
+/* After fork both sides share the page copy-on-write: the child's write
+ * must land in its own copy and leave the parent's untouched */
+static void libctest_cow_fork(void)
+{
+    static char cow_buf[LIBCTEST_PAGE_SIZE];
+    int before;
+    int pid;
+
+    strcpy(cow_buf, "parent");
+    before = proc_count();
+    pid = fork();
+    if (pid < 0) {
+        printf("[LIBC] fork failed\n");
+        return;
+    }
+    if (pid == 0) {
+        if (strcmp(cow_buf, "parent") != 0) {
+            printf("[LIBC] COW child did not inherit the buffer\n");
+        }
+        strcpy(cow_buf, "child");
+        exit(0);
+    }
+
+    libctest_wait_child(before);
+    printf((strcmp(cow_buf, "parent") == 0) ? "[LIBC] COW fork ok\n" :
+                                              "[LIBC] COW fork leaked the child's write\n");
+}
 
 int main(void)
 {
@@ -16,6 +239,9 @@ int main(void)
     char status[64];
     void *heap_probe;
     uint32_t offset;
+    uint32_t round;
+    uint32_t shortest;
+    uint8_t zeroed;
 
     printf("[LIBC] user C program started\n");
 
@@ -65,17 +291,50 @@ int main(void)
     free(buf);
     buf = 0;
 
+    libctest_mmap();
+    libctest_file_map();
+    libctest_cow_fork();
+    libctest_fork_getpid();
+    libctest_clock_monotonic();
+
+    /* A sleep must never end before the requested time, whatever point
+     * of the current tick it starts at */
+    shortest = 0xFFFFFFFFU;
+    for (round = 0U; round < LIBCTEST_SLEEP_ROUNDS; round++) {
+        uint32_t start = ticks_ms();
+        uint32_t elapsed;
+
+        (void)sleep_ms(LIBCTEST_SLEEP_MS);
+        elapsed = ticks_ms() - start;
+        if (elapsed < shortest) {
+            shortest = elapsed;
+        }
+    }
+    if (shortest >= LIBCTEST_SLEEP_MS) {
+        printf("[LIBC] sleep_ms(%u) ok (shortest=%u ms)\n",
+               (unsigned)LIBCTEST_SLEEP_MS, (unsigned)shortest);
+    } else {
+        printf("[LIBC] sleep_ms(%u) returned early (%u ms)\n",
+               (unsigned)LIBCTEST_SLEEP_MS, (unsigned)shortest);
+    }
+
     heap_probe = sbrk((int32_t)LIBCTEST_HEAP_PROBE_BYTES);
     if (heap_probe == (void *)0xFFFFFFFFU) {
         printf("[LIBC] sbrk 20MiB failed\n");
         goto done;
     }
 
+    /* New heap pages are demand-zero: each must read 0 before its write */
+    zeroed = 1U;
     for (offset = 0U; offset < LIBCTEST_HEAP_PROBE_BYTES;
          offset += LIBCTEST_HEAP_PROBE_STEP) {
+        if (((volatile uint8_t *)heap_probe)[offset] != 0U) {
+            zeroed = 0U;
+        }
         ((volatile uint8_t *)heap_probe)[offset] = (uint8_t)(offset / LIBCTEST_HEAP_PROBE_STEP);
     }
-    printf("[LIBC] sbrk 20MiB ok\n");
+    printf((zeroed != 0U) ? "[LIBC] sbrk 20MiB ok (demand-zero)\n" :
+                            "[LIBC] sbrk 20MiB pages not zeroed\n");
 
     if (sbrk(-((int32_t)LIBCTEST_HEAP_PROBE_BYTES)) == (void *)0xFFFFFFFFU) {
         printf("[LIBC] sbrk 20MiB release failed\n");